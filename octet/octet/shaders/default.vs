@@ -4,8 +4,16 @@
 //
 
 // matrices
-uniform mat4 modelToProjection;
-uniform mat4 modelToCamera;
+#ifdef INSTANCED
+  // instanced draws read each object's matrix from the instance buffer
+  uniform mat4 cameraToProjection;
+  attribute mat4 instance_modelToCamera;
+  #define modelToCamera instance_modelToCamera
+  #define modelToProjection (cameraToProjection * instance_modelToCamera)
+#else
+  uniform mat4 modelToProjection;
+  uniform mat4 modelToCamera;
+#endif
 
 // attributes from vertex buffer
 attribute vec4 pos;
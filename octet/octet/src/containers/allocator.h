@@ -53,6 +53,7 @@ namespace octet { namespace containers {
     // singleton state, a bit like an old-world global variable
     struct state_t {
       size_t num_bytes;
+      size_t peak_bytes;
     };
 
     static state_t &state() {
@@ -64,6 +65,7 @@ namespace octet { namespace containers {
     // todo: implement this from scratch using a pool allocator
     static void *malloc(size_t size) {
       state().num_bytes += size;
+      if (state().num_bytes > state().peak_bytes) state().peak_bytes = state().num_bytes;
       #if OCTET_SSE
         void *res = ::_aligned_malloc(size, 16);
       #elif OCTET_VITA
@@ -87,6 +89,7 @@ namespace octet { namespace containers {
 
     static void *realloc(void *ptr, size_t old_size, size_t size) {
       state().num_bytes += size - old_size;
+      if (state().num_bytes > state().peak_bytes) state().peak_bytes = state().num_bytes;
       #if OCTET_SSE
         void *res = ::_aligned_realloc(ptr, size, 16);
       #else
@@ -96,6 +99,21 @@ namespace octet { namespace containers {
       return res;
     }
 
+    // number of bytes currently allocated
+    static size_t get_num_bytes() {
+      return state().num_bytes;
+    }
+
+    // high water mark of allocated bytes since startup or the last reset_peak_bytes()
+    static size_t get_peak_bytes() {
+      return state().peak_bytes;
+    }
+
+    // start measuring the high water mark from the current allocation
+    static void reset_peak_bytes() {
+      state().peak_bytes = state().num_bytes;
+    }
+
     // crude check of stack integrity
     static void test(const char *label) {
       printf("test %s\n", label);
@@ -9,7 +9,10 @@
 
 #include "../../octet.h"
 #include "xbox_controller.h"
+#include "node_motion_state.h"
+#include "vehicle_fleet.h"
 #include "vehicle.h"
+#include "track_format.h"
 #include "race_track.h"
 #include "wreck_game.h"
 
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// node_motion_state.h - bullet motion states that drive scene nodes
+//
+
+namespace octet {
+  class motion_state_sync;
+
+  ///Motion state that connects a rigid body to the scene_node that draws it.
+  ///Bullet only calls setWorldTransform for bodies that are awake and not static, so the
+  ///motion state records the last two physics transforms and adds itself to the list of moving
+  ///bodies kept by a motion_state_sync. Sleeping and static bodies cost nothing per frame.
+  class node_motion_state : public btMotionState {
+    friend class motion_state_sync;
+
+    ref<scene_node> node; //node to write the interpolated transform to
+    motion_state_sync *sync; //owner of the moving list
+    btTransform prev_transform; //transform before the last physics tick
+    btTransform cur_transform; //transform after the last physics tick
+    unsigned last_tick; //physics tick in which the body last moved
+    int moving_index; //index in the moving list, -1 if not in it
+
+  public:
+    node_motion_state(scene_node *node, const btTransform &transform, motion_state_sync *sync) {
+      this->node = node;
+      this->sync = sync;
+      prev_transform = cur_transform = transform;
+      last_tick = 0;
+      moving_index = -1;
+      mat4t mat;
+      transform.getOpenGLMatrix(mat.get());
+      node->set_nodeToParent(mat);
+    }
+
+    ~node_motion_state();
+
+    ///Bullet reads the initial transform when the body is created.
+    void getWorldTransform(btTransform &transform) const {
+      transform = cur_transform;
+    }
+
+    ///Bullet writes the new transform of a moving body after each step.
+    void setWorldTransform(const btTransform &transform);
+
+    ///Teleport: use when the body is moved by hand, so the next frame does not interpolate from the old place.
+    void reset(const btTransform &transform) {
+      prev_transform = cur_transform = transform;
+      mat4t mat;
+      transform.getOpenGLMatrix(mat.get());
+      node->set_nodeToParent(mat);
+    }
+
+    ///the node this motion state drives
+    scene_node *get_node() {
+      return node;
+    }
+  };
+
+  ///Keeps a compact list of the bodies that moved in the last physics tick.
+  ///Call begin_step() before each stepSimulation and update_nodes() once per frame;
+  ///the cost of update_nodes() depends only on the number of moving bodies.
+  class motion_state_sync {
+    friend class node_motion_state;
+
+    dynarray<node_motion_state*> moving; //bodies to interpolate
+    unsigned tick; //current physics tick
+
+    void add_moving(node_motion_state *state) {
+      state->moving_index = moving.size();
+      moving.push_back(state);
+    }
+
+    void remove_moving(int index) {
+      node_motion_state *state = moving[index];
+      node_motion_state *last = moving.back();
+      moving[index] = last;
+      last->moving_index = index;
+      state->moving_index = -1;
+      moving.resize(moving.size() - 1);
+    }
+
+  public:
+    motion_state_sync() {
+      tick = 0;
+    }
+
+    ///call before every stepSimulation
+    void begin_step() {
+      tick++;
+    }
+
+    ///write the moving bodies to their scene nodes, interpolating between the last two physics ticks.
+    ///alpha is the fraction of a tick that has passed since the last step.
+    void update_nodes(float alpha) {
+      for (int i = 0; i < (int)moving.size(); ) {
+        node_motion_state *state = moving[i];
+        mat4t mat;
+        if (state->last_tick == tick) {
+          btTransform transform;
+          transform.setOrigin(state->prev_transform.getOrigin().lerp(state->cur_transform.getOrigin(), alpha));
+          transform.setRotation(state->prev_transform.getRotation().slerp(state->cur_transform.getRotation(), alpha));
+          transform.getOpenGLMatrix(mat.get());
+          state->node->set_nodeToParent(mat);
+          ++i;
+        } else {
+          // the body did not move in the last tick, so it is at rest. snap to its final place.
+          state->cur_transform.getOpenGLMatrix(mat.get());
+          state->node->set_nodeToParent(mat);
+          remove_moving(i);
+        }
+      }
+    }
+
+    ///number of bodies currently being interpolated
+    int get_num_moving() const {
+      return moving.size();
+    }
+  };
+
+  ///a deleted body stops being interpolated
+  inline node_motion_state::~node_motion_state() {
+    if (moving_index != -1) {
+      sync->remove_moving(moving_index);
+    }
+  }
+
+  inline void node_motion_state::setWorldTransform(const btTransform &transform) {
+    prev_transform = cur_transform;
+    cur_transform = transform;
+    last_tick = sync->tick;
+    if (moving_index == -1) {
+      sync->add_moving(this);
+    }
+  }
+}
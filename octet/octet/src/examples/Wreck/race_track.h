@@ -12,28 +12,100 @@ namespace octet {
   ///A race track is created by reading in a .txt file with 10 or 11 parameters.
   ///The first 4 parameters is the modelToWorld rotation, the next 3 is for the translation
   ///and the last 3 assign the size of the mesh box. If an 11th parameter then change the material to a road barrier.
+  ///With set_merge_static(true) every piece becomes a child of one btCompoundShape on a single static body,
+  ///and the friction of each piece is applied per contact by a contact added callback.
   class race_track : public resource {
 
     app *the_app;
     visual_scene *app_scene;
     btDiscreteDynamicsWorld *the_world;
 
+    bool merge_static; //bake the track pieces into one compound body
+    btCompoundShape *track_shape; //child shapes of the merged track
+    btRigidBody *track_body; //the merged track
+    dynarray<float> piece_friction; //friction of each child of track_shape
+    dynarray<btRigidBody*> piece_bodies; //one per piece if the track is not merged
+    ContactAddedCallback old_contact_added; //the callback before the merged track took it over
+
+    ///Bullet calls this for new contacts with the merged track; pick the friction of the piece that was hit.
+    static bool contact_added(btManifoldPoint &cp, const btCollisionObjectWrapper *colObj0Wrap, int /*partId0*/, int index0, const btCollisionObjectWrapper *colObj1Wrap, int /*partId1*/, int index1){
+      const btCollisionObject *obj0 = colObj0Wrap->getCollisionObject();
+      const btCollisionObject *obj1 = colObj1Wrap->getCollisionObject();
+      bool is_track0 = (obj0->getCollisionFlags() & btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK) != 0;
+      const btCollisionObject *track = is_track0 ? obj0 : obj1;
+      const btCollisionObject *other = is_track0 ? obj1 : obj0;
+      int index = is_track0 ? index0 : index1;
+
+      race_track *self = (race_track *)track->getUserPointer();
+      if (self && index >= 0 && index < (int)self->piece_friction.size()){
+        //same combination rule as btManifoldResult::calculateCombinedFriction
+        float friction = self->piece_friction[index] * other->getFriction();
+        cp.m_combinedFriction = friction > 10.0f ? 10.0f : friction < -10.0f ? -10.0f : friction;
+      }
+      return true;
+    }
+
+    ///Add the merged track to the world once all the pieces are in the compound shape.
+    void create_merged_body(){
+      if (!track_shape) return;
+      track_shape->recalculateLocalAabb();
+      btTransform transform;
+      transform.setIdentity();
+      btDefaultMotionState *motionState = new btDefaultMotionState(transform);
+      track_body = new btRigidBody(0.0f, motionState, track_shape, btVector3(0, 0, 0));
+      track_body->setFriction(1.0f);
+      track_body->setCollisionFlags(track_body->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+      track_body->setUserPointer(this);
+      the_world->addRigidBody(track_body);
+      old_contact_added = gContactAddedCallback;
+      gContactAddedCallback = contact_added;
+    }
+
   public:
     race_track()
     {
+      the_app = 0;
+      app_scene = 0;
+      the_world = 0;
+      merge_static = false;
+      old_contact_added = 0;
+      track_shape = 0;
+      track_body = 0;
+    }
+
+    ///Bake all static track pieces into a single compound body. Call before init().
+    ///This cuts broadphase proxies and per-body memory on large tracks.
+    void set_merge_static(bool value){
+      merge_static = value;
+    }
+
+    ///number of track pieces in the merged body, 0 if the track is not merged.
+    int get_num_merged_pieces() const {
+      return track_shape ? track_shape->getNumChildShapes() : 0;
     }
 
     /// Creates a mesh and possibly a rigid body for the environment. 
     /// Mainly used to create the race track rigid mesh and rigid bodies but also used to create a skybox mesh.
     
-    void create_track_component(mat4t_in track_size, mesh *msh, material *mtl, bool is_rigid_body){
+    void create_track_component(mat4t_in track_size, mesh *msh, material *mtl, bool is_rigid_body, float friction = 10.0f){
 
       scene_node *track_nodes = new scene_node();
-      track_nodes->access_nodeToParent() = track_size;
+      track_nodes->set_nodeToParent(track_size);
       app_scene->add_child(track_nodes);
-      app_scene->add_mesh_instance(new mesh_instance(track_nodes, msh, mtl));
-
+      mesh_instance *track_instance = app_scene->add_mesh_instance(new mesh_instance(track_nodes, msh, mtl));
+      //solid pieces such as barriers hide what is behind them, the sky must not
       if (is_rigid_body){
+        track_instance->set_flags(track_instance->get_flags() | mesh_instance::flag_occluder);
+      }
+
+      if (is_rigid_body && merge_static){
+        btTransform transform(get_btMatrix3x3(track_size), get_btVector3(track_size[3].xyz()));
+        if (!track_shape){
+          track_shape = new btCompoundShape(true);
+        }
+        track_shape->addChildShape(transform, msh->get_static_bullet_shape());
+        piece_friction.push_back(friction);
+      } else if (is_rigid_body){
         btMatrix3x3 matrix(get_btMatrix3x3(track_size));
         btVector3 pos(get_btVector3(track_size[3].xyz()));
         btCollisionShape *shape = msh->get_bullet_shape();
@@ -41,12 +113,56 @@ namespace octet {
         btTransform transform(matrix, pos);
         btDefaultMotionState *motionState = new btDefaultMotionState(transform);
         btVector3 inertiaTensor;
-        shape->calculateLocalInertia(0.0f, inertiaTensor);
+        bullet_shape_cache::get_local_inertia(shape, 0.0f, inertiaTensor);
         btRigidBody *track = new btRigidBody(0.0f, motionState, shape, inertiaTensor);
-        track->setFriction(10);
+        track->setFriction(friction);
         the_world->addRigidBody(track);
         track->setUserPointer(track_nodes);
+        piece_bodies.push_back(track);
+      }
+    }
+
+    ///Create the track pieces. Transforms are absolute, material ids index track_format::material_id.
+    void build_pieces(const track_format::track_piece *pieces, unsigned num_pieces){
+      material *materials[track_format::num_materials] = {
+        new material(resource_dict::get_shared_image("assets/road_texture.jpg")),
+        new material(resource_dict::get_shared_image("assets/deadend.jpg")),
+      };
+      for (unsigned i = 0; i != num_pieces; ++i){
+        const track_format::track_piece &piece = pieces[i];
+        unsigned material_id = piece.material < track_format::num_materials ? piece.material : 0;
+        mat4t modelToWorld = track_format::unpack_transform(piece);
+        vec3 size(piece.extent[0], piece.extent[1], piece.extent[2]);
+        create_track_component(modelToWorld, new mesh_box(size), materials[material_id], true);
+      }
+    }
+
+    ///Load the track. A compiled track (see track_compiler) is mapped into memory and used directly,
+    ///unless it is missing, of another version or older than the text file, which is then parsed instead.
+    void load_track(const char *text_url, const char *binary_url){
+      uint64_t text_time = file_map::get_modified_time(app_utils::get_path(text_url));
+      uint64_t binary_time = file_map::get_modified_time(app_utils::get_path(binary_url));
+      bool binary_is_current = binary_time != 0 && binary_time >= text_time;
+
+      file_map map(binary_is_current ? app_utils::get_path(binary_url) : NULL);
+      unsigned num_pieces = 0;
+      const track_format::track_piece *pieces = track_format::get_pieces(map.get_data(), map.get_size(), num_pieces);
+      if (pieces){
+        printf("loading the compiled race track \n");
+        build_pieces(pieces, num_pieces);
+        return;
       }
+
+      if (binary_time != 0) {
+        printf("%s is out of date, run track_compiler to rebuild it \n", binary_url);
+      }
+      printf("reading the race track text file \n");
+      dynarray<unsigned char> file; //contents of the text file
+      app_utils::get_url(file, text_url);
+      dynarray<track_format::track_piece> parsed;
+      track_format::parse_text(file.data(), file.size(), parsed);
+      build_pieces(parsed.data(), parsed.size());
+      printf("finished reading text file");
     }
 
     ///init the class, getting the app, app_scene and world from the main app (wreck_game.h)
@@ -57,49 +173,45 @@ namespace octet {
 
       //create the fake skybox
       mat4t modelToWorld;
-      material *skybox_mat = new material(new image("assets/seamless_sky.jpg"));
+      material *skybox_mat = new material(resource_dict::get_shared_image("assets/seamless_sky.jpg"));
       create_track_component(modelToWorld, new mesh_sphere(100.0f, 400.0f, 3), skybox_mat, false);
  
-      dynarray<unsigned char> file; //char array to store the contents of the file
-      app_utils::get_url(file, "assets/race_track.txt");
-      dynarray<char> track_variable; //stores individual track paramters from the file
-      dynarray<float> track_parameters; //stores complete race track paramters - rotation, translation and size
-      material *track_mat = new material(new image("assets/road_texture.jpg"));
-      //create the roads & barriers
-      printf("reading the race track text file \n");
-      for (unsigned i = 0; i != file.size(); ++i){
-        unsigned c = file[i];
-        //33 in UTF-8 represents an exclaimation mark, our breakpoint for reading the whole file
-        if (c != 33){
-          //commas are used to separate the values, 10 and 13 represent LF and CR
-          if (c != 44 && c != 10 && c != 13){
-            //if no comma, it's part of the same variable
-            track_variable.push_back(c);
-          }
-          //94 represents change material to barrier(^)
-          if (c == 94){
-            modelToWorld.loadIdentity();
-            track_mat = new material(new image("assets/deadend.jpg"));
-          }
-          //if a comma, add the track variable to the parameters array
-          if (c == 44){
-            track_variable.push_back('\0'); //null terminate the buffer
-            //parse char string to double and assign it to a float
-            float value = strtod(track_variable.data(), NULL); //floating point representation of char array which stores individual parameters
-            track_parameters.push_back(value);
-            track_variable.reset();
-          }
-          //put all the stored information in as a newline approaches
-          if (c == 10){
-            track_parameters.push_back('\0'); //null terminate the buffer 
-            modelToWorld.rotate(track_parameters[0], track_parameters[1], track_parameters[2], track_parameters[3]);
-            modelToWorld.translate(track_parameters[4], track_parameters[5], track_parameters[6]);
-            create_track_component(modelToWorld, new mesh_box(vec3(track_parameters[7], track_parameters[8], track_parameters[9])), track_mat, true);
-            track_parameters.reset();
-          }
+      //create the roads & barriers, from the compiled track if there is one
+      load_track("assets/race_track.txt", "assets/race_track.bin");
+
+      create_merged_body();
+    }
+
+    ///Take the track out of the world, delete its bodies and give the shared shapes back
+    ///to bullet_shape_cache. Call before deleting the world.
+    void destroy(){
+      if (!the_world) return;
+      for (unsigned i = 0; i != piece_bodies.size(); ++i) {
+        btRigidBody *body = piece_bodies[i];
+        the_world->removeRigidBody(body);
+        bullet_shape_cache::release(body->getCollisionShape());
+        delete body->getMotionState();
+        delete body;
+      }
+      piece_bodies.reset();
+
+      if (track_body) {
+        the_world->removeRigidBody(track_body);
+        delete track_body->getMotionState();
+        delete track_body;
+        track_body = 0;
+        gContactAddedCallback = old_contact_added;
+        old_contact_added = 0;
+      }
+      if (track_shape) {
+        for (int i = 0; i != track_shape->getNumChildShapes(); ++i) {
+          bullet_shape_cache::release(track_shape->getChildShape(i));
         }
+        delete track_shape;
+        track_shape = 0;
       }
-      printf("finished reading text file");
+      piece_friction.reset();
+      the_world = 0;
     }
 
     ~race_track() {
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// track_format.h - compiled binary race track format and the text to binary compiler
+//
+
+namespace octet {
+  ///Layout of a compiled race track (.bin).
+  ///The file is a track_header followed by num_pieces track_piece records, all little endian.
+  ///Transforms are baked to absolute modelToWorld matrices, so a loader can map the file
+  ///and build the track without parsing or accumulating any transforms.
+  namespace track_format {
+    enum {
+      magic = 0x4b525457, // "WTRK"
+      version = 1,
+    };
+
+    ///material ids, indices into race_track's material table
+    enum material_id {
+      material_road = 0,
+      material_barrier = 1,
+      num_materials,
+    };
+
+    struct track_header {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t num_pieces;
+      uint32_t piece_size; // sizeof(track_piece), lets old loaders reject newer layouts
+    };
+
+    ///one box of the track, 64 bytes
+    struct track_piece {
+      float transform[12]; // rows 0-2 are the x, y, z axes, row 3 the translation (w is implicit)
+      float extent[3]; // half extent of the box
+      uint32_t material; // material_id
+    };
+
+    ///Expand a packed transform to a matrix.
+    inline mat4t unpack_transform(const track_piece &piece) {
+      const float *t = piece.transform;
+      return mat4t(
+        vec4(t[0], t[1], t[2], 0),
+        vec4(t[3], t[4], t[5], 0),
+        vec4(t[6], t[7], t[8], 0),
+        vec4(t[9], t[10], t[11], 1)
+      );
+    }
+
+    ///Pack a matrix (with no projection) into a track piece.
+    inline void pack_transform(track_piece &piece, mat4t_in mat) {
+      for (int i = 0; i != 4; ++i) {
+        piece.transform[i*3+0] = mat[i][0];
+        piece.transform[i*3+1] = mat[i][1];
+        piece.transform[i*3+2] = mat[i][2];
+      }
+    }
+
+    ///Check a mapped blob and return its pieces, or NULL if it is not a compiled track of this version.
+    inline const track_piece *get_pieces(const uint8_t *data, uint64_t size, unsigned &num_pieces) {
+      num_pieces = 0;
+      if (!data || size < sizeof(track_header)) return 0;
+      const track_header *header = (const track_header *)data;
+      if (header->magic != magic || header->version != version || header->piece_size != sizeof(track_piece)) {
+        return 0;
+      }
+      if (size < sizeof(track_header) + (uint64_t)header->num_pieces * sizeof(track_piece)) {
+        return 0;
+      }
+      num_pieces = header->num_pieces;
+      return (const track_piece *)(data + sizeof(track_header));
+    }
+
+    ///Parse the text track format into pieces.
+    ///Each line holds: angle, axis x, axis y, axis z, translate x, y, z, half extent x, y, z.
+    ///The rotation and translation of each line are applied on top of the previous line.
+    ///A '^' on a line resets the transform and switches this and all later pieces to the barrier material.
+    ///Reading stops at the end of the buffer, '!' characters are ignored.
+    inline void parse_text(const uint8_t *text, size_t size, dynarray<track_piece> &pieces) {
+      mat4t modelToWorld;
+      uint32_t material = material_road;
+      char field[64];
+      unsigned field_len = 0;
+      float params[16];
+      unsigned num_params = 0;
+
+      for (size_t i = 0; i != size; ++i) {
+        unsigned c = text[i];
+        if (c == '!' || c == '\r') continue;
+
+        if (c == '^') {
+          modelToWorld.loadIdentity();
+          material = material_barrier;
+        } else if (c == ',') {
+          field[field_len] = 0;
+          if (num_params != 16) params[num_params++] = (float)strtod(field, NULL);
+          field_len = 0;
+        } else if (c == '\n') {
+          field_len = 0;
+          if (num_params >= 10) {
+            modelToWorld.rotate(params[0], params[1], params[2], params[3]);
+            modelToWorld.translate(params[4], params[5], params[6]);
+            pieces.resize(pieces.size() + 1);
+            track_piece &piece = pieces.back();
+            pack_transform(piece, modelToWorld);
+            piece.extent[0] = params[7];
+            piece.extent[1] = params[8];
+            piece.extent[2] = params[9];
+            piece.material = material;
+          }
+          num_params = 0;
+        } else if (field_len != sizeof(field) - 1) {
+          field[field_len++] = (char)c;
+        }
+      }
+    }
+
+    ///Write a compiled track, returns false if the file could not be written.
+    inline bool write_binary(const char *path, const track_piece *pieces, unsigned num_pieces) {
+      FILE *file = fopen(path, "wb");
+      if (!file) return false;
+      track_header header;
+      header.magic = magic;
+      header.version = version;
+      header.num_pieces = num_pieces;
+      header.piece_size = sizeof(track_piece);
+      bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+      ok = ok && fwrite(pieces, sizeof(track_piece), num_pieces, file) == num_pieces;
+      fclose(file);
+      return ok;
+    }
+  }
+}
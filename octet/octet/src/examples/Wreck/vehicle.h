@@ -15,15 +15,8 @@ namespace octet {
     xbox_controller xbox_controller;
 
     app *the_app;
-    visual_scene *app_scene;
-    btDiscreteDynamicsWorld *the_world;
-
-    dynarray<btRigidBody*> vehicles; //only one in array - should change
-    dynarray<btRigidBody*> axils; //axil array - used to connect hinges and activate physics when movement occurs
-    dynarray<btRigidBody*> wheels; //wheel array - used to connect hinges 
-
-    dynarray<btHingeConstraint*> hingeAW; //Axil-Wheel Hinges
-    dynarray<btHingeConstraint*> hingeCA; //Chassis-Axil Hinges
+    vehicle_fleet *fleet; //owns the rigid bodies and hinges
+    int car; //index of this vehicle in the fleet
 
     float axil_direction_limit = 0.0f; //limit the axil can rotate in radians
     float motor_velocity = 0.0f; //speed in which the vehicle will move
@@ -34,16 +27,12 @@ namespace octet {
     // text mesh object for overlay.
     ref<mesh_text> text;
 
-    //sourced from Andy Thomason
     //sounds
+    voice_manager *voices; //shares the AL sources between all the sounds in the game
     ALuint loop_engine;
-    unsigned cur_source;
-    ALuint sources[8];
-    ALuint get_sound_source() { return sources[cur_source++ % 8]; }
+    int engine_emitter; //keeps its voice while the engine is running
 
     bool last_frame_key_m = false;
-    bool is_sound_playing = false;
-    bool play_audio = false;
     bool mute = false; //to mute the audio playing;
 
   public:
@@ -52,72 +41,18 @@ namespace octet {
     {
     }
 
-    ///Function to create a car component, assigning a rigid body array and a mass.
-    void create_car_component(mat4t_in axilsize, mesh *msh, material *mtl, dynarray <btRigidBody*> *rbArray, btScalar mass){
-      scene_node *vehicle_nodes = new scene_node();
-      vehicle_nodes->access_nodeToParent() = axilsize;
-      app_scene->add_child(vehicle_nodes);
-      app_scene->add_mesh_instance(new mesh_instance(vehicle_nodes, msh, mtl));
-      btMatrix3x3 matrix(get_btMatrix3x3(axilsize));
-      btVector3 pos(get_btVector3(axilsize[3].xyz()));
-      btCollisionShape *shape = msh->get_bullet_shape();
-
-      btTransform transform(matrix, pos);
-      btDefaultMotionState *motionState = new btDefaultMotionState(transform);
-      btVector3 inertiaTensor;
-      shape->calculateLocalInertia(mass, inertiaTensor);
-      btRigidBody *component = new btRigidBody(mass, motionState, shape, inertiaTensor);
-      the_world->addRigidBody(component);
-      component->setUserPointer(vehicle_nodes);
-      rbArray->push_back(component);
-    }
-
-    ///Creates the hinge constraints between two rigid bodies. 
-    /// Function takes in two rigid bodies, the hinge constraint it should be pushed back into, the pivots of the objects(position in local space to connect constraint),
-    ///the axis in which the hinge constraint has freedom and a bool to check whether or not hinge limits should be applied. Hinge limits only applicable for Chassis-Axil hinge for rotation.
-    void create_hinges(btRigidBody *rbA, btRigidBody *rbB, dynarray <btHingeConstraint*> *hinge_array, vec3_in PivotA, vec3_in PivotB, vec3_in Axis, bool set_hinge_limits){
-
-      btVector3 btPivotA = get_btVector3(PivotA); //btVector3 of first rigid body pivot
-      btVector3 btPivotB = get_btVector3(PivotB); //btVector3 of second rigid body pivot
-      btVector3 btAxis = get_btVector3(Axis); //axis on which hinge constraint has freedome
-
-      btHingeConstraint *hingeConstraint = new btHingeConstraint((*rbA), (*rbB), btPivotA, btPivotB, btAxis, btAxis);
-      if (set_hinge_limits){
-        hingeConstraint->setLimit(0.0f, 0.0f); //init the hinge constraint to 0 - can change when steering the vehicle
-      }
-      hinge_array->push_back(hingeConstraint);
-      the_world->addConstraint(hingeConstraint, false); //do not disable collision between rigid bodies or they will ignore each other (very bad)
-    }
-
     ///Function to play sound when the vehicle is moving. 
-    /// sound_control gets the source state of selected source and returns it state
-    /// if a sound file is not playing and the motor_velocity(movement) is != 0.0 then play a sound file.
+    /// The engine loop plays while motor_velocity(movement) is != 0.0 and the sound is not muted.
+    /// This only records the wanted state, the voice_manager calls AL when the state changes.
     void sound_control(){
-
-      unsigned source_state; //state of the selected source
-      //get sound state of the selected sound source
-      getSourceState(loop_engine, source_state);
-
-      //init the sound
-      ALuint source = get_sound_source();
-      alSourcei(source, AL_BUFFER, loop_engine);
-
-      //if vehicle is moving in a direction, play the sound only if the sound is not already being played
-      if (motor_velocity != 0.0f && !mute && play_audio){
-        alSourcePlay(source);
-      }
-      //if the vehicle is not moving, stop the sound.
-      else if (motor_velocity == 0.0f || mute){
-        alSourceStop(source);
-      }
+      voices->set_playing(engine_emitter, motor_velocity != 0.0f && !mute);
     }
 
-    /// Init the vehicle by creating the rigid bodies and attaching the hinge constraints.
-    /// Creates the meshes and rigid bodies for the chassis, 4 axils and 4 wheels. Creates the hinge constraints for each of these rigid bodies.
-    void init(app *app, visual_scene *app_scene, btDiscreteDynamicsWorld *world){
+    /// Init the vehicle by adding a car to the fleet and creating the HUD and sounds.
+    void init(app *app, vehicle_fleet *fleet, voice_manager *voices){
       this->the_app = app;
-      this->app_scene = app_scene;
-      this->the_world = world;
+      this->fleet = fleet;
+      this->voices = voices;
 
       // create the overlay
       overlay = new text_overlay();
@@ -132,41 +67,12 @@ namespace octet {
       // add the mesh to the overlay.
       overlay->add_mesh_text(text);
 
-      mat4t modelToWorld;
-      modelToWorld.translate(0.0f, 5.0f, 0.0f);
-      vec3 chassis_size(3.0f, 0.125f, 2.0f);
-      create_car_component(modelToWorld, new mesh_box(chassis_size), new material(new image("assets/chassis_texture.jpg")), &vehicles, 5.0f);
-
-      vec3 axil_size(0.25f, 0.25f, 0.5f);
-
-      material *wheel_mat = new material(new image("assets/tire.jpg"));
-      material *red = new material(vec4(1, 0, 0, 1));
-
-      //create 4 wheels and 4 axils
-      for (float i = 0.0f; i != 4; ++i){
-        modelToWorld.translate(i, 0.0f, 0.0f);
-        create_car_component(modelToWorld, new mesh_cylinder(zcylinder(vec3(0, 0, 0), 1.0f, 0.5f)), wheel_mat, &wheels, 5.0f);
-        create_car_component(modelToWorld, new mesh_box(axil_size), red, &axils, 20.0f);
-      }
-
-      float dist_x = chassis_size.x() - axil_size.x() * 2.0f;
-      float dist_y = chassis_size.y();
-      float dist_z = chassis_size.z() - axil_size.z();
-
-      //create the hinges for the chassis - axils
-      create_hinges(*&vehicles[0], *&axils[0], &hingeCA, vec3(dist_x, dist_y, 0.0f), vec3(0.0f, 0.0f, dist_z), vec3(0.0f, 1.0f, 0.0f), true);
-      create_hinges(*&axils[0], *&wheels[0], &hingeAW, vec3(0.0f, 0.0f, -0.575f), vec3(0.0f, 0.0f, 0.575f), vec3(0.0f, 0.0f, 1.0f), false);
-      create_hinges(*&vehicles[0], *&axils[1], &hingeCA, vec3(dist_x, dist_y, 0.0f), vec3(0.0f, 0.0f, -dist_z), vec3(0.0f, 1.0f, 0.0f), true);
-      create_hinges(*&axils[1], *&wheels[1], &hingeAW, vec3(0.0f, 0.0f, 0.575f), vec3(0.0f, 0.0f, -0.575f), vec3(0.0f, 0.0f, 1.0f), false);
-      create_hinges(*&vehicles[0], *&axils[2], &hingeCA, vec3(-dist_x, dist_y, 0.0f), vec3(0.0f, 0.0f, dist_z), vec3(0.0f, 1.0f, 0.0f), true);
-      create_hinges(*&axils[2], *&wheels[2], &hingeAW, vec3(0.0f, 0.0f, -0.575f), vec3(0.0f, 0.0f, 0.575f), vec3(0.0f, 0.0f, 1.0f), false);
-      create_hinges(*&vehicles[0], *&axils[3], &hingeCA, vec3(-dist_x, dist_y, 0.0f), vec3(0.0f, 0.0f, -dist_z), vec3(0.0f, 1.0f, 0.0f), true);
-      create_hinges(*&axils[3], *&wheels[3], &hingeAW, vec3(0.0f, 0.0f, 0.575f), vec3(0.0f, 0.0f, -0.575f), vec3(0.0f, 0.0f, 1.0f), false);
+      car = fleet->add_car(vec3(0.0f, 5.0f, 0.0f));
 
       //sounds
       loop_engine = resource_dict::get_sound_handle(AL_FORMAT_MONO16, "assets/engine_loop.wav");
-      cur_source = 0;
-      alGenSources(8, sources);
+      //the player's engine is the most important sound in the game
+      engine_emitter = voices->add_emitter(loop_engine, 10.0f, true);
     }
 
     ///Update the vehicle class every frame, called from the main app wreck_game. 
@@ -175,17 +81,11 @@ namespace octet {
     /// If an Xbox controller is found then the inputs from the xbox controller are taken instead. 
     void update(int vx, int vy){
 
-      const float step_acceleration = 0.4f; //float to increment motor_velocity
-      const float max_velocity = 20.0f; //maximum velocity the vehicle can go
-
-      const float step_angle = 1.5f; //float to increment the angle axils turn
-      const float max_angle = 15.0f; //maximum angle the axil can rotate
-
       // write some text to the overlay
 
       text->clear();
 
-      text->format("Press X to rotate camera with mouse position \n" "Esc to close the program \n" "M to mute sound - Sound muted: %s \n", mute ? "true" : "false");
+      text->format("Press X to rotate camera with mouse position \n" "Esc to close the program \n" "M to mute sound - Sound muted: %s \n" "P to show performance counters \n" "B to show physics shapes and contacts \n", mute ? "true" : "false");
 
       // convert it to a mesh.
       text->update();
@@ -193,6 +93,36 @@ namespace octet {
       // draw the text overlay
       overlay->render(vx, vy);
 
+      update_controls();
+
+      //mute sound
+      if (the_app->is_key_down('M') && !last_frame_key_m)
+      {
+        mute = !mute;
+      }
+
+      sound_control();
+
+      //close the program
+      if (the_app->is_key_down(key_esc))
+      {
+        exit(1); //exits the program....safely?
+      }
+
+      last_frame_key_m = the_app->is_key_down('M');
+      
+    }
+
+    ///Apply the keyboard and xbox controller inputs to the hinge motors and steering.
+    /// This only touches the physics world, so it can be run without a window, GL or audio.
+    void update_controls(){
+
+      const float step_acceleration = 0.4f; //float to increment motor_velocity
+      const float max_velocity = 20.0f; //maximum velocity the vehicle can go
+
+      const float step_angle = 1.5f; //float to increment the angle axils turn
+      const float max_angle = 15.0f; //maximum angle the axil can rotate
+
       // rotation of the front two axils - turning the chassis left or right
       if (the_app->is_key_down('A') || the_app->is_key_down(key_left)) {
         if (axil_direction_limit > -(max_angle * 3.14159265f / 180.0f))
@@ -238,13 +168,13 @@ namespace octet {
         }
       }
 
-      move_direction(motor_velocity, 10); //apply the motor_velocity
+      move_direction(motor_velocity); //apply the motor_velocity
 
       //if the xbox controller has been connected
       if (xbox_controller.refresh()){
         //right trigger is acceleration, left trigger is decceleration.
         motor_velocity = xbox_controller.right_trigger - xbox_controller.left_trigger;
-        move_direction(motor_velocity, 10);
+        move_direction(motor_velocity);
         //turn wheels based on x pos of left analog stick
         if (!xbox_controller.analog_deadzone()){
           rotate_axils(xbox_controller.left_analog_x);
@@ -253,51 +183,24 @@ namespace octet {
           rotate_axils(0); //set the axils back to it's center point
         }
       }
-      //mute sound
-      if (the_app->is_key_down('M') && !last_frame_key_m)
-      {
-        mute = !mute;
-      }
-
-      if (!is_sound_playing && (the_app->is_key_down('W') || the_app->is_key_down('S') || !xbox_controller.trigger_deadzone())) {
-        play_audio = true;
-      }
-      else{
-        play_audio = false;
-      }
-      sound_control();
-
-      //close the program
-      if (the_app->is_key_down(key_esc))
-      {
-        exit(1); //exits the program....safely?
-      }
-
-      is_sound_playing = the_app->is_key_down('W') || the_app->is_key_down('S') || !xbox_controller.trigger_deadzone();
-      last_frame_key_m = the_app->is_key_down('M');
-      
     }
 
     ///Move the vehicle by setting a velocity on the hinge angular motors. 
-    /// To move the vehicle, all 4 axils are activated and the angular motor on all Axil-Wheel hinge constraints are enabled. 
-    /// a motor velocity and a maximum impulse is then set to the hinge. 
-    void move_direction(float motor_velocity, float motor_impulse_limit){
-      for (int i = 0; i != 4; ++i){
-        //optimize bullet simulation - don't want to waste memory on simulating static object
-        axils[i]->activate(true);
-        hingeAW[i]->enableAngularMotor(true, motor_velocity, motor_impulse_limit);
-      }
+    /// The fleet applies the velocity to all 4 Axil-Wheel hinge motors in vehicle_fleet::apply_controls(),
+    /// waking the axils only when the velocity changes.
+    void move_direction(float motor_velocity){
+      fleet->set_motor_velocity(car, motor_velocity);
     }
 
     ///Function to take in the radian at which to turn the vehicle. 
-    /// The vehicle is turned by activating the front two axils in the scene and applying an angular rotation
-    /// on the free angle in the Chassis-Axil hinge constraints 
+    /// The fleet applies the angle to the free angle of the front two Chassis-Axil hinge constraints.
     void rotate_axils(float axil_direction_limit){
-      for (int i = 0; i != 2; ++i){
-        //optimize bullet simulation - don't want to waste memory on simulating static object
-        axils[i]->activate(true);
-        hingeCA[i]->setLimit(axil_direction_limit, axil_direction_limit);
-      }
+      fleet->set_steer_angle(car, axil_direction_limit);
+    }
+
+    ///The scene node of the chassis, used to attach the camera.
+    scene_node *get_chassis_node(){
+      return fleet->get_chassis_node(car);
     }
 
     ~vehicle() {
@@ -0,0 +1,567 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// vehicle_fleet.h - owns the rigid bodies, hinges and control state of many vehicles
+//
+
+namespace octet {
+
+  ///Single body raycast model of a car, used by vehicle_fleet for cars far from the viewer.
+  ///The wheels are rays and the engine force is driven towards the requested wheel motor velocity,
+  ///so the car follows the same inputs as the hinge model.
+  class raycast_car : public btRaycastVehicle {
+    float target_velocity; //requested wheel velocity, positive drives towards +x like the hinge motors
+    float steering; //requested steering angle, in the hinge convention
+    float steer_scale; //fraction of the steering angle that the hinge car turns by
+    float wheel_radius;
+    float max_impulse; //impulse limit of each wheel motor per tick
+
+  public:
+    raycast_car(const btVehicleTuning &tuning, btRigidBody *chassis, btVehicleRaycaster *raycaster, float wheel_radius, float max_impulse)
+    : btRaycastVehicle(tuning, chassis, raycaster) {
+      this->wheel_radius = wheel_radius;
+      this->max_impulse = max_impulse;
+      target_velocity = 0;
+      steering = 0;
+      //the front wheels of the hinge car slip, it turns about 0.6 as tightly as its steering angle implies
+      steer_scale = 0.62f;
+    }
+
+    ///request a wheel velocity (radians per second)
+    void set_target_velocity(float velocity) {
+      target_velocity = velocity;
+    }
+
+    ///steer the front wheels, same sign as the Chassis-Axil hinge limits
+    void set_steering(float angle) {
+      steering = angle;
+      //bullet turns the wheels the other way round the up axis
+      setSteeringValue(-angle * steer_scale, 0);
+      setSteeringValue(-angle * steer_scale, 1);
+    }
+
+    ///the steering angle last requested
+    float get_steering() const {
+      return steering;
+    }
+
+    ///Called by the world every tick: set the engine force then step the wheels.
+    void updateAction(btCollisionWorld *world, btScalar step) {
+      btRigidBody *body = getRigidBody();
+      //speed along +x, the direction that a positive motor velocity drives
+      float speed = (float)body->getLinearVelocity().dot(getForwardVector());
+      float wanted = target_velocity * wheel_radius;
+      //each wheel pushes towards the wanted speed, limited like a hinge motor
+      float force = (wanted - speed) / (body->getInvMass() * step * getNumWheels());
+      float max_force = max_impulse / (step * wheel_radius);
+      force = force < -max_force ? -max_force : force > max_force ? max_force : force;
+      for (int i = 0; i != getNumWheels(); ++i) {
+        applyEngineForce(force, i);
+      }
+      btRaycastVehicle::updateAction(world, step);
+    }
+  };
+
+  ///Class that owns any number of hinge based vehicles.
+  ///Each car is a chassis, 4 axils and 4 wheels joined by Chassis-Axil and Axil-Wheel hinges, as in vehicle.h.
+  ///Bodies and hinges are stored in flat arrays indexed by car * 4 + wheel, and the control inputs
+  ///(motor velocity and steering angle) are stored in flat arrays indexed by car.
+  ///Inputs are set with set_controls() and pushed to the hinges by apply_controls() in one pass,
+  ///which only touches and wakes the cars whose inputs changed since the last pass.
+  ///
+  ///Cars far from the viewer can be swapped to a single body raycast_car (see set_lod_distances()).
+  ///The raycast model reuses the chassis body, so position, velocity and controls carry over;
+  ///the axils, wheels and hinges are taken out of the world until the car comes back.
+  class vehicle_fleet : public resource {
+
+    visual_scene *app_scene;
+    btDiscreteDynamicsWorld *the_world;
+    motion_state_sync *motion_sync;
+
+    //meshes, materials and collision shapes are shared by every car, the shapes come from bullet_shape_cache
+    ref<mesh> chassis_mesh;
+    ref<mesh> wheel_mesh;
+    ref<mesh> axil_mesh;
+    ref<material> chassis_mat;
+    ref<material> wheel_mat;
+    ref<material> axil_mat;
+    btCollisionShape *chassis_shape;
+    btCollisionShape *wheel_shape;
+    btCollisionShape *axil_shape;
+
+    vec3 chassis_size;
+    vec3 axil_size;
+
+    dynarray<btRigidBody*> chassis; //one per car
+    dynarray<btRigidBody*> axils; //four per car
+    dynarray<btRigidBody*> wheels; //four per car
+    dynarray<btHingeConstraint*> hingeAW; //Axil-Wheel Hinges, four per car
+    dynarray<btHingeConstraint*> hingeCA; //Chassis-Axil Hinges, four per car, the first two steer
+
+    dynarray<float> motor_velocity; //requested velocity of the wheel motors
+    dynarray<float> steer_angle; //requested angle of the front axils in radians
+    dynarray<float> applied_velocity; //velocity last sent to the hinges
+    dynarray<float> applied_angle; //angle last sent to the hinges
+
+    float motor_impulse_limit; //maximum impulse of the wheel motors
+    float chassis_mass;
+    float wheel_mass;
+    float axil_mass;
+    float wheel_radius;
+    float wheel_offset; //distance from an axil to its wheel along z
+    float wheel_height; //height of the wheels above the chassis when the car rests on them
+
+    int num_woken; //cars whose inputs changed in the last apply_controls()
+
+    //level of detail
+    enum lod_t { lod_hinges, lod_raycast };
+    dynarray<uint8_t> lod; //lod_t of each car
+    dynarray<raycast_car*> raycast; //one per car, created the first time the car is swapped
+    btVehicleRaycaster *raycaster;
+    btRaycastVehicle::btVehicleTuning tuning;
+    float suspension_rest; //rest length of the raycast suspension
+    float lod_near; //hinge model within this distance of the viewer
+    float lod_far; //raycast model beyond this distance, 0 to disable
+    int num_raycast; //cars using the raycast model
+    int num_swaps; //cars swapped in the last update_lod()
+
+    ///Create a rigid body and a scene node for one component of a car.
+    btRigidBody *create_car_component(mat4t_in modelToWorld, mesh *msh, material *mtl, btCollisionShape *shape, btScalar mass){
+      scene_node *node = new scene_node();
+      app_scene->add_child(node);
+      app_scene->add_mesh_instance(new mesh_instance(node, msh, mtl));
+
+      btMatrix3x3 matrix(get_btMatrix3x3(modelToWorld));
+      btVector3 pos(get_btVector3(modelToWorld[3].xyz()));
+      btTransform transform(matrix, pos);
+      node_motion_state *motionState = new node_motion_state(node, transform, motion_sync);
+      btVector3 inertiaTensor;
+      bullet_shape_cache::get_local_inertia(shape, mass, inertiaTensor);
+      btRigidBody *component = new btRigidBody(mass, motionState, shape, inertiaTensor);
+      the_world->addRigidBody(component);
+      component->setUserPointer(node);
+      return component;
+    }
+
+    ///Create a hinge between two rigid bodies. Hinge limits are only used for steering on the Chassis-Axil hinges.
+    btHingeConstraint *create_hinge(btRigidBody *rbA, btRigidBody *rbB, vec3_in PivotA, vec3_in PivotB, vec3_in Axis, bool set_hinge_limits){
+      btVector3 btAxis = get_btVector3(Axis);
+      btHingeConstraint *hingeConstraint = new btHingeConstraint(*rbA, *rbB, get_btVector3(PivotA), get_btVector3(PivotB), btAxis, btAxis);
+      if (set_hinge_limits){
+        hingeConstraint->setLimit(0.0f, 0.0f);
+      }
+      the_world->addConstraint(hingeConstraint, false); //do not disable collision between rigid bodies or they will ignore each other
+      return hingeConstraint;
+    }
+
+    //the first two axils are at the front (+x) and steer
+    static float side_x(int i) { return i < 2 ? 1.0f : -1.0f; }
+    static float side_z(int i) { return (i & 1) ? -1.0f : 1.0f; }
+
+    //where the Chassis-Axil hinges sit on the chassis
+    vec3 get_axil_pivot(int i) const {
+      return vec3(side_x(i) * (chassis_size.x() - axil_size.x() * 2.0f), chassis_size.y(), 0.0f);
+    }
+
+    //transform of an axil and its wheel relative to the chassis, as the hinges hold them.
+    //a positive steering angle turns the front axils clockwise seen from above.
+    void get_wheel_transforms(int i, float steer, float pivot_y, mat4t &axil, mat4t &wheel) const {
+      vec3 pivot = get_axil_pivot(i);
+      axil.loadIdentity();
+      axil.translate(pivot.x(), pivot_y, pivot.z());
+      if (i < 2) axil.rotateY(-steer * (180.0f / 3.14159265f));
+      axil.translate(0.0f, 0.0f, -side_z(i) * (chassis_size.z() - axil_size.z()));
+      wheel = axil;
+      wheel.translate(0.0f, 0.0f, -side_z(i) * wheel_offset);
+    }
+
+    //set a body's mass, keeping the inertia of its shape
+    static void set_mass(btRigidBody *body, float mass) {
+      btVector3 inertia;
+      bullet_shape_cache::get_local_inertia(body->getCollisionShape(), mass, inertia);
+      body->setMassProps(mass, inertia);
+      body->updateInertiaTensor();
+    }
+
+    raycast_car *create_raycast_car(int car) {
+      raycast_car *result = new raycast_car(tuning, chassis[car], raycaster, wheel_radius, motor_impulse_limit);
+      //the car drives along x. bullet reads the wheel axle from column 0 of the wheel basis whatever
+      //the chassis axes are, so right is 0 too; with an axle of +z, positive engine force pushes +x.
+      result->setCoordinateSystem(0, 1, 0);
+      //connect the rays so that the chassis rests at the same height as on its hinges
+      float gravity = the_world->getGravity().length();
+      float sag = gravity / (tuning.m_suspensionStiffness * 4);
+      for (int i = 0; i != 4; ++i) {
+        mat4t axil, wheel;
+        get_wheel_transforms(i, 0, wheel_height, axil, wheel);
+        btVector3 connection(wheel[3].x(), wheel_height + suspension_rest - sag, wheel[3].z());
+        result->addWheel(connection, btVector3(0, -1, 0), btVector3(0, 0, 1), suspension_rest, wheel_radius, tuning, i < 2);
+      }
+      return result;
+    }
+
+    //take the axils, wheels and hinges out of the world and drive the chassis with rays
+    void swap_to_raycast(int car) {
+      for (int i = car * 4; i != car * 4 + 4; ++i) {
+        the_world->removeConstraint(hingeAW[i]);
+        the_world->removeConstraint(hingeCA[i]);
+        the_world->removeRigidBody(wheels[i]);
+        the_world->removeRigidBody(axils[i]);
+      }
+      if (!raycast[car]) raycast[car] = create_raycast_car(car);
+      raycast_car *vehicle = raycast[car];
+
+      set_mass(chassis[car], chassis_mass + (wheel_mass + axil_mass) * 4);
+      vehicle->resetSuspension();
+      vehicle->set_target_velocity(applied_velocity[car]);
+      vehicle->set_steering(applied_angle[car]);
+      the_world->addVehicle(vehicle);
+      chassis[car]->activate(true);
+      lod[car] = lod_raycast;
+      num_raycast++;
+    }
+
+    //put the axils and wheels back where the hinges want them, moving with the chassis
+    void swap_to_hinges(int car) {
+      btRigidBody *body = chassis[car];
+      the_world->removeVehicle(raycast[car]);
+      set_mass(body, chassis_mass);
+
+      const btTransform &chassis_transform = body->getWorldTransform();
+      mat4t chassis_matrix;
+      chassis_transform.getOpenGLMatrix(chassis_matrix.get());
+      btVector3 velocity = body->getLinearVelocity();
+      btVector3 spin = body->getAngularVelocity();
+      //wheel spin for rolling at the current speed
+      float roll = -(float)velocity.dot(chassis_transform.getBasis().getColumn(0)) / wheel_radius;
+
+      for (int i = 0; i != 4; ++i) {
+        mat4t axil_local, wheel_local;
+        get_wheel_transforms(i, applied_angle[car], wheel_height, axil_local, wheel_local);
+        btRigidBody *parts[2] = { axils[car * 4 + i], wheels[car * 4 + i] };
+        mat4t parts_local[2] = { axil_local, wheel_local };
+        for (int j = 0; j != 2; ++j) {
+          mat4t world_matrix = parts_local[j] * chassis_matrix;
+          btTransform transform;
+          transform.setFromOpenGLMatrix(world_matrix.get());
+          btRigidBody *part = parts[j];
+          part->setWorldTransform(transform);
+          part->setInterpolationWorldTransform(transform);
+          part->setLinearVelocity(velocity + spin.cross(transform.getOrigin() - chassis_transform.getOrigin()));
+          btVector3 part_spin = j == 1 ? spin + transform.getBasis().getColumn(2) * roll : spin;
+          part->setAngularVelocity(part_spin);
+          part->setInterpolationLinearVelocity(part->getLinearVelocity());
+          part->setInterpolationAngularVelocity(part_spin);
+          part->clearForces();
+          ((node_motion_state*)part->getMotionState())->reset(transform);
+          the_world->addRigidBody(part);
+          part->activate(true);
+        }
+      }
+      //the hinges missed the input changes made while the car was a raycast car
+      for (int i = car * 4; i != car * 4 + 4; ++i) {
+        if (i < car * 4 + 2) hingeCA[i]->setLimit(applied_angle[car], applied_angle[car]);
+        hingeAW[i]->enableAngularMotor(true, applied_velocity[car], motor_impulse_limit);
+        the_world->addConstraint(hingeCA[i], false);
+        the_world->addConstraint(hingeAW[i], false);
+      }
+      body->activate(true);
+      lod[car] = lod_hinges;
+      num_raycast--;
+    }
+
+  public:
+    vehicle_fleet()
+    {
+      app_scene = 0;
+      the_world = 0;
+      motion_sync = 0;
+      chassis_shape = wheel_shape = axil_shape = 0;
+      motor_impulse_limit = 10.0f;
+      chassis_mass = 5.0f;
+      wheel_mass = 5.0f;
+      axil_mass = 20.0f;
+      wheel_radius = 1.0f;
+      wheel_offset = 1.15f;
+      wheel_height = 0;
+      num_woken = 0;
+      raycaster = 0;
+      suspension_rest = 0.3f;
+      lod_near = lod_far = 0;
+      num_raycast = num_swaps = 0;
+      tuning.m_suspensionStiffness = 40.0f;
+      tuning.m_suspensionCompression = 4.4f;
+      tuning.m_suspensionDamping = 2.3f;
+      tuning.m_frictionSlip = 5.0f;
+    }
+
+    ///Set up the shared meshes and shapes. Cars are added with add_car().
+    void init(visual_scene *app_scene, btDiscreteDynamicsWorld *world, motion_state_sync *motion_sync){
+      this->app_scene = app_scene;
+      this->the_world = world;
+      this->motion_sync = motion_sync;
+
+      chassis_size = vec3(3.0f, 0.125f, 2.0f);
+      axil_size = vec3(0.25f, 0.25f, 0.5f);
+      //the axils collide with the chassis and rest on top of it, above the hinge pivots
+      wheel_height = chassis_size.y() + axil_size.y();
+
+      chassis_mesh = new mesh_box(chassis_size);
+      wheel_mesh = new mesh_cylinder(zcylinder(vec3(0, 0, 0), wheel_radius, 0.5f));
+      axil_mesh = new mesh_box(axil_size);
+
+      chassis_mat = new material(resource_dict::get_shared_image("assets/chassis_texture.jpg"));
+      wheel_mat = new material(resource_dict::get_shared_image("assets/tire.jpg"));
+      axil_mat = new material(vec4(1, 0, 0, 1));
+
+      chassis_shape = chassis_mesh->get_bullet_shape();
+      wheel_shape = wheel_mesh->get_bullet_shape();
+      axil_shape = axil_mesh->get_bullet_shape();
+
+      raycaster = new btDefaultVehicleRaycaster(world);
+    }
+
+    ///Add a car with its chassis at position, returns the index of the car.
+    int add_car(vec3_in position){
+      int car = chassis.size();
+
+      mat4t modelToWorld;
+      modelToWorld.translate(position.x(), position.y(), position.z());
+      chassis.push_back(create_car_component(modelToWorld, chassis_mesh, chassis_mat, chassis_shape, chassis_mass));
+
+      //create 4 wheels and 4 axils, the hinges pull them into place
+      for (float i = 0.0f; i != 4; ++i){
+        modelToWorld.translate(i, 0.0f, 0.0f);
+        wheels.push_back(create_car_component(modelToWorld, wheel_mesh, wheel_mat, wheel_shape, wheel_mass));
+        axils.push_back(create_car_component(modelToWorld, axil_mesh, axil_mat, axil_shape, axil_mass));
+      }
+
+      for (int i = 0; i != 4; ++i){
+        btRigidBody *axil = axils[car * 4 + i];
+        btRigidBody *wheel = wheels[car * 4 + i];
+        float half_offset = wheel_offset * 0.5f;
+        hingeCA.push_back(create_hinge(chassis[car], axil, get_axil_pivot(i), vec3(0.0f, 0.0f, side_z(i) * (chassis_size.z() - axil_size.z())), vec3(0.0f, 1.0f, 0.0f), true));
+        hingeAW.push_back(create_hinge(axil, wheel, vec3(0.0f, 0.0f, -side_z(i) * half_offset), vec3(0.0f, 0.0f, side_z(i) * half_offset), vec3(0.0f, 0.0f, 1.0f), false));
+        //a stopped motor acts as a brake
+        hingeAW.back()->enableAngularMotor(true, 0.0f, motor_impulse_limit);
+      }
+
+      motor_velocity.push_back(0.0f);
+      steer_angle.push_back(0.0f);
+      applied_velocity.push_back(0.0f);
+      applied_angle.push_back(0.0f);
+      lod.push_back(lod_hinges);
+      raycast.push_back(0);
+      return car;
+    }
+
+    ///Request a motor velocity and a steering angle (radians) for a car. Takes effect at the next apply_controls().
+    void set_controls(int car, float velocity, float angle){
+      motor_velocity[car] = velocity;
+      steer_angle[car] = angle;
+    }
+
+    ///Request a motor velocity for a car.
+    void set_motor_velocity(int car, float velocity){
+      motor_velocity[car] = velocity;
+    }
+
+    ///Request a steering angle (radians) for a car.
+    void set_steer_angle(int car, float angle){
+      steer_angle[car] = angle;
+    }
+
+    ///Push the requested inputs to the hinge motors and limits.
+    ///Only cars whose inputs changed are touched, and only their axils are woken up.
+    void apply_controls(){
+      int woken = 0;
+      int num_cars = chassis.size();
+      for (int car = 0; car != num_cars; ++car){
+        bool velocity_changed = motor_velocity[car] != applied_velocity[car];
+        bool angle_changed = steer_angle[car] != applied_angle[car];
+        if (!velocity_changed && !angle_changed) continue;
+
+        if (lod[car] == lod_raycast){
+          raycast_car *vehicle = raycast[car];
+          vehicle->set_target_velocity(motor_velocity[car]);
+          vehicle->set_steering(steer_angle[car]);
+          chassis[car]->activate(true);
+          applied_velocity[car] = motor_velocity[car];
+          applied_angle[car] = steer_angle[car];
+          woken++;
+          continue;
+        }
+
+        btRigidBody **car_axils = &axils[car * 4];
+        if (velocity_changed){
+          float velocity = motor_velocity[car];
+          btHingeConstraint **car_hinges = &hingeAW[car * 4];
+          for (int i = 0; i != 4; ++i){
+            car_axils[i]->activate(true);
+            car_hinges[i]->enableAngularMotor(true, velocity, motor_impulse_limit);
+          }
+          applied_velocity[car] = velocity;
+        }
+        if (angle_changed){
+          float angle = steer_angle[car];
+          btHingeConstraint **car_hinges = &hingeCA[car * 4];
+          for (int i = 0; i != 2; ++i){
+            car_axils[i]->activate(true);
+            car_hinges[i]->setLimit(angle, angle);
+          }
+          applied_angle[car] = angle;
+        }
+        woken++;
+      }
+      num_woken = woken;
+    }
+
+    ///Cars further than far from the viewer use the raycast model, cars closer than near use hinges.
+    ///The gap between the two stops cars on the boundary from swapping every frame. far = 0 turns LOD off.
+    void set_lod_distances(float near, float far){
+      lod_near = near < far ? near : far;
+      lod_far = far;
+    }
+
+    ///Swap cars between the hinge and raycast models by their distance from the viewer.
+    ///Call once per frame, before stepping the world.
+    void update_lod(vec3_in viewer){
+      int swaps = 0;
+      int num_cars = chassis.size();
+      float near_sq = lod_near * lod_near;
+      float far_sq = lod_far * lod_far;
+      for (int car = 0; car != num_cars; ++car){
+        btVector3 pos = chassis[car]->getWorldTransform().getOrigin();
+        vec3 delta = vec3((float)pos.x(), (float)pos.y(), (float)pos.z()) - viewer;
+        float dist_sq = dot(delta, delta);
+        if (lod[car] == lod_hinges){
+          if (lod_far > 0 && dist_sq > far_sq){
+            swap_to_raycast(car);
+            swaps++;
+          }
+        } else if (lod_far <= 0 || dist_sq < near_sq){
+          swap_to_hinges(car);
+          swaps++;
+        }
+      }
+      num_swaps = swaps;
+    }
+
+    ///Draw the axils and wheels of raycast cars where the rays put them. Call after the chassis nodes are updated.
+    void update_nodes(){
+      if (num_raycast == 0) return;
+      int num_cars = chassis.size();
+      for (int car = 0; car != num_cars; ++car){
+        if (lod[car] != lod_raycast) continue;
+        raycast_car *vehicle = raycast[car];
+        const mat4t &chassis_matrix = get_chassis_node(car)->get_nodeToParent();
+        for (int i = 0; i != 4; ++i){
+          const btWheelInfo &info = vehicle->getWheelInfo(i);
+          float pivot_y = (float)info.m_chassisConnectionPointCS.y() - (float)info.m_raycastInfo.m_suspensionLength;
+          mat4t axil, wheel;
+          get_wheel_transforms(i, vehicle->get_steering(), pivot_y, axil, wheel);
+          wheel.rotateZ(-(float)info.m_rotation * (180.0f / 3.14159265f));
+          ((scene_node *)axils[car * 4 + i]->getUserPointer())->set_nodeToParent(axil * chassis_matrix);
+          ((scene_node *)wheels[car * 4 + i]->getUserPointer())->set_nodeToParent(wheel * chassis_matrix);
+        }
+      }
+    }
+
+    ///number of cars using the raycast model
+    int get_num_raycast_cars() const {
+      return num_raycast;
+    }
+
+    ///number of cars that changed model in the last update_lod()
+    int get_num_lod_swaps() const {
+      return num_swaps;
+    }
+
+    ///true if a car is using the raycast model
+    bool is_raycast(int car) const {
+      return lod[car] == lod_raycast;
+    }
+
+    ///number of cars in the fleet
+    int get_num_cars() const {
+      return chassis.size();
+    }
+
+    ///number of cars whose inputs changed in the last apply_controls()
+    int get_num_woken() const {
+      return num_woken;
+    }
+
+    ///the chassis rigid body of a car
+    btRigidBody *get_chassis(int car){
+      return chassis[car];
+    }
+
+    ///the scene node of the chassis of a car, used to attach the camera.
+    scene_node *get_chassis_node(int car){
+      return (scene_node *)chassis[car]->getUserPointer();
+    }
+
+    ///current requested motor velocity of a car
+    float get_motor_velocity(int car) const {
+      return motor_velocity[car];
+    }
+
+    ///current requested steering angle of a car
+    float get_steer_angle(int car) const {
+      return steer_angle[car];
+    }
+
+    ///Take the cars out of the world, delete their bodies and hinges and give the shared shapes back
+    ///to bullet_shape_cache. Call before deleting the world.
+    void destroy(){
+      if (!the_world) return;
+      for (unsigned car = 0; car != raycast.size(); ++car) {
+        if (lod[car] == lod_raycast) the_world->removeVehicle(raycast[car]);
+        delete raycast[car];
+      }
+      raycast.reset();
+      lod.reset();
+
+      //hinges of raycast cars are already out of the world, removing them again does nothing.
+      btHingeConstraint **hinges[2] = { hingeAW.data(), hingeCA.data() };
+      for (int h = 0; h != 2; ++h) {
+        for (unsigned i = 0; i != hingeAW.size(); ++i) {
+          the_world->removeConstraint(hinges[h][i]);
+          delete hinges[h][i];
+        }
+      }
+      hingeAW.reset();
+      hingeCA.reset();
+
+      dynarray<btRigidBody*> *bodies[3] = { &chassis, &axils, &wheels };
+      for (int b = 0; b != 3; ++b) {
+        for (unsigned i = 0; i != bodies[b]->size(); ++i) {
+          btRigidBody *body = (*bodies[b])[i];
+          the_world->removeRigidBody(body);
+          delete body->getMotionState();
+          delete body;
+        }
+        bodies[b]->reset();
+      }
+
+      //the bodies shared the reference taken in init()
+      bullet_shape_cache::release(chassis_shape);
+      bullet_shape_cache::release(wheel_shape);
+      bullet_shape_cache::release(axil_shape);
+      chassis_shape = wheel_shape = axil_shape = 0;
+
+      delete raycaster;
+      raycaster = 0;
+      the_world = 0;
+    }
+
+    ~vehicle_fleet() {
+      for (unsigned i = 0; i != raycast.size(); ++i) {
+        delete raycast[i];
+      }
+      delete raycaster;
+    }
+  };
+}
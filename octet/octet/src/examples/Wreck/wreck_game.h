@@ -12,7 +12,9 @@ namespace octet {
   class wreck_game : public app {
 
     race_track race_track;
+    vehicle_fleet fleet;
     vehicle vehicle_instance;
+    voice_manager voices; // AL sources shared by every sound in the game
     xbox_controller xbox_controller;
 
     // scene for drawing box
@@ -25,6 +27,20 @@ namespace octet {
 
     vec2 camAngle = (0.0f, 0.0f); //vec2 to store x and y pos of camera angle.
 
+    // fixed timestep physics: the world always advances by physics_step,
+    // rendering interpolates between the last two physics states.
+    btClock frame_clock; // wall clock time between frames
+    float physics_step; // seconds per physics tick
+    float accumulator; // unsimulated wall clock time
+    float frame_time; // wall clock time of the last frame
+    int max_substeps; // cap on ticks per frame to avoid a spiral of death
+    motion_state_sync motion_sync; // moving bodies and their scene nodes
+
+    ref<perf_hud> hud; // performance counters, toggled with P
+    bool last_frame_key_p;
+    bool show_physics; // bullet shapes and contacts, toggled with B
+    bool last_frame_key_b;
+
     ///this function is responsible for moving the camera based on mouse position
     void move_camera(int x, int y, HWND *w)
     {
@@ -62,14 +78,30 @@ namespace octet {
       broadphase = new btDbvtBroadphase();
       solver = new btSequentialImpulseConstraintSolver();
       world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, &config);
+      physics_step = 1.0f / 60;
+      accumulator = 0;
+      frame_time = 0;
+      max_substeps = 5;
+      last_frame_key_p = false;
+      show_physics = false;
+      last_frame_key_b = false;
     }
     ~wreck_game() {
+      fleet.destroy();
+      race_track.destroy();
       delete world;
       delete solver;
       delete broadphase;
       delete dispatcher;
     }
 
+    /// set the rate at which the physics world is stepped, independent of the frame rate.
+    void set_physics_rate(float ticks_per_second, int max_ticks_per_frame = 5) {
+      physics_step = 1.0f / ticks_per_second;
+      max_substeps = max_ticks_per_frame;
+      accumulator = 0;
+    }
+
     /// this is called once OpenGL is initialized
     void app_init() {
 
@@ -84,57 +116,135 @@ namespace octet {
       app_scene->create_default_camera_and_lights();
       app_scene->get_camera_instance(0)->set_near_plane(1);
       app_scene->get_camera_instance(0)->set_far_plane(2000);
-      app_scene->get_camera_instance(0)->get_node()->access_nodeToParent().translate(0.0f, 3.0f, 20.0f);
+      app_scene->get_camera_instance(0)->get_node()->translate(vec3(0.0f, 3.0f, 20.0f));
 
       //create the race track
       race_track.init(this, *&app_scene, *&world);
 
       //create the car
-      vehicle_instance.init(this, *&app_scene, *&world);
+      fleet.init(app_scene, world, &motion_sync);
+      voices.init(8);
+      vehicle_instance.init(this, &fleet, &voices);
+
+      //the camera follows the chassis
+      vehicle_instance.get_chassis_node()->add_child(app_scene->get_camera_instance(0)->get_node());
+
+      hud = new perf_hud();
+      hud->set_scene(app_scene);
+      hud->set_world(world);
+
+      // bullet draws its shapes, contacts and constraints as batched debug lines in the scene.
+      world->setDebugDrawer(app_scene->get_debug_draw());
+
+      frame_clock.reset();
+    }
+
+    /// advance the physics world in fixed ticks, returns the interpolation factor for rendering.
+    float step_physics() {
+      frame_time = frame_clock.getTimeMicroseconds() * 1e-6f;
+      frame_clock.reset();
+
+      accumulator += frame_time;
+      int num_steps = 0;
+      while (accumulator >= physics_step && num_steps < max_substeps) {
+        motion_sync.begin_step();
+        // maxSubSteps = 0 steps the world by exactly one tick.
+        world->stepSimulation(physics_step, 0);
+        accumulator -= physics_step;
+        num_steps++;
+      }
+
+      // drop the time we could not simulate rather than falling further behind.
+      if (accumulator >= physics_step) {
+        accumulator = fmodf(accumulator, physics_step);
+      }
+      return accumulator / physics_step;
     }
 
     /// this is called to draw the world
     void draw_world(int x, int y, int w, int h) {
+      // the last frame ends here, the summary covers everything up to this draw_world.
+      profiler::end_frame();
+      OCTET_PROFILE("draw_world");
       
       int vx = 0, vy = 0;
       get_viewport_size(vx, vy);
       app_scene->begin_render(vx, vy);
 
       //keyboard inputs - car movement with keyboard and xbox controller
-      vehicle_instance.update(vx, vy);
-
-      world->stepSimulation(1.0f / 30, 1, 1.0f / 30);
-
-      //update the rigid bodies
-      btCollisionObjectArray &array = world->getCollisionObjectArray();
-      for (int i = 0; i != array.size(); ++i) {
-        btCollisionObject *co = array[i];
-        scene_node *vehicle_nodes = (scene_node *)co->getUserPointer();
-        if (vehicle_nodes) {
-          if (i == 49){ //the chassis - shouldn't programatically assign camera
-            scene_node *cameraNode = app_scene->get_camera_instance(0)->get_node();
-            vehicle_nodes->add_child(cameraNode);
-            mat4t &cameraMatrix = cameraNode->access_nodeToParent();
-            cameraNode->loadIdentity();
-            cameraMatrix.translate(-30, 14, 0);
-            if (is_key_down('X')){ //allow a free rotating camera 
-              cameraMatrix.rotateY(camAngle.x());
-              cameraMatrix.rotateX(camAngle.y() - 30);
-            }
-            //default positions - static camera facing vehicle
-            else{
-              cameraMatrix.rotateY(270.0f);
-              cameraMatrix.rotateX(-20);
-            }
-          }
-          mat4t &mat = vehicle_nodes->access_nodeToParent();
-          co->getWorldTransform().getOpenGLMatrix(mat.get());
-        }
+      {
+        OCTET_PROFILE("input");
+        vehicle_instance.update(vx, vy);
+        fleet.update_lod(vehicle_instance.get_chassis_node()->get_nodeToParent()[3].xyz());
+        fleet.apply_controls();
+      }
+
+      float alpha = 0;
+      {
+        OCTET_PROFILE("stepSimulation");
+        alpha = step_physics();
+      }
+
+      //move the scene nodes of the bodies that bullet moved, interpolating between the last two physics states
+      {
+        OCTET_PROFILE("transform sync");
+        motion_sync.update_nodes(alpha);
+        fleet.update_nodes();
+      }
+
+      //push sound changes to AL once per frame
+      {
+        OCTET_PROFILE("audio");
+        voices.update();
+      }
+
+      //position the camera relative to the chassis
+      scene_node *cameraNode = app_scene->get_camera_instance(0)->get_node();
+      mat4t cameraMatrix;
+      cameraMatrix.loadIdentity();
+      cameraMatrix.translate(-30, 14, 0);
+      if (is_key_down('X')){ //allow a free rotating camera 
+        cameraMatrix.rotateY(camAngle.x());
+        cameraMatrix.rotateX(camAngle.y() - 30);
+      }
+      //default positions - static camera facing vehicle
+      else{
+        cameraMatrix.rotateY(270.0f);
+        cameraMatrix.rotateX(-20);
+      }
+      cameraNode->set_nodeToParent(cameraMatrix);
+
+      // update matrices.
+      {
+        OCTET_PROFILE("visual_scene::update");
+        app_scene->update(frame_time);
+      }
+      // show or hide the physics shapes and contacts
+      if (is_key_down('B') && !last_frame_key_b) {
+        show_physics = !show_physics;
+        app_scene->set_render_debug_lines(show_physics);
       }
-      // update matrices. assume 30 fps.
-      app_scene->update(1.0f / 30);
+      last_frame_key_b = is_key_down('B');
+      if (show_physics) {
+        OCTET_PROFILE("debugDrawWorld");
+        app_scene->get_debug_draw()->set_viewport(vx, vy);
+        world->debugDrawWorld();
+      }
+
       // draw the scene
-      app_scene->render((float)vx / vy);
+      {
+        OCTET_PROFILE("render");
+        hud->begin_gpu_pass("scene");
+        app_scene->render((float)vx / vy);
+        hud->end_gpu_pass();
+      }
+
+      // show or hide the performance counters
+      if (is_key_down('P') && !last_frame_key_p) {
+        hud->toggle();
+      }
+      last_frame_key_p = is_key_down('P');
+      hud->render(vx, vy);
     }
 
   };
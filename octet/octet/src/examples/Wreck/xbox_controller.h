@@ -5,9 +5,12 @@
 // xbox_controller.h - responsible for providing inputs from an xbox_controller
 // 
 
+#ifdef WIN32
 #include <Xinput.h>
+#endif
 
 namespace octet {
+#ifdef WIN32
     /// Class for getting the input from an Xbox controller.
   /** The class is called to check if an Xbox controller is connected and if it is, get various inputs from it.
   Currently, the only inputs that are being checked are the left trigger, right trigger and the left analog stick. */
@@ -122,4 +125,26 @@ namespace octet {
       return false;
     }
   };
+#else
+  /// XInput is only available on windows, elsewhere there is never a controller connected.
+  class xbox_controller : public resource {
+  public:
+    float left_trigger = 0.0f; //deceleration of vehicle
+    float right_trigger = 0.0f; //acceleration of vehicle
+    float left_analog_x = 0.0f; //left analog x pos
+    float left_analog_y = 0.0f; //left analog y pos
+
+    xbox_controller()
+    {
+    }
+
+    bool is_connected() { return false; }
+
+    bool analog_deadzone() { return true; }
+
+    bool trigger_deadzone() { return true; }
+
+    bool refresh() { return false; }
+  };
+#endif
 }
\ No newline at end of file
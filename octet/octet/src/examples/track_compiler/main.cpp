@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// Race track compiler: converts the text track format to the binary format in track_format.h
+// Build with the generic platform (__GENERIC__), it needs no window, GL or audio.
+//
+
+#include "../../octet.h"
+#include "../Wreck/track_format.h"
+
+static const char *options[] = {
+  "usage: track_compiler [options] <track.txt> <track.bin>",
+  "-help", "show this message",
+  0
+};
+
+/// Compile a text race track to a binary blob that race_track can map.
+int main(int argc, char **argv) {
+  using namespace octet;
+
+  platform::args_parser args(argc, argv, options);
+  if (args.get_error() || *args["-help"] || !args[0] || !args[1]) {
+    if (args.get_error()) printf("%s: %s\n", args.get_error(), args.get_error_arg());
+    args.usage();
+    return 1;
+  }
+
+  FILE *file = fopen(args[0], "rb");
+  if (!file) {
+    printf("could not open %s\n", args[0]);
+    return 1;
+  }
+  dynarray<uint8_t> text;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  text.resize(size > 0 ? (unsigned)size : 0);
+  size_t bytes_read = fread(text.data(), 1, text.size(), file);
+  fclose(file);
+  if (size < 0 || bytes_read != text.size()) {
+    printf("could not read %s: got %u of %ld bytes\n", args[0], (unsigned)bytes_read, size);
+    return 1;
+  }
+
+  dynarray<track_format::track_piece> pieces;
+  track_format::parse_text(text.data(), text.size(), pieces);
+
+  if (!track_format::write_binary(args[1], pieces.data(), pieces.size())) {
+    printf("could not write %s\n", args[1]);
+    return 1;
+  }
+
+  printf("%s: %d pieces, %d bytes\n", args[1], pieces.size(), (int)(sizeof(track_format::track_header) + pieces.size() * sizeof(track_format::track_piece)));
+  return 0;
+}
@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// Pass/fail checks for the Wreck performance work.
+// Build with the generic platform (__GENERIC__) so that no window, GL or audio is needed.
+//
+
+#define OCTET_BULLET 1
+
+#include <algorithm>
+
+#include "../../octet.h"
+#include "../Wreck/track_format.h"
+#include "../Wreck/node_motion_state.h"
+#include "../Wreck/vehicle_fleet.h"
+#include "wreck_check.h"
+
+static const char *options[] = {
+  "usage: wreck_check [options]",
+  "-help", "show this message",
+  0
+};
+
+/// Run the checks, the exit code is non zero if any of them failed.
+int main(int argc, char **argv) {
+  octet::platform::args_parser args(argc, argv, options);
+  if (args.get_error() || *args["-help"]) {
+    if (args.get_error()) printf("%s: %s\n", args.get_error(), args.get_error_arg());
+    args.usage();
+    return 1;
+  }
+
+  octet::app::init_all(argc, argv);
+  octet::wreck_check checks;
+  return checks.run() ? 1 : 0;
+}
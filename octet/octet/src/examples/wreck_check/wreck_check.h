@@ -0,0 +1,1233 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// wreck_check.h - pass/fail checks of the Wreck performance work
+//
+namespace octet {
+  ///Checks each optimisation against the simple code it replaced, or against a reference,
+  ///without a window, GL or audio. Every failed check is printed, and run() returns the number of failures,
+  ///so 'make check' fails when any feature has broken.
+  class wreck_check {
+    unsigned num_checks; // checks made so far
+    unsigned num_failures; // checks that did not hold
+    const char *feature; // name printed with a failure
+
+    // record one check, printing the reason if it failed.
+    bool expect(bool ok, const char *format, ...) {
+      num_checks++;
+      if (!ok) {
+        num_failures++;
+        printf("FAIL %-16s ", feature);
+        va_list list;
+        va_start(list, format);
+        vprintf(format, list);
+        va_end(list);
+        printf("\n");
+      }
+      return ok;
+    }
+
+    // start the checks of one feature
+    void begin(const char *name) {
+      feature = name;
+    }
+
+    // print the result of the feature's checks
+    void end(unsigned failures_before, const char *summary) {
+      printf("%s %-16s %s\n", num_failures == failures_before ? "ok  " : "FAIL", feature, summary);
+    }
+
+    // largest difference between two matrices
+    static float max_difference(const mat4t &a, const mat4t &b) {
+      float result = 0;
+      for (int i = 0; i != 4; ++i) {
+        for (int j = 0; j != 4; ++j) {
+          result = std::max(result, fabsf(a[i][j] - b[i][j]));
+        }
+      }
+      return result;
+    }
+
+    // the node to world matrix multiplied out from the node to parent matrices, as before the cache
+    static mat4t reference_nodeToWorld(scene_node *node) {
+      mat4t result = node->get_nodeToParent();
+      for (scene_node *parent = node->get_parent(); parent; parent = parent->get_parent()) {
+        result = result * parent->get_nodeToParent();
+      }
+      return result;
+    }
+
+    ///The compiled track holds the same pieces as the text file and loaders reject blobs they can not use.
+    void check_track_format() {
+      begin("track_format");
+      unsigned failures = num_failures;
+
+      static const char text[] =
+        "0,0,0,0,1.0,2.0,3.0,50.0,0.5,10.0,\r\n"
+        "90,0,1,0,10.0,0.0,0.0,20.0,0.5,10.0,\n"
+        "!not a piece\n"
+        "^0,0,0,0,0.0,5.0,0.0,1.0,2.0,3.0,\n";
+      dynarray<track_format::track_piece> pieces;
+      track_format::parse_text((const uint8_t*)text, sizeof(text) - 1, pieces);
+      if (expect(pieces.size() == 3, "parsed %d pieces, expected 3", pieces.size())) {
+        mat4t expected;
+        expected.loadIdentity();
+        expected.translate(1, 2, 3);
+        expected.rotate(90, 0, 1, 0);
+        expected.translate(10, 0, 0);
+        mat4t second = track_format::unpack_transform(pieces[1]);
+        float error = length(second.w() - expected.w()) + length(second.x() - expected.x());
+        expect(error < 1e-4f, "second piece is %g away from the accumulated transform", error);
+        expect(pieces[1].material == track_format::material_road, "second piece is not road");
+        expect(pieces[2].material == track_format::material_barrier, "'^' did not switch to the barrier material");
+        expect(length(track_format::unpack_transform(pieces[2]).w() - vec4(0, 5, 0, 1)) < 1e-6f, "'^' did not reset the transform");
+        expect(pieces[2].extent[0] == 1 && pieces[2].extent[1] == 2 && pieces[2].extent[2] == 3, "wrong extent");
+      }
+
+      const char *path = "wreck_check_track.tmp";
+      if (expect(track_format::write_binary(path, pieces.data(), pieces.size()), "could not write %s", path)) {
+        unsigned num_pieces = 0;
+        const track_format::track_piece *mapped = 0;
+        {
+          file_map map(path);
+          mapped = track_format::get_pieces(map.get_data(), map.get_size(), num_pieces);
+          expect(mapped && num_pieces == pieces.size(), "the compiled track did not load");
+          expect(mapped && !memcmp(mapped, pieces.data(), num_pieces * sizeof(track_format::track_piece)), "the compiled pieces differ");
+
+          // a short file and a newer version must both fall back to the text track
+          expect(!track_format::get_pieces(map.get_data(), map.get_size() - 1, num_pieces), "a truncated track was accepted");
+          dynarray<uint8_t> copy;
+          copy.resize((unsigned)map.get_size());
+          memcpy(copy.data(), map.get_data(), copy.size());
+          ((track_format::track_header*)copy.data())->version++;
+          expect(!track_format::get_pieces(copy.data(), copy.size(), num_pieces), "a track of another version was accepted");
+        }
+        remove(path);
+      }
+
+      end(failures, "text and compiled tracks agree");
+    }
+
+    ///Shapes with the same dimensions are shared, others are not, and a shape lives until its last release.
+    void check_shape_cache() {
+      begin("shape_cache");
+      unsigned failures = num_failures;
+      const bullet_shape_cache::stats &stats = bullet_shape_cache::get_stats();
+      unsigned live = stats.live_shapes;
+
+      btVector3 half(1.25f, 0.5f, 3.0f);
+      btCollisionShape *box = bullet_shape_cache::get_box(half);
+      btCollisionShape *same_box = bullet_shape_cache::get_box(half);
+      btCollisionShape *other_box = bullet_shape_cache::get_box(btVector3(1.25f, 0.5f, 3.5f));
+      btCollisionShape *cylinder = bullet_shape_cache::get_cylinder_z(half);
+      expect(box == same_box, "two boxes of the same size are not shared");
+      expect(box != other_box, "boxes of different sizes are shared");
+      expect(box != cylinder, "a box and a cylinder of the same size are shared");
+      expect(stats.live_shapes == live + 3, "%u live shapes, expected %u", stats.live_shapes, live + 3);
+
+      btVector3 cached, fresh;
+      btBoxShape plain(half);
+      bullet_shape_cache::get_local_inertia(box, 7.0f, cached);
+      plain.calculateLocalInertia(7.0f, fresh);
+      expect((cached - fresh).length() < 1e-4f * fresh.length(), "cached inertia differs from the box's own");
+      expect(!bullet_shape_cache::is_shared(&plain), "a shape made outside the cache is shared");
+      bullet_shape_cache::release(&plain); // must be ignored
+
+      bullet_shape_cache::release(box);
+      expect(stats.live_shapes == live + 3, "the box was deleted while it was still in use");
+      bullet_shape_cache::release(same_box);
+      expect(stats.live_shapes == live + 2, "the box was not deleted by its last release");
+      unsigned misses = stats.misses;
+      btCollisionShape *new_box = bullet_shape_cache::get_box(half);
+      expect(stats.misses == misses + 1, "a released box was found in the cache");
+
+      bullet_shape_cache::release(new_box);
+      bullet_shape_cache::release(other_box);
+      bullet_shape_cache::release(cylinder);
+      expect(stats.live_shapes == live, "%u shapes leaked", stats.live_shapes - live);
+
+      end(failures, "shapes are shared by size and freed by the last release");
+    }
+
+    ///The loudest emitters get the voices, a voice is only stolen by a clearly louder emitter and a quiet frame makes no AL calls.
+    void check_voice_manager() {
+      begin("voice_manager");
+      unsigned failures = num_failures;
+      voice_manager voices;
+      voices.init(2);
+      ALuint buffer = 1;
+      int quiet = voices.add_emitter(buffer, 1.0f, true);
+      int middle = voices.add_emitter(buffer, 1.0f, true);
+      int loud = voices.add_emitter(buffer, 1.0f, true);
+      voices.set_gain(quiet, 0.2f);
+      voices.set_gain(middle, 0.5f);
+      voices.set_gain(loud, 0.9f);
+      for (int i = quiet; i <= loud; ++i) voices.set_playing(i, true);
+      voices.update();
+      expect(!voices.is_audible(quiet) && voices.is_audible(middle) && voices.is_audible(loud), "the two loudest emitters do not have the voices");
+      voice_manager::stats stats = voices.get_stats();
+      expect(stats.num_playing == 2 && stats.num_virtual == 1, "%u playing and %u virtual, expected 2 and 1", stats.num_playing, stats.num_virtual);
+
+      voices.update();
+      expect(voices.get_stats().al_calls == 0, "%u AL calls in a frame where nothing changed", voices.get_stats().al_calls);
+
+      // a little louder than a playing emitter is not enough to take its voice
+      voices.set_gain(quiet, 0.55f);
+      voices.update();
+      expect(!voices.is_audible(quiet) && voices.get_stats().num_steals == 0, "a voice was stolen by an emitter that is only a little louder");
+
+      voices.set_gain(quiet, 0.8f);
+      voices.update();
+      expect(voices.is_audible(quiet) && !voices.is_audible(middle), "a much louder emitter did not steal the quietest voice");
+      expect(voices.get_stats().num_steals == 1, "%u steals, expected 1", voices.get_stats().num_steals);
+
+      // removing a playing emitter frees its voice for the next loudest
+      voices.remove_emitter(loud);
+      voices.update();
+      expect(voices.is_audible(middle), "the voice of a removed emitter was not reused");
+      expect(voices.get_stats().num_emitters == 2 && voices.get_stats().num_virtual == 0, "removed emitter is still counted");
+
+      // of two emitters with the same gain the higher priority wins
+      int low = voices.add_emitter(buffer, 1.0f, true);
+      int high = voices.add_emitter(buffer, 4.0f, true);
+      voices.set_gain(low, 1.0f);
+      voices.set_gain(high, 1.0f);
+      voices.set_playing(low, true);
+      voices.set_playing(high, true);
+      voices.update();
+      expect(voices.is_audible(high) && !voices.is_audible(low), "priority did not decide between equal gains");
+
+      end(failures, "voices go to the loudest emitters and are stolen with hysteresis");
+    }
+
+    ///Cached world matrices match the product of the parent matrices however the nodes are moved and reparented.
+    void check_scene_node() {
+      begin("scene_node");
+      unsigned failures = num_failures;
+      random rand;
+      ref<visual_scene> scene = new visual_scene();
+      dynarray<ref<scene_node> > nodes;
+      const int num_nodes = 64;
+      for (int i = 0; i != num_nodes; ++i) {
+        scene_node *node = new scene_node();
+        (i == 0 ? (scene_node*)scene : (scene_node*)nodes[rand.get(0, i - 1)])->add_child(node);
+        nodes.push_back(node);
+      }
+
+      float worst = 0;
+      const int num_rounds = 200;
+      for (int round = 0; round != num_rounds; ++round) {
+        for (int change = 0; change != 4; ++change) {
+          scene_node *node = nodes[rand.get(0, num_nodes - 1)];
+          switch (rand.get(0, 3)) {
+            case 0: {
+              mat4t m;
+              m.loadIdentity();
+              m.rotate(rand.get(-180.0f, 180.0f), 0, 1, 0);
+              m.translate(rand.get(-10.0f, 10.0f), rand.get(-10.0f, 10.0f), 0);
+              node->set_nodeToParent(m);
+            } break;
+            case 1: node->translate(vec3(rand.get(-1.0f, 1.0f), 0, rand.get(-1.0f, 1.0f))); break;
+            case 2: node->rotate(rand.get(-30.0f, 30.0f), vec3(1, 0, 0)); break;
+            default: {
+              // move the node under an earlier one, so the hierarchy never has a cycle
+              int index = 0;
+              while (nodes[index] != node) ++index;
+              if (index != 0) nodes[rand.get(0, index - 1)]->add_child(node);
+            } break;
+          }
+        }
+        // half the rounds refresh the whole scene at once, the others ask node by node
+        if (round & 1) scene->update_world_transforms();
+        for (int i = 0; i != num_nodes; ++i) {
+          worst = std::max(worst, max_difference(nodes[i]->get_nodeToWorld(), reference_nodeToWorld(nodes[i])));
+        }
+      }
+      expect(worst < 1e-3f, "cached world matrices are up to %g away from the reference", worst);
+
+      // writing through access_nodeToParent() after a query must not leave a stale world matrix
+      scene_node *leaf = nodes[num_nodes - 1];
+      mat4t &matrix = leaf->access_nodeToParent();
+      leaf->get_nodeToWorld();
+      matrix.translate(5, 0, 0);
+      float error = max_difference(leaf->get_nodeToWorld(), reference_nodeToWorld(leaf));
+      expect(error < 1e-3f, "a write through access_nodeToParent() after get_nodeToWorld() was lost (%g)", error);
+
+      unsigned version = scene_node::get_change_version();
+      leaf->set_nodeToParent(leaf->get_nodeToParent());
+      expect(scene_node::get_change_version() != version, "set_nodeToParent() did not change the change version");
+
+      end(failures, "world matrices match the reference after random moves");
+    }
+
+    ///Four boxes at a time give the same answer as one at a time, and no box with its center on screen is culled.
+    void check_frustum() {
+      begin("frustum");
+      unsigned failures = num_failures;
+      random rand;
+      mat4t cameraToWorld;
+      cameraToWorld.loadIdentity();
+      cameraToWorld.translate(0, 0, 20);
+      cameraToWorld.rotateY(30);
+      mat4t cameraToProjection;
+      cameraToProjection.loadIdentity();
+      cameraToProjection.frustum(-1, 1, -1, 1, 1, 100);
+      frustum view(cameraToWorld.inverse3x4() * cameraToProjection);
+
+      const int num_blocks = 1000;
+      unsigned num_visible = 0, num_mismatches = 0, num_wrongly_culled = 0;
+      for (int b = 0; b != num_blocks; ++b) {
+        float block[24];
+        aabb boxes[4];
+        for (int i = 0; i != 4; ++i) {
+          vec3 center(rand.get(-60.0f, 60.0f), rand.get(-60.0f, 60.0f), rand.get(-60.0f, 60.0f));
+          vec3 half(rand.get(0.0f, 5.0f), rand.get(0.0f, 5.0f), rand.get(0.0f, 5.0f));
+          boxes[i] = aabb(center, half);
+          frustum::set_block(block, i, boxes[i]);
+        }
+        unsigned mask = view.intersects4(block);
+        for (int i = 0; i != 4; ++i) {
+          bool visible = (mask >> i & 1) != 0;
+          num_visible += visible;
+          num_mismatches += visible != view.intersects(boxes[i]);
+          num_wrongly_culled += !visible && view.intersects(boxes[i].get_center());
+        }
+      }
+      expect(num_visible != 0 && num_visible != num_blocks * 4, "the test boxes are all in or all out, it checks nothing");
+      expect(num_mismatches == 0, "intersects4 disagrees with intersects for %u of %u boxes", num_mismatches, num_blocks * 4);
+      expect(num_wrongly_culled == 0, "%u boxes with their center on screen were culled", num_wrongly_culled);
+
+      char summary[80];
+      sprintf(summary, "intersects4 agrees with intersects on %d boxes (%u visible)", num_blocks * 4, num_visible);
+      end(failures, summary);
+    }
+
+    // t where org + dir * t enters a box, or max_t if it misses before max_t
+    static float entry_t(const aabb &box, vec3_in org, vec3_in dir, float max_t) {
+      vec3 min = box.get_min(), max = box.get_max();
+      float tmin = 0, tmax = max_t;
+      for (int i = 0; i != 3; ++i) {
+        if (dir[i] == 0) {
+          if (org[i] < min[i] || org[i] > max[i]) return max_t;
+        } else {
+          float t0 = (min[i] - org[i]) / dir[i], t1 = (max[i] - org[i]) / dir[i];
+          tmin = std::max(tmin, std::min(t0, t1));
+          tmax = std::min(tmax, std::max(t0, t1));
+        }
+      }
+      return tmin <= tmax && tmin < max_t ? tmin : max_t;
+    }
+
+    // exact boxes for the instance tree check, ray_cast calls this for each leaf it reaches
+    struct box_caster {
+      const dynarray<aabb> *boxes;
+      vec3 org, dir;
+
+      float operator()(int i, float max_t) const {
+        return entry_t((*boxes)[i], org, dir, max_t);
+      }
+    };
+
+    // sort a query result so that it can be compared with the brute force one
+    static bool same_set(dynarray<int> &a, dynarray<int> &b) {
+      std::sort(a.data(), a.data() + a.size());
+      std::sort(b.data(), b.data() + b.size());
+      return a.size() == b.size() && (a.size() == 0 || memcmp(a.data(), b.data(), a.size() * sizeof(int)) == 0);
+    }
+
+    void check_instance_tree() {
+      begin("instance_tree");
+      unsigned failures = num_failures;
+      random rand;
+      const int num_boxes = 300;
+      const float margin = 0.5f;
+      dynamic_aabb_tree tree(margin);
+      dynarray<aabb> boxes; // exact box of each user value
+      dynarray<int> proxies; // proxy of each user value, -1 once removed
+      for (int i = 0; i != num_boxes; ++i) {
+        vec3 center(rand.get(-100.0f, 100.0f), rand.get(-10.0f, 10.0f), rand.get(-100.0f, 100.0f));
+        boxes.push_back(aabb(center, vec3(rand.get(0.5f, 4.0f), rand.get(0.5f, 4.0f), rand.get(0.5f, 4.0f))));
+        proxies.push_back(tree.insert(boxes[i], i));
+      }
+
+      // move every box, some a little (inside the fat box) and some a long way, and remove a few
+      unsigned num_reinserted = 0;
+      for (int round = 0; round != 10; ++round) {
+        for (int i = 0; i != num_boxes; ++i) {
+          if (proxies[i] < 0) continue;
+          float step = rand.get(0, 4) == 0 ? 30.0f : 0.2f;
+          vec3 offset(rand.get(-step, step), rand.get(-step, step) * 0.1f, rand.get(-step, step));
+          boxes[i] = aabb(boxes[i].get_center() + offset, boxes[i].get_half_extent());
+          num_reinserted += tree.move(proxies[i], boxes[i]);
+        }
+        int victim = rand.get(0, num_boxes);
+        if (proxies[victim] >= 0) {
+          tree.remove(proxies[victim]);
+          proxies[victim] = -1;
+        }
+      }
+      int num_live = 0, num_wrong_users = 0, num_outside = 0;
+      for (int i = 0; i != num_boxes; ++i) {
+        if (proxies[i] < 0) continue;
+        num_live++;
+        aabb fat = tree.get_fat_aabb(proxies[i]);
+        num_wrong_users += tree.get_user(proxies[i]) != i;
+        num_outside += !all(fat.get_min() <= boxes[i].get_min()) || !all(boxes[i].get_max() <= fat.get_max());
+      }
+      expect(num_wrong_users == 0, "%d proxies have the wrong user value", num_wrong_users);
+      expect(num_outside == 0, "%d boxes are outside their fat boxes after moving", num_outside);
+      expect(tree.get_num_leaves() == num_live, "the tree has %d leaves, not %d", tree.get_num_leaves(), num_live);
+      expect(tree.get_height() <= 24, "the tree is %d high for %d leaves, it is not balanced", tree.get_height(), num_live);
+
+      // box, sphere and ray queries against a test of every fat box
+      unsigned num_mismatches = 0, num_found = 0;
+      dynarray<int> result, reference;
+      for (int q = 0; q != 200; ++q) {
+        vec3 center(rand.get(-100.0f, 100.0f), rand.get(-10.0f, 10.0f), rand.get(-100.0f, 100.0f));
+        vec3 end(rand.get(-100.0f, 100.0f), rand.get(-10.0f, 10.0f), rand.get(-100.0f, 100.0f));
+        aabb query_box(center, vec3(rand.get(1.0f, 20.0f), rand.get(1.0f, 20.0f), rand.get(1.0f, 20.0f)));
+        sphere query_sphere(center, rand.get(1.0f, 20.0f));
+        ray query_ray(center, end);
+        for (int kind = 0; kind != 3; ++kind) {
+          result.resize(0);
+          reference.resize(0);
+          if (kind == 0) tree.query(query_box, result);
+          else if (kind == 1) tree.query(query_sphere, result);
+          else tree.query(query_ray, result);
+          for (int i = 0; i != num_boxes; ++i) {
+            if (proxies[i] < 0) continue;
+            aabb fat = tree.get_fat_aabb(proxies[i]);
+            vec3 outside = max(max(fat.get_min() - center, center - fat.get_max()), vec3(0, 0, 0));
+            bool hit =
+              kind == 0 ? query_box.intersects(fat) :
+              kind == 1 ? dot(outside, outside) <= squared(query_sphere.get_radius()) :
+              entry_t(fat, center, end - center, 2) <= 1;
+            if (hit) reference.push_back(i);
+          }
+          num_found += reference.size();
+          num_mismatches += !same_set(result, reference);
+        }
+      }
+      expect(num_found != 0, "no query found anything, it checks nothing");
+      expect(num_mismatches == 0, "%u of 600 queries differ from brute force", num_mismatches);
+
+      // nearest hit along rays against the nearest of every exact box
+      unsigned num_hits = 0, num_wrong_hits = 0;
+      box_caster caster;
+      caster.boxes = &boxes;
+      for (int q = 0; q != 500; ++q) {
+        caster.org = vec3(rand.get(-100.0f, 100.0f), rand.get(-10.0f, 10.0f), rand.get(-100.0f, 100.0f));
+        caster.dir = normalize(vec3(rand.get(-1.0f, 1.0f), rand.get(-0.1f, 0.1f), rand.get(-1.0f, 1.0f)));
+        float distance = 200;
+        int best = tree.ray_cast(caster.org, caster.dir, distance, caster);
+        float reference_distance = 200;
+        int reference_best = -1;
+        for (int i = 0; i != num_boxes; ++i) {
+          if (proxies[i] < 0) continue;
+          float t = caster(i, reference_distance);
+          if (t < reference_distance) {
+            reference_distance = t;
+            reference_best = i;
+          }
+        }
+        num_hits += reference_best >= 0;
+        num_wrong_hits += best != reference_best && distance != reference_distance;
+      }
+      expect(num_hits != 0, "no ray hit a box, it checks nothing");
+      expect(num_wrong_hits == 0, "ray_cast found a different nearest box for %u of 500 rays", num_wrong_hits);
+
+      char summary[100];
+      sprintf(summary, "queries match brute force on %d boxes (%u reinserts, %u ray hits)", num_live, num_reinserted, num_hits);
+      end(failures, summary);
+    }
+
+    void check_mesh_bvh() {
+      begin("mesh_bvh");
+      unsigned failures = num_failures;
+      random rand;
+      // sphere::get_geometry only places the subdivided vertices correctly for a unit sphere at the origin
+      vec3 centre(0, 0, 0);
+      float radius = 1;
+      ref<mesh_sphere> tree_mesh = new mesh_sphere(centre, radius, 4);
+      ref<mesh_sphere> plain_mesh = new mesh_sphere(centre, radius, 4);
+      plain_mesh->set_use_bvh(false);
+      unsigned num_triangles = tree_mesh->get_num_indices() / 3;
+      expect(num_triangles >= 1000 && tree_mesh->get_bvh() != NULL, "the sphere has %u triangles and no tree, it checks nothing", num_triangles);
+
+      // rays from outside the sphere at points near it, some miss and some pass through both sides
+      const int num_rays = 2000;
+      unsigned num_hits = 0, num_mismatches = 0, num_off_surface = 0;
+      for (int r = 0; r != num_rays; ++r) {
+        vec3 start = centre + normalize(vec3(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f))) * (radius * 3);
+        vec3 target = centre + vec3(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f)) * (radius * 1.2f);
+        ray the_ray(start, target);
+        int tree_indices[3] = { -1, -1, -1 }, plain_indices[3] = { -1, -1, -1 };
+        vec4 tree_numer(0, 0, 0, 0), plain_numer(0, 0, 0, 0);
+        float tree_denom = 0, plain_denom = 0;
+        bool tree_hit = tree_mesh->ray_cast(the_ray, tree_indices, tree_numer, tree_denom);
+        bool plain_hit = plain_mesh->ray_cast(the_ray, plain_indices, plain_numer, plain_denom);
+        if (tree_hit != plain_hit || (plain_hit && memcmp(tree_indices, plain_indices, sizeof(plain_indices)) != 0)) {
+          num_mismatches++;
+        } else if (plain_hit) {
+          num_hits++;
+          // the nearest hit is on the front of the sphere
+          vec3 pos = start + (target - start) * (plain_numer[3] / plain_denom);
+          float distance = length(pos - centre);
+          num_off_surface += distance < radius * 0.95f || distance > radius * 1.001f || dot(pos - centre, target - start) > 0;
+        }
+      }
+      expect(num_hits != 0 && num_hits != num_rays, "the rays all hit or all miss, it checks nothing");
+      expect(num_mismatches == 0, "the tree found a different triangle from the full search for %u of %d rays", num_mismatches, num_rays);
+      expect(num_off_surface == 0, "%u hits are not on the front of the sphere", num_off_surface);
+
+      // changing the vertices must rebuild the tree
+      mesh_bvh *old_tree = tree_mesh->get_bvh();
+      tree_mesh->set_shape(sphere(centre, radius * 0.5f), 4);
+      mesh_bvh *new_tree = tree_mesh->get_bvh();
+      int indices[3];
+      vec4 numer;
+      float denom = 0;
+      bool hit = tree_mesh->ray_cast(ray(centre + vec3(0, 0, radius * 2), centre), indices, numer, denom);
+      float t = hit ? numer[3] / denom : 0;
+      expect(hit && fabsf(t - 0.75f) < 0.02f, "a ray at the shrunk sphere hit at %f, not 0.75, the tree was not rebuilt (%p, %p)", t, old_tree, new_tree);
+
+      char summary[100];
+      sprintf(summary, "tree and full search agree on %d rays at %u triangles (%u hits)", num_rays, num_triangles, num_hits);
+      end(failures, summary);
+    }
+
+    // compare render_queue items by key only, so that std::stable_sort keeps equal keys in the order they were added
+    static bool key_less(const render_queue::item &a, const render_queue::item &b) {
+      return a.key < b.key;
+    }
+
+    void check_render_queue() {
+      begin("render_queue");
+      unsigned failures = num_failures;
+      random rand;
+      render_queue queue;
+      int dummy_materials[20], dummy_meshes[50];
+      dynarray<float> depths;
+      dynarray<render_queue::item> reference;
+      unsigned num_sorted = 0, num_wrong_order = 0, num_wrong_depth = 0;
+
+      // the sizes cover the empty and single draw cases; the last rounds share a program, material and mesh,
+      // so most key bytes are the same in every draw and the sort skips them
+      static const unsigned sizes[] = { 0, 1, 2, 17, 1000, 5000, 1000, 5000 };
+      for (unsigned round = 0; round != sizeof(sizes) / sizeof(sizes[0]); ++round) {
+        bool one_state = round >= 6;
+        queue.reset();
+        depths.resize(0);
+        for (unsigned i = 0; i != sizes[round]; ++i) {
+          GLuint program = one_state ? 3 : rand.get(1, 6);
+          const void *material = one_state ? (void*)&dummy_materials[0] : (void*)&dummy_materials[rand.get(0, 20)];
+          const void *mesh = one_state ? (void*)&dummy_meshes[0] : (void*)&dummy_meshes[rand.get(0, 50)];
+          float depth = rand.get(0, 4) == 0 ? 10.0f : rand.get(0.1f, 500.0f); // some equal depths to check stability
+          queue.add(program, material, mesh, depth, i);
+          depths.push_back(depth);
+        }
+
+        // before sorting, get_key() gives the keys in the order they were added
+        reference.resize(queue.size());
+        for (unsigned i = 0; i != queue.size(); ++i) {
+          reference[i].key = queue.get_key(i);
+          reference[i].index = queue.get_index(i);
+        }
+        std::stable_sort(reference.data(), reference.data() + reference.size(), key_less);
+
+        queue.sort();
+        expect(queue.size() == sizes[round], "the queue has %u draws, not %u", queue.size(), sizes[round]);
+        for (unsigned i = 0; i != queue.size(); ++i) {
+          num_sorted++;
+          num_wrong_order += queue.get_key(i) != reference[i].key || queue.get_index(i) != reference[i].index;
+          // within the same program, material and mesh, nearer draws come first
+          if (i != 0 && queue.get_key(i) >> render_queue::mesh_shift == queue.get_key(i-1) >> render_queue::mesh_shift) {
+            num_wrong_depth += depths[queue.get_index(i)] < depths[queue.get_index(i-1)] && queue.get_key(i) != queue.get_key(i-1);
+          }
+        }
+      }
+      expect(num_wrong_order == 0, "%u of %u draws differ from a stable sort of the keys", num_wrong_order, num_sorted);
+      expect(num_wrong_depth == 0, "%u draws come after a farther draw with the same state", num_wrong_depth);
+
+      char summary[100];
+      sprintf(summary, "radix sort matches a stable sort on %u draws", num_sorted);
+      end(failures, summary);
+    }
+
+    void check_occlusion() {
+      begin("occlusion");
+      unsigned failures = num_failures;
+      random rand;
+      thread_pool pool;
+      pool.init(4);
+
+      // looking down -z from the origin at walls between 20 and 60 units away
+      mat4t cameraToProjection;
+      cameraToProjection.loadIdentity();
+      cameraToProjection.frustum(-1, 1, -0.5f, 0.5f, 1, 200);
+      dynarray<ref<mesh_box> > walls;
+      dynarray<mat4t> wallToWorld;
+      for (int i = 0; i != 12; ++i) {
+        walls.push_back(new mesh_box(vec3(rand.get(2.0f, 8.0f), rand.get(2.0f, 8.0f), 0.5f)));
+        mat4t modelToWorld;
+        modelToWorld.loadIdentity();
+        modelToWorld.translate(rand.get(-20.0f, 20.0f), rand.get(-10.0f, 10.0f), rand.get(-60.0f, -20.0f));
+        wallToWorld.push_back(modelToWorld);
+      }
+
+      frustum view(cameraToProjection);
+      occlusion_buffer fast, reference;
+      unsigned num_pixels = 0, num_depth_mismatches = 0, num_tested = 0, num_hidden = 0, num_mismatches = 0, num_wrongly_hidden = 0;
+      for (int threaded = 0; threaded != 2; ++threaded) {
+        fast.begin(cameraToProjection);
+        reference.begin(cameraToProjection);
+        for (unsigned i = 0; i != walls.size(); ++i) {
+          fast.add_occluder(walls[i], wallToWorld[i]);
+          reference.add_occluder(walls[i], wallToWorld[i]);
+        }
+        fast.rasterize(threaded ? &pool : NULL);
+        reference.rasterize_reference();
+
+        for (unsigned y = 0; y != fast.get_height(); ++y) {
+          for (unsigned x = 0; x != fast.get_width(); ++x) {
+            num_pixels++;
+            num_depth_mismatches += fabsf(fast.get_depth(x, y) - reference.get_depth(x, y)) > 1e-6f;
+          }
+        }
+
+        for (int i = 0; i != 2000; ++i) {
+          vec3 center(rand.get(-40.0f, 40.0f), rand.get(-20.0f, 20.0f), rand.get(-150.0f, -10.0f));
+          aabb bb(center, vec3(rand.get(0.2f, 3.0f), rand.get(0.2f, 3.0f), rand.get(0.2f, 3.0f)));
+          if (!view.intersects(bb)) continue;
+          bool hidden = fast.is_occluded(bb);
+          num_tested++;
+          num_hidden += hidden;
+          num_mismatches += hidden != reference.is_occluded_reference(bb);
+          // a box nearer than every wall can not be hidden
+          num_wrongly_hidden += hidden && bb.get_max().z() > -19.5f;
+        }
+      }
+      expect(num_hidden != 0 && num_hidden != num_tested, "the boxes are all hidden or all visible, it checks nothing");
+      expect(num_depth_mismatches == 0, "%u of %u pixels differ from the reference rasterizer", num_depth_mismatches, num_pixels);
+      expect(num_mismatches == 0, "is_occluded disagrees with the reference for %u of %u boxes", num_mismatches, num_tested);
+      expect(num_wrongly_hidden == 0, "%u boxes in front of the walls were hidden", num_wrongly_hidden);
+
+      char summary[100];
+      sprintf(summary, "depth and tests match the reference, with and without threads (%u of %u hidden)", num_hidden, num_tested);
+      end(failures, summary);
+    }
+
+    void check_ray_batch() {
+      begin("ray_batch");
+      unsigned failures = num_failures;
+      random rand;
+      thread_pool pool;
+      pool.init(4);
+
+      // spheres scaled, turned and moved by their nodes; plain copies of the meshes give the full search
+      ref<visual_scene> scene = new visual_scene();
+      ref<material> mat = new material(vec4(1, 0, 0, 1));
+      ref<mesh_sphere> tree_mesh = new mesh_sphere(vec3(0, 0, 0), 1, 3);
+      ref<mesh_sphere> plain_mesh = new mesh_sphere(vec3(0, 0, 0), 1, 3);
+      plain_mesh->set_use_bvh(false);
+      const int num_spheres = 40;
+      dynarray<scene_node*> nodes;
+      for (int i = 0; i != num_spheres; ++i) {
+        mat4t nodeToParent;
+        nodeToParent.loadIdentity();
+        nodeToParent.translate(rand.get(-50.0f, 50.0f), rand.get(-5.0f, 5.0f), rand.get(-50.0f, 50.0f));
+        nodeToParent.rotateY(rand.get(0.0f, 360.0f));
+        nodeToParent.scale(rand.get(1.0f, 6.0f), rand.get(1.0f, 6.0f), rand.get(1.0f, 6.0f));
+        scene_node *node = new scene_node();
+        node->set_nodeToParent(nodeToParent);
+        scene->add_child(node);
+        scene->add_mesh_instance(new mesh_instance(node, tree_mesh, mat));
+        nodes.push_back(node);
+      }
+
+      const unsigned num_rays = 3000;
+      dynarray<visual_scene::ray_query> queries;
+      dynarray<visual_scene::ray_hit> threaded(num_rays), serial(num_rays);
+      for (unsigned r = 0; r != num_rays; ++r) {
+        visual_scene::ray_query q;
+        q.origin = vec3(rand.get(-60.0f, 60.0f), rand.get(-5.0f, 5.0f), rand.get(-60.0f, 60.0f));
+        q.direction = normalize(vec3(rand.get(-1.0f, 1.0f), rand.get(-0.2f, 0.2f), rand.get(-1.0f, 1.0f)));
+        q.max_distance = rand.get(10.0f, 100.0f);
+        q.ignore = rand.get(0, 4) == 0 ? nodes[rand.get(0, num_spheres)] : NULL;
+        queries.push_back(q);
+      }
+      scene->cast_rays(threaded.data(), queries.data(), num_rays, &pool);
+      scene->cast_rays(serial.data(), queries.data(), num_rays);
+
+      unsigned num_hits = 0, num_thread_mismatches = 0, num_mismatches = 0, num_ignored = 0;
+      for (unsigned r = 0; r != num_rays; ++r) {
+        const visual_scene::ray_query &q = queries[r];
+        num_thread_mismatches += threaded[r].mi != serial[r].mi || threaded[r].distance != serial[r].distance || threaded[r].index != serial[r].index;
+
+        // nearest hit of every sphere, one triangle at a time
+        mesh_instance *best = NULL;
+        float best_t = q.max_distance;
+        for (int i = 0; i != num_spheres; ++i) {
+          if (nodes[i] == q.ignore) continue;
+          mat4t worldToNode = nodes[i]->get_nodeToWorld().inverse3x4();
+          vec3 org = (q.origin.xyz1() * worldToNode).xyz();
+          vec3 dir = (q.direction.xyz0() * worldToNode).xyz();
+          int indices[3];
+          vec4 numer;
+          float denom;
+          if (plain_mesh->ray_cast(ray(org, org + dir), indices, numer, denom)) {
+            float t = numer[3] / denom;
+            if (t < best_t) {
+              best_t = t;
+              best = scene->get_mesh_instance(i);
+            }
+          }
+        }
+        num_hits += best != NULL;
+        num_ignored += serial[r].mi && serial[r].mi->get_node() == q.ignore;
+        // the full search divides in a different order, so allow a little rounding
+        num_mismatches += serial[r].mi != best || fabsf(serial[r].distance - best_t) > 1e-3f * best_t;
+      }
+      expect(num_hits != 0 && num_hits != num_rays, "the rays all hit or all miss, it checks nothing");
+      expect(num_thread_mismatches == 0, "%u of %u rays differ between threaded and serial casts", num_thread_mismatches, num_rays);
+      expect(num_mismatches == 0, "%u of %u rays differ from a search of every triangle", num_mismatches, num_rays);
+      expect(num_ignored == 0, "%u rays hit the node they were told to ignore", num_ignored);
+
+      char summary[100];
+      sprintf(summary, "threaded, serial and full search agree on %u rays (%u hits)", num_rays, num_hits);
+      end(failures, summary);
+    }
+
+    // the bindings GL would hold, for the gl_state check
+    struct gl_bindings {
+      GLuint program, array_buffer, element_buffer, framebuffer;
+      GLuint textures[4];
+      bool caps[3];
+
+      bool operator==(const gl_bindings &rhs) const {
+        return memcmp(this, &rhs, sizeof(*this)) == 0;
+      }
+    };
+
+    void check_gl_state() {
+      begin("gl_state");
+      unsigned failures = num_failures;
+      random rand;
+      static const GLenum caps[] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE };
+
+      // 'want' has every call applied, 'gl' only the calls that gl_state makes. They must always agree.
+      gl_bindings want, gl;
+      memset(&want, 0, sizeof(want));
+      gl = want;
+      gl_state::invalidate();
+      gl_state::end_frame();
+      unsigned num_ops = 20000, num_wrong = 0, num_foreign = 0;
+      for (unsigned i = 0; i != num_ops; ++i) {
+        gl_state::stats before = gl_state::get_stats();
+        GLuint value = rand.get(0, 4);
+        switch (rand.get(0, 8)) {
+          case 0: {
+            want.program = value;
+            if (gl_state::use_program(value)) gl.program = value;
+          } break;
+          case 1: {
+            bool array = rand.get(0, 2) == 0;
+            (array ? want.array_buffer : want.element_buffer) = value;
+            if (gl_state::bind_buffer(array ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER, value)) {
+              (array ? gl.array_buffer : gl.element_buffer) = value;
+            }
+          } break;
+          case 2: {
+            unsigned slot = rand.get(0, 4);
+            want.textures[slot] = value;
+            if (gl_state::bind_texture(slot, GL_TEXTURE_2D, value)) gl.textures[slot] = value;
+          } break;
+          case 3: {
+            unsigned cap = rand.get(0, 3);
+            bool enabled = rand.get(0, 2) != 0;
+            want.caps[cap] = enabled;
+            gl_state::set_enabled(caps[cap], enabled);
+            if (gl_state::get_stats().issued[gl_state::kind_enable] != before.issued[gl_state::kind_enable]) gl.caps[cap] = enabled;
+          } break;
+          case 4: {
+            want.framebuffer = value;
+            if (gl_state::bind_framebuffer(GL_FRAMEBUFFER, value)) gl.framebuffer = value;
+          } break;
+          case 5: {
+            // deleting a bound buffer binds zero in its place
+            gl_state::forget_buffer(value);
+            if (want.array_buffer == value) want.array_buffer = gl.array_buffer = 0;
+            if (want.element_buffer == value) want.element_buffer = gl.element_buffer = 0;
+          } break;
+          case 6: case 7: {
+            // other code calls GL directly, then tells gl_state
+            want.program = gl.program = value;
+            want.textures[0] = gl.textures[0] = rand.get(0, 4);
+            want.caps[0] = gl.caps[0] = rand.get(0, 2) != 0;
+            gl_state::invalidate();
+            num_foreign++;
+          } break;
+        }
+        num_wrong += !(gl == want);
+      }
+      unsigned num_elided = gl_state::get_stats().get_elided(), num_issued = gl_state::get_stats().get_issued();
+      expect(num_elided != 0 && num_foreign != 0, "nothing was skipped or invalidated, it checks nothing");
+      expect(num_wrong == 0, "GL was left in the wrong state after %u of %u calls", num_wrong, num_ops);
+
+      // GL_SAMPLE_BUFFERS is asked for once per framebuffer binding
+      gl_state::invalidate();
+      gl_state::bind_framebuffer(GL_FRAMEBUFFER, 1);
+      unsigned queries = gl_state::get_stats().issued[gl_state::kind_query];
+      gl_state::get_sample_buffers();
+      gl_state::get_sample_buffers();
+      gl_state::bind_framebuffer(GL_FRAMEBUFFER, 1);
+      gl_state::get_sample_buffers();
+      expect(gl_state::get_stats().issued[gl_state::kind_query] == queries + 1, "the sample buffers were asked for %u times for one binding", gl_state::get_stats().issued[gl_state::kind_query] - queries);
+      gl_state::bind_framebuffer(GL_FRAMEBUFFER, 2);
+      gl_state::get_sample_buffers();
+      gl_state::bind_framebuffer(GL_DRAW_FRAMEBUFFER, 3);
+      gl_state::get_sample_buffers();
+      expect(gl_state::get_stats().issued[gl_state::kind_query] == queries + 3, "the sample buffers were not asked for again after a new binding");
+      expect(gl_state::bind_framebuffer(GL_FRAMEBUFFER, 2), "binding both framebuffers after a draw binding was skipped");
+
+      gl_state::end_frame();
+      expect(gl_state::get_frame_stats().get_issued() >= num_issued && gl_state::get_stats().get_issued() == 0, "end_frame() did not move the counters to the last frame");
+      gl_state::invalidate();
+
+      char summary[100];
+      sprintf(summary, "GL matches every call made after %u calls, %u issued and %u skipped", num_ops, num_issued, num_elided);
+      end(failures, summary);
+    }
+
+    // keep the cpu busy for a while inside a profiled block
+    static void spin(unsigned count) {
+      volatile float x = 1;
+      for (unsigned i = 0; i != count; ++i) {
+        x = x * 0.999f + 0.001f;
+      }
+    }
+
+    // thread_pool job for the profiler check: one profiled block per item
+    static void profiled_job(void *, unsigned begin, unsigned end) {
+      for (unsigned i = begin; i != end; ++i) {
+        OCTET_PROFILE("check \"item\"");
+        spin(1000);
+      }
+    }
+
+    // number of times a string appears in a text
+    static unsigned count_matches(const char *text, const char *str) {
+      unsigned result = 0;
+      for (const char *p = strstr(text, str); p; p = strstr(p + 1, str)) {
+        result++;
+      }
+      return result;
+    }
+
+    // find a block in the profiler's summary, NULL if it is not there
+    static const profiler::summary_entry *find_summary(const char *name) {
+      const dynarray<profiler::summary_entry> &summary = profiler::get_summary();
+      for (unsigned i = 0; i != summary.size(); ++i) {
+        if (!strcmp(summary[i].name, name)) return &summary[i];
+      }
+      return NULL;
+    }
+
+    void check_profiler() {
+      begin("profiler");
+      unsigned failures = num_failures;
+      thread_pool pool;
+      pool.init(4);
+
+      // two summary windows, so that one of them holds only these frames
+      for (unsigned frame = 0; frame != profiler::summary_frames * 2; ++frame) {
+        {
+          OCTET_PROFILE("check outer");
+          for (int i = 0; i != 3; ++i) {
+            OCTET_PROFILE("check inner");
+            spin(20000);
+          }
+        }
+        profiler::end_frame();
+      }
+      const profiler::summary_entry *outer = find_summary("check outer");
+      const profiler::summary_entry *inner = find_summary("check inner");
+      if (expect(outer && inner, "the blocks are missing from the summary")) {
+        expect(inner->depth == outer->depth + 1, "the inner block is at depth %u inside a block at depth %u", inner->depth, outer->depth);
+        expect(outer->calls == 1 && inner->calls == 3, "%.2f and %.2f calls a frame, not 1 and 3", outer->calls, inner->calls);
+        expect(inner->avg_ms > 0 && inner->avg_ms <= outer->avg_ms && outer->avg_ms <= outer->max_ms, "times out of order: inner %.3fms, outer %.3fms avg %.3fms max", inner->avg_ms, outer->avg_ms, outer->max_ms);
+      }
+
+      // blocks on the pool's threads all go into the trace
+      const unsigned num_items = 200;
+      const char *filename = "wreck_check_trace.json";
+      profiler::begin_capture();
+      for (int frame = 0; frame != 2; ++frame) {
+        pool.run(profiled_job, NULL, num_items, 4);
+        profiler::end_frame();
+      }
+      bool written = profiler::write_trace(filename);
+      expect(written && !profiler::is_capturing(), "the trace was not written to %s", filename);
+      dynarray<char> text;
+      if (FILE *file = fopen(filename, "rb")) {
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        text.resize(size + 1);
+        text[fread(text.data(), 1, size, file)] = 0;
+        fclose(file);
+        remove(filename);
+      } else {
+        text.push_back(0);
+      }
+
+      // brackets outside strings must balance for the trace to load
+      int braces = 0, min_braces = 0;
+      bool in_string = false;
+      for (const char *p = text.data(); *p; ++p) {
+        if (in_string) {
+          if (*p == '\\') p++; else if (*p == '"') in_string = false;
+        } else if (*p == '"') {
+          in_string = true;
+        } else {
+          braces += (*p == '{' || *p == '[') - (*p == '}' || *p == ']');
+          min_braces = std::min(min_braces, braces);
+        }
+      }
+      unsigned num_events = count_matches(text.data(), "\"name\":\"check \\\"item\\\"\"");
+      unsigned num_threads = count_matches(text.data(), "\"thread_name\"");
+      expect(!strncmp(text.data(), "{\"traceEvents\":[", 16) && braces == 0 && min_braces == 0 && !in_string, "the trace is not well formed JSON");
+      expect(num_events == num_items * 2, "the trace has %u of the %u blocks", num_events, num_items * 2);
+      expect(num_threads >= 2, "the trace has %u threads, the pool's threads are missing", num_threads);
+
+      char summary[100];
+      sprintf(summary, "nested blocks are summarised and %u blocks on %u threads are traced", num_events, num_threads);
+      end(failures, summary);
+    }
+
+    // a bullet world with gravity and a floor at y = 0, for the physics checks
+    struct physics_world {
+      btDefaultCollisionConfiguration config;
+      btCollisionDispatcher dispatcher;
+      btDbvtBroadphase broadphase;
+      btSequentialImpulseConstraintSolver solver;
+      btDiscreteDynamicsWorld world;
+      btBoxShape floor_shape;
+      btRigidBody floor;
+
+      physics_world() :
+        dispatcher(&config),
+        world(&dispatcher, &broadphase, &solver, &config),
+        floor_shape(btVector3(200, 1, 200)),
+        floor(0, NULL, &floor_shape)
+      {
+        world.setGravity(btVector3(0, -9.8f, 0));
+        floor.setWorldTransform(btTransform(btQuaternion(0, 0, 0, 1), btVector3(0, -1, 0)));
+        floor.setFriction(10);
+        world.addRigidBody(&floor);
+      }
+
+      ~physics_world() {
+        world.removeRigidBody(&floor);
+      }
+    };
+
+    void check_motion_state() {
+      begin("motion_state");
+      unsigned failures = num_failures;
+      physics_world physics;
+      btDiscreteDynamicsWorld &world = physics.world;
+
+      // a stack of boxes that fall, settle and go to sleep
+      btBoxShape box_shape(btVector3(0.5f, 0.5f, 0.5f));
+      motion_state_sync sync;
+      const int num_boxes = 20;
+      dynarray<ref<scene_node> > nodes;
+      dynarray<node_motion_state*> states;
+      dynarray<btRigidBody*> bodies;
+      btVector3 inertia;
+      box_shape.calculateLocalInertia(1, inertia);
+      for (int i = 0; i != num_boxes; ++i) {
+        btTransform start(btQuaternion(btVector3(0, 1, 0), i * 0.3f), btVector3((i % 4) * 2.0f - 3, 1.0f + i * 1.5f, (i / 4) * 2.0f - 4));
+        nodes.push_back(new scene_node());
+        states.push_back(new node_motion_state(nodes[i], start, &sync));
+        bodies.push_back(new btRigidBody(1, states[i], &box_shape, inertia));
+        world.addRigidBody(bodies[i]);
+      }
+
+      // with alpha = 1 every node must be where its body is, and half way between ticks with alpha = 0.5.
+      // The rotation goes through a quaternion, so allow for some rounding.
+      const btScalar step = 1.0f / 60;
+      unsigned num_steps = 0, num_wrong = 0, num_wrong_halfway = 0, max_moving = 0;
+      while (num_steps != 1200 && (num_steps < 10 || sync.get_num_moving() != 0)) {
+        dynarray<vec3> before;
+        for (int i = 0; i != num_boxes; ++i) {
+          btVector3 pos = bodies[i]->getWorldTransform().getOrigin();
+          before.push_back(vec3(pos.x(), pos.y(), pos.z()));
+        }
+        sync.begin_step();
+        world.stepSimulation(step, 0);
+        num_steps++;
+        max_moving = std::max(max_moving, (unsigned)sync.get_num_moving());
+
+        sync.update_nodes(0.5f);
+        for (int i = 0; i != num_boxes; ++i) {
+          if (!bodies[i]->isActive()) continue;
+          btVector3 pos = bodies[i]->getWorldTransform().getOrigin();
+          vec3 halfway = (before[i] + vec3(pos.x(), pos.y(), pos.z())) * 0.5f;
+          num_wrong_halfway += length(nodes[i]->get_nodeToParent().w().xyz() - halfway) > 1e-3f;
+        }
+        sync.update_nodes(1.0f);
+        for (int i = 0; i != num_boxes; ++i) {
+          mat4t body;
+          bodies[i]->getWorldTransform().getOpenGLMatrix(body.get());
+          num_wrong += max_difference(nodes[i]->get_nodeToParent(), body) > 1e-3f;
+        }
+      }
+      expect(max_moving == num_boxes, "only %u of %d falling boxes were moving", max_moving, num_boxes);
+      expect(num_wrong == 0, "%u times a node was not where its body is", num_wrong);
+      expect(num_wrong_halfway == 0, "%u times a node was not half way between ticks", num_wrong_halfway);
+      expect(sync.get_num_moving() == 0, "%d boxes are still moving after %u steps", sync.get_num_moving(), num_steps);
+
+      // waking one box moves only that one, and deleting a moving body takes it off the list
+      bodies[0]->activate();
+      bodies[0]->applyCentralImpulse(btVector3(0, 5, 0));
+      sync.begin_step();
+      world.stepSimulation(step, 0);
+      sync.update_nodes(1.0f);
+      expect(sync.get_num_moving() == 1, "%d boxes moving after waking one", sync.get_num_moving());
+      world.removeRigidBody(bodies[0]);
+      delete bodies[0];
+      delete states[0];
+      expect(sync.get_num_moving() == 0, "a deleted body is still in the moving list");
+
+      for (int i = 1; i != num_boxes; ++i) {
+        world.removeRigidBody(bodies[i]);
+        delete bodies[i];
+        delete states[i];
+      }
+
+      char summary[100];
+      sprintf(summary, "nodes follow %d bodies until they all sleep after %u steps", num_boxes, num_steps);
+      end(failures, summary);
+    }
+
+    void check_debug_draw() {
+      begin("debug_draw");
+      unsigned failures = num_failures;
+      debug_draw draw;
+      render_state state;
+      mat4t worldToProjection;
+      worldToProjection.loadIdentity();
+
+      draw.add_line(vec3(0, 0, 0), vec3(1, 0, 0));
+      expect(draw.get_num_lines() == 1, "a line added %u lines", draw.get_num_lines());
+      draw.add_box(aabb(vec3(0, 0, 0), vec3(1, 2, 3)));
+      expect(draw.get_num_lines() == 13, "a box added %u lines, not 12", draw.get_num_lines() - 1);
+      draw.add_axes(mat4t());
+      expect(draw.get_num_lines() == 16, "axes added %u lines, not 3", draw.get_num_lines() - 13);
+      draw.add_sphere(vec3(0, 0, 0), 1);
+      unsigned sphere_lines = draw.get_num_lines() - 16;
+      expect(sphere_lines != 0 && sphere_lines % 3 == 0, "a sphere added %u lines, not three circles", sphere_lines);
+
+      // a bullet world: the axes and edges of every box and a normal at each contact point
+      physics_world physics;
+      btDiscreteDynamicsWorld &world = physics.world;
+      btBoxShape box_shape(btVector3(0.5f, 0.5f, 0.5f));
+      const int num_boxes = 100;
+      dynarray<btRigidBody*> bodies;
+      btVector3 inertia;
+      box_shape.calculateLocalInertia(1, inertia);
+      for (int i = 0; i != num_boxes; ++i) {
+        bodies.push_back(new btRigidBody(1, NULL, &box_shape, inertia));
+        bodies[i]->setWorldTransform(btTransform(btQuaternion(0, 0, 0, 1), btVector3((i % 10) * 2.0f, 0.5f, (i / 10) * 2.0f)));
+        world.addRigidBody(bodies[i]);
+      }
+      world.stepSimulation(1.0f / 60, 0);
+
+      unsigned num_contacts = 0;
+      for (int i = 0; i != physics.dispatcher.getNumManifolds(); ++i) {
+        num_contacts += physics.dispatcher.getManifoldByIndexInternal(i)->getNumContacts();
+      }
+      draw.clear();
+      expect(draw.get_num_lines() == 0, "clear() left %u lines", draw.get_num_lines());
+      world.setDebugDrawer(&draw);
+      world.debugDrawWorld();
+      world.setDebugDrawer(NULL);
+      unsigned num_lines = draw.get_num_lines();
+      expect(num_contacts != 0, "the boxes are not touching the floor, it checks nothing");
+      unsigned expected = (3 + 12) * (num_boxes + 1) + num_contacts;
+      expect(num_lines == expected, "%u lines for %d boxes and %u contacts, expected %u", num_lines, num_boxes + 1, num_contacts, expected);
+
+      // however many lines, they take one draw call
+      draw.render(worldToProjection, state);
+      expect(state.get_stats().draw_calls == 1, "%u draw calls for %u lines", state.get_stats().draw_calls, num_lines);
+      expect(draw.get_num_lines_drawn() == num_lines, "%u of %u lines drawn", draw.get_num_lines_drawn(), num_lines);
+      draw.clear();
+      state.reset_stats();
+      draw.render(worldToProjection, state);
+      expect(state.get_stats().draw_calls == 0 && draw.get_num_lines_drawn() == 0, "an empty frame made %u draw calls", state.get_stats().draw_calls);
+
+      for (int i = 0; i != num_boxes; ++i) {
+        world.removeRigidBody(bodies[i]);
+        delete bodies[i];
+      }
+
+      char summary[100];
+      sprintf(summary, "%u lines for %d bodies and %u contacts in one draw call", num_lines, num_boxes + 1, num_contacts);
+      end(failures, summary);
+    }
+
+    // distance a car's chassis has moved from a point
+    static float distance_from(vehicle_fleet &fleet, int car, const btVector3 &pos) {
+      return (float)fleet.get_chassis(car)->getWorldTransform().getOrigin().distance(pos);
+    }
+
+    void check_vehicle_fleet() {
+      begin("vehicle_fleet");
+      unsigned failures = num_failures;
+      physics_world physics;
+      motion_state_sync sync;
+      ref<visual_scene> scene = new visual_scene();
+      vehicle_fleet fleet;
+      fleet.init(scene, &physics.world, &sync);
+      const int num_cars = 6;
+      for (int car = 0; car != num_cars; ++car) {
+        fleet.add_car(vec3(car * 10.0f, 2.0f, 0));
+      }
+      // the hinges pull the parts of each car together with a jolt, so let them settle
+      for (int i = 0; i != 300; ++i) {
+        fleet.apply_controls();
+        sync.begin_step();
+        physics.world.stepSimulation(1.0f / 60, 0);
+      }
+
+      // only the cars whose inputs changed are touched
+      fleet.apply_controls();
+      expect(fleet.get_num_woken() == 0, "%d cars woken with no new inputs", fleet.get_num_woken());
+      fleet.set_controls(0, 10, 0);
+      fleet.set_controls(1, 0, 0.3f);
+      fleet.set_controls(2, 0, 0);
+      fleet.apply_controls();
+      expect(fleet.get_num_woken() == 2, "%d cars woken when two changed their inputs", fleet.get_num_woken());
+      fleet.set_controls(0, 10, 0);
+      fleet.apply_controls();
+      expect(fleet.get_num_woken() == 0, "%d cars woken by inputs set to what they were", fleet.get_num_woken());
+      expect(fleet.get_motor_velocity(0) == 10 && fleet.get_steer_angle(1) == 0.3f, "the fleet lost the requested inputs");
+
+      // the driven car moves, a parked car out of its way only creeps
+      btVector3 start0 = fleet.get_chassis(0)->getWorldTransform().getOrigin();
+      btVector3 start5 = fleet.get_chassis(5)->getWorldTransform().getOrigin();
+      for (int i = 0; i != 120; ++i) {
+        fleet.apply_controls();
+        sync.begin_step();
+        physics.world.stepSimulation(1.0f / 60, 0);
+      }
+      float driven = distance_from(fleet, 0, start0), parked = distance_from(fleet, 5, start5);
+      expect(driven > 2, "the driven car moved %.2f in two seconds", driven);
+      expect(driven > parked * 4, "the driven car moved %.2f, not much more than a parked car (%.2f)", driven, parked);
+
+      fleet.destroy();
+
+      char summary[100];
+      sprintf(summary, "%d cars: only changed inputs wake a car, driven %.1f, parked %.2f", num_cars, driven, parked);
+      end(failures, summary);
+    }
+
+    void check_vehicle_lod() {
+      begin("vehicle_lod");
+      unsigned failures = num_failures;
+      physics_world physics;
+      motion_state_sync sync;
+      ref<visual_scene> scene = new visual_scene();
+      vehicle_fleet fleet;
+      fleet.init(scene, &physics.world, &sync);
+      fleet.set_lod_distances(40, 60);
+      static const float x[] = { 0, 50, 100 };
+      for (int car = 0; car != 3; ++car) {
+        fleet.add_car(vec3(x[car], 2.0f, 0));
+      }
+      for (int i = 0; i != 60; ++i) {
+        sync.begin_step();
+        physics.world.stepSimulation(1.0f / 60, 0);
+      }
+
+      // far cars swap to the raycast model, cars in the gap between near and far keep theirs
+      btVector3 before = fleet.get_chassis(2)->getWorldTransform().getOrigin();
+      fleet.update_lod(vec3(0, 2, 0));
+      expect(fleet.get_num_lod_swaps() == 1 && fleet.is_raycast(2) && !fleet.is_raycast(1), "from x = 0, %d swaps and the cars at 50 and 100 are %s and %s",
+        fleet.get_num_lod_swaps(), fleet.is_raycast(1) ? "raycast" : "hinges", fleet.is_raycast(2) ? "raycast" : "hinges"
+      );
+      expect(distance_from(fleet, 2, before) < 1e-4f, "the chassis moved when the car swapped model");
+      fleet.update_lod(vec3(0, 2, 0));
+      expect(fleet.get_num_lod_swaps() == 0, "%d swaps with nothing moved", fleet.get_num_lod_swaps());
+      fleet.update_lod(vec3(45, 2, 0));
+      expect(fleet.get_num_lod_swaps() == 0 && fleet.get_num_raycast_cars() == 1, "a car in the gap swapped model");
+      fleet.update_lod(vec3(100, 2, 0));
+      expect(fleet.get_num_lod_swaps() == 2 && fleet.is_raycast(0) && !fleet.is_raycast(2), "from x = 100, %d swaps", fleet.get_num_lod_swaps());
+
+      // a raycast car drives on its rays and its wheels are drawn next to it
+      btVector3 start = fleet.get_chassis(0)->getWorldTransform().getOrigin();
+      fleet.set_controls(0, 10, 0);
+      fleet.apply_controls();
+      for (int i = 0; i != 120; ++i) {
+        sync.begin_step();
+        physics.world.stepSimulation(1.0f / 60, 0);
+      }
+      sync.update_nodes(1.0f);
+      fleet.update_nodes();
+      btVector3 pos = fleet.get_chassis(0)->getWorldTransform().getOrigin();
+      float driven = (float)pos.distance(start);
+      expect(driven > 2 && pos.y() > 0.3f, "the raycast car moved %.2f and is at height %.2f", driven, (float)pos.y());
+
+      // the first car's chassis, wheels and axils are the first nine instances
+      vec3 chassis_pos = fleet.get_chassis_node(0)->get_nodeToParent().w().xyz();
+      unsigned num_far_wheels = 0;
+      for (int i = 1; i != 9; ++i) {
+        scene_node *node = scene->get_mesh_instance(i)->get_node();
+        num_far_wheels += length(node->get_nodeToParent().w().xyz() - chassis_pos) > 4;
+      }
+      expect(num_far_wheels == 0, "%u wheels and axils of the raycast car are away from its chassis", num_far_wheels);
+
+      fleet.set_lod_distances(0, 0);
+      fleet.update_lod(vec3(100, 2, 0));
+      expect(fleet.get_num_raycast_cars() == 0, "%d cars still raycast with LOD off", fleet.get_num_raycast_cars());
+      fleet.destroy();
+
+      char summary[100];
+      sprintf(summary, "cars swap model outside 60 and back inside 40, the raycast car drove %.1f", driven);
+      end(failures, summary);
+    }
+
+  public:
+    wreck_check() {
+      num_checks = 0;
+      num_failures = 0;
+      feature = "";
+    }
+
+    ///Run every check, returns the number that failed.
+    unsigned run() {
+      check_motion_state();
+      check_vehicle_fleet();
+      check_track_format();
+      check_shape_cache();
+      check_vehicle_lod();
+      check_voice_manager();
+      check_scene_node();
+      check_frustum();
+      check_instance_tree();
+      check_mesh_bvh();
+      check_ray_batch();
+      check_render_queue();
+      check_gl_state();
+      check_profiler();
+      check_occlusion();
+      check_debug_draw();
+
+      printf("%u checks, %u failed\n", num_checks, num_failures);
+      return num_failures;
+    }
+  };
+}
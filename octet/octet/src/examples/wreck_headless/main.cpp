@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// Headless physics benchmark for Wreck.
+// Build with the generic platform (__GENERIC__) so that no window, GL or audio is needed.
+//
+
+#define OCTET_BULLET 1
+
+#include <algorithm>
+
+#include "../../octet.h"
+#include "../Wreck/xbox_controller.h"
+#include "../Wreck/node_motion_state.h"
+#include "../Wreck/vehicle_fleet.h"
+#include "../Wreck/vehicle.h"
+#include "../Wreck/track_format.h"
+#include "../Wreck/race_track.h"
+#include "wreck_headless.h"
+
+static const char *options[] = {
+  "usage: wreck_headless [options]",
+  "-steps <n>", "number of physics steps to run (default 2000)",
+  "-rate <hz>", "physics steps per second (default 60)",
+  "-cars <n>", "number of cars in the fleet, including the player (default 1)",
+  "-lod <distance>", "use the raycast model for cars further than this from the player (default off)",
+  "-rays <n>", "cast n sensor rays per car per step and report rays per second (default 0)",
+  "-threads <n>", "threads for the sensor rays, including the main thread (default: one per processor)",
+  "-merge-track", "bake the static track into a single compound body",
+  "-profile", "print bullet's profile tree and octet's profile summary after the run",
+  "-occlusion", "compare occlusion culling of the track with the one pixel at a time reference after the run",
+  "-debug-draw", "time drawing the bullet world with batched debug lines after the run",
+  "-hud", "print the text of the on-screen performance HUD after the run",
+  "-trace <file>", "write a Chrome trace_event file of loading and the run (open in chrome://tracing)",
+  "-prefix <dir>", "directory containing assets/ and shaders/ (default: search for README.txt)",
+  "-help", "show this message",
+  0
+};
+
+/// Step the Wreck world for a number of ticks and report the cost.
+int main(int argc, char **argv) {
+  octet::platform::args_parser args(argc, argv, options);
+  if (args.get_error() || *args["-help"]) {
+    if (args.get_error()) printf("%s: %s\n", args.get_error(), args.get_error_arg());
+    args.usage();
+    return 1;
+  }
+
+  int steps = *args["-steps"] ? atoi(args["-steps"]) : 2000;
+  float rate = *args["-rate"] ? (float)atof(args["-rate"]) : 60.0f;
+
+  if (*args["-prefix"]) {
+    octet::app_utils::prefix(args["-prefix"]);
+  }
+
+  // set up the platform.
+  octet::app::init_all(argc, argv);
+  // our application.
+  octet::wreck_headless app(argc, argv);
+  app.set_steps(steps, rate);
+  app.set_num_cars(*args["-cars"] ? atoi(args["-cars"]) : 1);
+  app.set_lod_distance(*args["-lod"] ? (float)atof(args["-lod"]) : 0.0f);
+  app.set_rays(*args["-rays"] ? atoi(args["-rays"]) : 0, *args["-threads"] ? atoi(args["-threads"]) : 0);
+  app.set_merge_track(*args["-merge-track"] != 0);
+  app.set_profile(*args["-profile"] != 0);
+  app.set_hud(*args["-hud"] != 0);
+  app.set_check_occlusion(*args["-occlusion"] != 0);
+  app.set_debug_draw(*args["-debug-draw"] != 0);
+  if (*args["-trace"]) {
+    octet::platform::profiler::begin_capture();
+  }
+  app.init();
+  app.run();
+  if (*args["-trace"]) {
+    if (octet::platform::profiler::write_trace(args["-trace"])) {
+      printf("trace written to %s\n", args["-trace"]);
+    } else {
+      printf("could not write %s\n", args["-trace"]);
+    }
+  }
+}
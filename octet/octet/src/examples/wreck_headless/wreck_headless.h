@@ -0,0 +1,529 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Ryan Singh 2014
+//
+// wreck_headless.h - steps the Wreck physics world without a window, GL or audio
+//
+namespace octet {
+  ///Runs the race track and vehicle from the Wreck example for a fixed number of physics steps.
+  ///Inputs come from a script rather than the keyboard, so every run drives the car the same way.
+  ///Each call to stepSimulation is timed and a summary is printed at the end, this is used to
+  ///regression test the cost of the physics on machines without a GPU.
+  ///Extra AI cars can be added to the fleet to measure the cost per car.
+  class wreck_headless : public app {
+
+    race_track track;
+    vehicle_fleet fleet;
+    vehicle vehicle_instance;
+    voice_manager voices; // engine sounds of all the cars, played through the fake AL
+    dynarray<int> engine_emitters; // one per AI car
+
+    // the track and vehicle need a scene to add their nodes to, it is only rendered through the fake GL to count state changes.
+    ref<visual_scene> app_scene;
+    btDefaultCollisionConfiguration config; /// setup for the world
+    btCollisionDispatcher *dispatcher; /// handler for collisions between objects
+    btDbvtBroadphase *broadphase; /// handler for broadphase (rough) collision
+    btSequentialImpulseConstraintSolver *solver; /// handler to resolve collisions
+    btDiscreteDynamicsWorld *world; /// physics world, contains rigid bodies
+    motion_state_sync motion_sync; /// moving bodies and their scene nodes
+
+    int num_steps; // number of physics ticks to run
+    float physics_step; // seconds per physics tick
+    int num_cars; // total number of cars, including the player
+    bool profile; // dump the bullet profile at the end
+    bool show_hud; // print the perf_hud text at the end
+    bool check_occlusion; // compare occlusion culling with the reference at the end
+    bool measure_debug_draw; // time drawing the bullet world with debug lines at the end
+    float lod_distance; // cars further than this from the player use the raycast model, 0 for off
+    dynarray<float> step_ms; // time taken by each tick
+    int rays_per_car; // AI sensor rays cast by each car every tick, 0 for none
+    thread_pool pool; // threads for the sensor rays
+    int num_threads; // 0 for one per processor
+    dynarray<visual_scene::ray_query> ray_queries;
+    dynarray<visual_scene::ray_hit> ray_hits; // cast by the pool
+    dynarray<visual_scene::ray_hit> serial_hits; // the same rays cast on one thread
+    btRigidBody *ground; // catches fleet cars that miss the track
+
+    // no window, no mouse
+    void move_camera(int /*x*/, int /*y*/, HWND * /*w*/) {
+    }
+
+    ///scripted driving: accelerate, steer left, steer right, brake and coast in a 10 second loop.
+    void script_inputs(int step) {
+      int t = step % 600;
+      set_key('W', t < 360);
+      set_key('A', t >= 120 && t < 240);
+      set_key('D', t >= 240 && t < 360);
+      set_key('S', t >= 360 && t < 480);
+    }
+
+    ///the AI cars run the same loop as the player, each a little out of phase
+    ///so that their inputs change on different ticks.
+    void script_fleet(int step) {
+      const float step_angle = 1.5f * 3.14159265f / 180.0f;
+      for (int car = 1; car < num_cars; ++car) {
+        int t = (step + car * 37) % 600;
+        float velocity = t < 360 ? min(t * 0.4f, 20.0f) : t < 480 ? -min((t - 360) * 0.4f, 20.0f) : 0.0f;
+        float angle = t >= 120 && t < 240 ? -min((t - 119) * step_angle, 10 * step_angle) :
+                      t >= 240 && t < 360 ? min((t - 239) * step_angle, 10 * step_angle) : 0.0f;
+        fleet.set_controls(car, velocity, angle);
+      }
+    }
+
+    ///static plane under the track so that cars that fall off keep being simulated.
+    void add_ground() {
+      btCollisionShape *shape = new btStaticPlaneShape(btVector3(0, 1, 0), -10.0f);
+      btDefaultMotionState *motionState = new btDefaultMotionState();
+      ground = new btRigidBody(0.0f, motionState, shape, btVector3(0, 0, 0));
+      ground->setFriction(10);
+      world->addRigidBody(ground);
+    }
+
+    ///the AI engines are loud near the player and fade out by 100m, the voice manager picks the loudest.
+    void update_audio(int step, const btVector3 &player) {
+      vehicle_instance.sound_control();
+      for (int car = 1; car < num_cars; ++car) {
+        int emitter = engine_emitters[car - 1];
+        float distance = fleet.get_chassis(car)->getWorldTransform().getOrigin().distance(player);
+        voices.set_gain(emitter, max(0.0f, 1.0f - distance * 0.01f));
+        voices.set_playing(emitter, (step + car * 37) % 600 < 480);
+      }
+      voices.update();
+    }
+
+    ///one ground probe and a fan of whiskers across the front of each car, in the car's frame.
+    void make_sensor_rays() {
+      ray_queries.resize(0);
+      for (int car = 0; car < num_cars; ++car) {
+        const btTransform &transform = fleet.get_chassis(car)->getWorldTransform();
+        btVector3 origin = transform.getOrigin() + transform.getBasis() * btVector3(0, 1, 0);
+        for (int i = 0; i != rays_per_car; ++i) {
+          btVector3 dir(0, -1, 0);
+          float max_distance = 5;
+          if (i != 0) {
+            float angle = rays_per_car > 2 ? ((i - 1.0f) / (rays_per_car - 2) - 0.5f) * 2.0f : 0.0f;
+            dir = btVector3(sinf(angle), -0.05f, cosf(angle)).normalized();
+            max_distance = 30;
+          }
+          dir = transform.getBasis() * dir;
+          visual_scene::ray_query q;
+          q.origin = vec3(origin.x(), origin.y(), origin.z());
+          q.direction = vec3(dir.x(), dir.y(), dir.z());
+          q.max_distance = max_distance;
+          q.ignore = fleet.get_chassis_node(car);
+          ray_queries.push_back(q);
+        }
+      }
+      ray_hits.resize(ray_queries.size());
+      serial_hits.resize(ray_queries.size());
+    }
+
+    static float percentile(const dynarray<float> &sorted, float p) {
+      if (sorted.size() == 0) return 0;
+      unsigned index = (unsigned)(p * (sorted.size() - 1) + 0.5f);
+      return sorted[index];
+    }
+
+  public:
+    /// this is called when we construct the class before everything is initialised.
+    wreck_headless(int argc, char **argv) : app(argc, argv) {
+      dispatcher = new btCollisionDispatcher(&config);
+      broadphase = new btDbvtBroadphase();
+      solver = new btSequentialImpulseConstraintSolver();
+      world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, &config);
+      num_steps = 2000;
+      physics_step = 1.0f / 60;
+      num_cars = 1;
+      profile = false;
+      show_hud = false;
+      check_occlusion = false;
+      measure_debug_draw = false;
+      lod_distance = 0;
+      ground = 0;
+      rays_per_car = 0;
+      num_threads = 0;
+    }
+
+    ~wreck_headless() {
+      fleet.destroy();
+      track.destroy();
+      if (ground) {
+        world->removeRigidBody(ground);
+        delete ground->getCollisionShape();
+        delete ground->getMotionState();
+        delete ground;
+      }
+      delete world;
+      delete solver;
+      delete broadphase;
+      delete dispatcher;
+    }
+
+    /// set the number of ticks and the tick rate, call before init()
+    void set_steps(int steps, float ticks_per_second) {
+      num_steps = steps;
+      physics_step = 1.0f / ticks_per_second;
+    }
+
+    /// set the number of cars (including the player), call before init()
+    void set_num_cars(int cars) {
+      num_cars = cars < 1 ? 1 : cars;
+    }
+
+    /// bake the track into one compound body, call before init()
+    void set_merge_track(bool value) {
+      track.set_merge_static(value);
+    }
+
+    /// swap cars further than distance from the player to the raycast model, call before init()
+    void set_lod_distance(float distance) {
+      lod_distance = distance;
+    }
+
+    /// cast this many sensor rays per car per tick and time them, call before init()
+    void set_rays(int rays, int threads) {
+      rays_per_car = rays < 0 ? 0 : rays;
+      num_threads = threads;
+    }
+
+    /// print bullet's own profile tree and octet's profile summary after the run
+    void set_profile(bool value) {
+      profile = value;
+    }
+
+    /// print the text of the on-screen performance HUD after the run
+    void set_hud(bool value) {
+      show_hud = value;
+    }
+
+    /// compare occlusion culling with the one pixel at a time reference after the run
+    void set_check_occlusion(bool value) {
+      check_occlusion = value;
+    }
+
+    /// time drawing the shapes, contacts and constraints of the world with debug lines after the run
+    void set_debug_draw(bool value) {
+      measure_debug_draw = value;
+    }
+
+    /// build the same world as wreck_game
+    void app_init() {
+      world->setGravity(btVector3(0.0f, -15.0f, 0.0f));
+
+      app_scene = new visual_scene();
+      app_scene->create_default_camera_and_lights();
+
+      track.init(this, *&app_scene, *&world);
+      fleet.init(app_scene, world, &motion_sync);
+      voices.init(8);
+      vehicle_instance.init(this, &fleet, &voices);
+      fleet.set_lod_distances(lod_distance * 0.8f, lod_distance);
+      if (rays_per_car) pool.init(num_threads);
+
+      if (num_cars > 1) {
+        add_ground();
+
+        //spawn the AI cars on a grid around the start of the track
+        int columns = (int)ceilf(sqrtf((float)num_cars));
+        for (int car = 1; car != num_cars; ++car) {
+          int col = car % columns, row = car / columns;
+          float x = (col - columns * 0.5f) * 10.0f;
+          float z = (row - columns * 0.5f) * 7.0f;
+          fleet.add_car(vec3(x, 5.0f, z));
+          ALuint engine = resource_dict::get_sound_handle(AL_FORMAT_MONO16, "assets/engine_loop.wav");
+          engine_emitters.push_back(voices.add_emitter(engine, 1.0f, true));
+        }
+      }
+    }
+
+    /// nothing is drawn
+    void draw_world(int /*x*/, int /*y*/, int /*w*/, int /*h*/) {
+    }
+
+    /// look from behind each car as the game's camera does and compare the instances that the track
+    /// hides in the occlusion buffer, in the scene and in the reference.
+    void compare_occlusion() {
+      if (!rays_per_car) pool.init(num_threads);
+      camera_instance *cam = app_scene->get_camera_instance(0);
+      cam->set_near_plane(1);
+      cam->set_far_plane(2000);
+      const float aspect_ratio = 16.0f / 9;
+
+      occlusion_buffer fast, reference;
+      dynarray<uint8_t> hidden;
+      unsigned num_views = fleet.get_num_cars();
+      unsigned num_occluders = 0, num_triangles = 0, num_tested = 0, num_hidden = 0;
+      unsigned num_mismatches = 0, num_scene_mismatches = 0;
+      float fast_ms = 0, reference_ms = 0;
+      btClock clock;
+      for (unsigned view = 0; view != num_views; ++view) {
+        mat4t cameraToChassis;
+        cameraToChassis.loadIdentity();
+        cameraToChassis.translate(-30, 14, 0);
+        cameraToChassis.rotateY(270.0f);
+        cameraToChassis.rotateX(-20);
+        mat4t cameraToWorld = cameraToChassis * fleet.get_chassis_node(view)->get_nodeToParent();
+        mat4t worldToCamera;
+        cameraToWorld.invertQuick(worldToCamera);
+        cam->set_cameraToWorld(cameraToWorld, aspect_ratio);
+        mat4t worldToProjection = worldToCamera * cam->get_cameraToProjection();
+        frustum view_frustum(worldToProjection);
+
+        int num_instances = app_scene->get_num_mesh_instances();
+        hidden.resize(num_instances);
+        for (unsigned pass = 0; pass != 2; ++pass) {
+          occlusion_buffer &buffer = pass == 0 ? fast : reference;
+          clock.reset();
+          buffer.begin(worldToProjection);
+          for (int i = 0; i != num_instances; ++i) {
+            mesh_instance *mi = app_scene->get_mesh_instance(i);
+            if (mi->get_flags() & mesh_instance::flag_occluder) {
+              buffer.add_occluder(mi->get_mesh(), mi->get_node()->get_nodeToWorld());
+            }
+          }
+          if (pass == 0) buffer.rasterize(&pool); else buffer.rasterize_reference();
+          for (int i = 0; i != num_instances; ++i) {
+            mesh_instance *mi = app_scene->get_mesh_instance(i);
+            aabb bb = mi->get_mesh()->get_aabb().get_transform(mi->get_node()->get_nodeToWorld());
+            if ((mi->get_flags() & mesh_instance::flag_occluder) || !view_frustum.intersects(bb)) continue;
+            if (pass == 0) {
+              hidden[i] = buffer.is_occluded(bb);
+            } else {
+              num_mismatches += hidden[i] != buffer.is_occluded_reference(bb);
+            }
+          }
+          (pass == 0 ? fast_ms : reference_ms) += clock.getTimeMicroseconds() * 0.001f;
+        }
+        num_occluders += fast.get_stats().occluders;
+        num_triangles += fast.get_stats().triangles;
+        num_tested += fast.get_stats().tests;
+        num_hidden += fast.get_stats().occluded;
+
+        // the scene should hide the same instances.
+        cam->get_node()->set_nodeToParent(cameraToWorld);
+        app_scene->set_occlusion_culling(true, &pool);
+        app_scene->render(aspect_ratio);
+        num_scene_mismatches += app_scene->get_num_occluded_instances() != (int)fast.get_stats().occluded;
+      }
+      app_scene->set_occlusion_culling(false);
+
+      printf("occlusion       %u views, %u occluders and %u triangles per view, %u of %u instances hidden, %u mismatches against the reference, %u views disagree with the scene\n",
+        num_views, num_occluders / num_views, num_triangles / num_views, num_hidden, num_tested, num_mismatches, num_scene_mismatches
+      );
+      printf("occlusion time  %.3f ms/view on %u threads, %.3f ms/view reference\n", fast_ms / num_views, pool.get_num_threads(), reference_ms / num_views);
+    }
+
+    /// draw the world through the scene's btIDebugDraw as wreck_game does when B is pressed.
+    void time_debug_draw() {
+      debug_draw *debug = app_scene->get_debug_draw();
+      debug->set_viewport(1280, 720);
+      world->setDebugDrawer(debug);
+
+      // a frame without the lines, drawn the same way, to count the draw calls the lines add.
+      app_scene->render(16.0f / 9);
+      gl_state::end_frame();
+      render_stats plain = app_scene->get_render_stats();
+      app_scene->set_render_debug_lines(true);
+
+      const int num_frames = 10;
+      float gather_ms = 0, render_ms = 0;
+      unsigned num_lines = 0;
+      btClock clock;
+      for (int frame = 0; frame != num_frames; ++frame) {
+        clock.reset();
+        world->debugDrawWorld();
+        for (int i = 0; i != fleet.get_num_cars(); ++i) {
+          debug->add_text(fleet.get_chassis_node(i)->get_nodeToWorld().w().xyz(), "car");
+        }
+        gather_ms += clock.getTimeMicroseconds() * 0.001f;
+        num_lines = debug->get_num_lines();
+
+        clock.reset();
+        app_scene->render(16.0f / 9);
+        gl_state::end_frame();
+        render_ms += clock.getTimeMicroseconds() * 0.001f;
+      }
+      const render_stats &stats = app_scene->get_render_stats();
+
+      int num_contacts = 0;
+      for (int i = 0; i != world->getDispatcher()->getNumManifolds(); ++i) {
+        num_contacts += world->getDispatcher()->getManifoldByIndexInternal(i)->getNumContacts();
+      }
+
+      printf("debug draw      %u lines for %d bodies and %d contacts, %u labels, %u more draw calls, %.3f ms/frame debugDrawWorld, %.3f ms/frame render\n",
+        num_lines, world->getNumCollisionObjects(), num_contacts, fleet.get_num_cars(), stats.draw_calls - plain.draw_calls, gather_ms / num_frames, render_ms / num_frames
+      );
+
+      world->setDebugDrawer(NULL);
+      app_scene->set_render_debug_lines(false);
+    }
+
+    /// step the world num_steps times and print the timings.
+    void run() {
+      step_ms.reserve(num_steps);
+      allocator::reset_peak_bytes();
+      size_t start_bytes = allocator::get_num_bytes();
+
+      btClock clock;
+      float controls_ms = 0;
+      int num_woken = 0;
+      int num_raycast = 0;
+      int num_swaps = 0;
+      float audio_ms = 0;
+      unsigned num_al_calls = 0;
+      unsigned num_virtual = 0;
+      float rays_ms = 0, serial_rays_ms = 0;
+      unsigned num_rays = 0, num_ray_hits = 0, num_ray_mismatches = 0;
+      CProfileManager::Reset();
+      for (int i = 0; i != num_steps; ++i) {
+        // each tick is a frame for the profiler's summary.
+        profiler::end_frame();
+        OCTET_PROFILE("tick");
+        clock.reset();
+        btVector3 player;
+        {
+          OCTET_PROFILE("input");
+          script_inputs(i);
+          script_fleet(i);
+          vehicle_instance.update_controls();
+          player = fleet.get_chassis(0)->getWorldTransform().getOrigin();
+          fleet.update_lod(vec3(player.x(), player.y(), player.z()));
+          fleet.apply_controls();
+        }
+        num_raycast += fleet.get_num_raycast_cars();
+        num_swaps += fleet.get_num_lod_swaps();
+        num_woken += fleet.get_num_woken();
+        controls_ms += clock.getTimeMicroseconds() * 0.001f;
+
+        clock.reset();
+        {
+          OCTET_PROFILE("audio");
+          update_audio(i, player);
+        }
+        audio_ms += clock.getTimeMicroseconds() * 0.001f;
+        voice_manager::stats audio = voices.get_stats();
+        num_al_calls += audio.al_calls;
+        num_virtual += audio.num_virtual;
+
+        motion_sync.begin_step();
+        clock.reset();
+        {
+          OCTET_PROFILE("stepSimulation");
+          world->stepSimulation(physics_step, 0);
+        }
+        step_ms.push_back(clock.getTimeMicroseconds() * 0.001f);
+        CProfileManager::Increment_Frame_Counter();
+
+        if (rays_per_car) {
+          OCTET_PROFILE("sensor rays");
+          // the sensors see the scene nodes, so bring them up to date first
+          motion_sync.update_nodes(1.0f);
+          fleet.update_nodes();
+          make_sensor_rays();
+          // refit the scene's query tree outside the timing, every query pays for it once per frame
+          app_scene->update_instance_tree();
+          unsigned n = ray_queries.size();
+          clock.reset();
+          app_scene->cast_rays(ray_hits.data(), ray_queries.data(), n, &pool);
+          rays_ms += clock.getTimeMicroseconds() * 0.001f;
+          clock.reset();
+          app_scene->cast_rays(serial_hits.data(), ray_queries.data(), n);
+          serial_rays_ms += clock.getTimeMicroseconds() * 0.001f;
+          for (unsigned r = 0; r != n; ++r) {
+            num_ray_hits += ray_hits[r].mi != NULL;
+            num_ray_mismatches += ray_hits[r].mi != serial_hits[r].mi || ray_hits[r].distance != serial_hits[r].distance;
+          }
+          num_rays += n;
+        }
+      }
+      profiler::end_frame();
+
+      float total_ms = 0;
+      for (unsigned i = 0; i != step_ms.size(); ++i) {
+        total_ms += step_ms[i];
+      }
+      std::sort(step_ms.data(), step_ms.data() + step_ms.size());
+
+      printf("\n");
+      printf("cars            %d%s\n", fleet.get_num_cars(), ground ? " (with ground plane)" : "");
+      printf("bodies          %d\n", world->getNumCollisionObjects());
+      printf("merged pieces   %d\n", track.get_num_merged_pieces());
+      printf("constraints     %d\n", world->getNumConstraints());
+      printf("steps           %d at %.1fHz\n", num_steps, 1.0f / physics_step);
+      printf("total           %.3f ms\n", total_ms);
+      printf("ms/step         %.4f\n", num_steps ? total_ms / num_steps : 0.0f);
+      printf("p50             %.4f ms\n", percentile(step_ms, 0.50f));
+      printf("p99             %.4f ms\n", percentile(step_ms, 0.99f));
+      printf("steps/sec       %.1f\n", total_ms > 0 ? num_steps * 1000.0f / total_ms : 0.0f);
+      printf("us/step/car     %.3f\n", num_steps ? total_ms * 1000.0f / num_steps / fleet.get_num_cars() : 0.0f);
+      printf("controls        %.4f ms/step, %.2f cars woken/step\n", num_steps ? controls_ms / num_steps : 0.0f, num_steps ? (float)num_woken / num_steps : 0.0f);
+      if (lod_distance > 0) {
+        printf("lod             %.2f raycast cars/step, %d swaps\n", num_steps ? (float)num_raycast / num_steps : 0.0f, num_swaps);
+      }
+      voice_manager::stats audio = voices.get_stats();
+      printf("audio           %.4f ms/step, %.2f AL calls/step, %u voices, %.1f virtual/step, %u steals\n", num_steps ? audio_ms / num_steps : 0.0f, num_steps ? (float)num_al_calls / num_steps : 0.0f, audio.num_voices, num_steps ? (float)num_virtual / num_steps : 0.0f, audio.num_steals);
+      if (rays_per_car) {
+        printf("rays            %u/step, %.1f%% hit, %.0f rays/sec on %u threads, %.0f rays/sec on 1, %u mismatches\n",
+          num_steps ? num_rays / num_steps : 0, num_rays ? num_ray_hits * 100.0f / num_rays : 0.0f,
+          rays_ms > 0 ? num_rays * 1000.0f / rays_ms : 0.0f, pool.get_num_threads(),
+          serial_rays_ms > 0 ? num_rays * 1000.0f / serial_rays_ms : 0.0f, num_ray_mismatches
+        );
+      }
+      printf("allocator bytes %u at start, %u peak while stepping\n", (unsigned)start_bytes, (unsigned)allocator::get_peak_bytes());
+      resource_dict::cache_stats &cache = resource_dict::get_cache_stats();
+      printf("image cache     %u hits, %u misses\n", cache.image_hits, cache.image_misses);
+      const bullet_shape_cache::stats &shapes = bullet_shape_cache::get_stats();
+      printf("shape cache     %u hits, %u misses, %u live shapes\n", shapes.hits, shapes.misses, shapes.live_shapes);
+
+      // one frame of the final scene in scene order and one sorted by state.
+      // a first frame fills the uniform and binding caches, so both measured frames start warm.
+      motion_sync.update_nodes(1.0f);
+      fleet.update_nodes();
+      app_scene->set_frustum_culling(false);
+      app_scene->set_sort_draws(false);
+      app_scene->render(1.0f);
+      gl_state::end_frame();
+      app_scene->render(1.0f);
+      render_stats unsorted = app_scene->get_render_stats();
+      gl_state::stats unsorted_calls = gl_state::get_stats();
+      gl_state::end_frame();
+      app_scene->set_sort_draws(true);
+      app_scene->render(1.0f);
+      const render_stats &sorted = app_scene->get_render_stats();
+      gl_state::end_frame();
+      const gl_state::stats &calls = gl_state::get_frame_stats();
+      printf("draws           %u calls for %u objects, %u triangles, %u material binds, %u state changes sorted, %u material binds, %u state changes in scene order\n",
+        sorted.draw_calls, sorted.instances, sorted.triangles, sorted.material_binds, sorted.get_state_changes(), unsorted.material_binds, unsorted.get_state_changes()
+      );
+      printf("uniforms        %u uploads sorted, %u in scene order\n", sorted.uniform_uploads, unsorted.uniform_uploads);
+      printf("gl state        %u calls issued, %u elided sorted, %u issued, %u elided in scene order (programs %u/%u, buffers %u/%u, textures %u/%u, vertex arrays %u/%u sorted)\n",
+        calls.get_issued(), calls.get_elided(), unsorted_calls.get_issued(), unsorted_calls.get_elided(),
+        calls.issued[gl_state::kind_program], calls.elided[gl_state::kind_program],
+        calls.issued[gl_state::kind_buffer], calls.elided[gl_state::kind_buffer],
+        calls.issued[gl_state::kind_texture], calls.elided[gl_state::kind_texture],
+        calls.issued[gl_state::kind_vertex_array], calls.elided[gl_state::kind_vertex_array]
+      );
+
+      if (profile) {
+        CProfileManager::dumpAll();
+        printf("octet profile, last %d ticks:\n", (int)profiler::summary_frames);
+        profiler::dump_summary(stdout);
+      }
+
+      if (check_occlusion) {
+        compare_occlusion();
+      }
+
+      if (measure_debug_draw) {
+        time_debug_draw();
+      }
+
+      if (show_hud) {
+        ref<perf_hud> hud = new perf_hud();
+        hud->set_scene(app_scene);
+        hud->set_world(world);
+        printf("perf hud:\n%s", hud->get_text());
+      }
+    }
+  };
+}
@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// On-screen performance counters
+//
+
+namespace octet { namespace helpers {
+  /// Live performance counters drawn over the scene with a text_overlay.
+  ///
+  /// Shows the frame time with a graph of recent frames, the profiler's CPU blocks, the GPU time of
+  /// passes between begin_gpu_pass() and end_gpu_pass(), the draw calls, triangles and state changes
+  /// of a visual_scene, gl_state calls, live allocator bytes and the bodies and pairs of a bullet world.
+  ///
+  /// Call render() once a frame after drawing the scene. Nothing is timed or drawn while the HUD is hidden.
+  class perf_hud : public resource {
+    struct gpu_pass {
+      const char *name;
+      ref<gpu_timer> timer;
+    };
+
+    enum {
+      graph_columns = 48,
+      graph_rows = 4,
+      width = 480, // pixels, 60 characters of the default font
+      margin = 8
+    };
+
+    ref<text_overlay> overlay;
+    ref<mesh_text> text;
+    ref<visual_scene> scene;
+    #ifdef OCTET_BULLET
+      btCollisionWorld *world;
+    #endif
+    dynarray<gpu_pass> passes;
+    gpu_timer *current_pass;
+    string buffer;
+    bool visible;
+
+    // the frame time graph, newest frame on the right.
+    void add_graph() {
+      float max_ms = 0;
+      for (unsigned i = 0; i != graph_columns; ++i) {
+        max_ms = max(max_ms, profiler::get_frame_ms(i));
+      }
+
+      // the top of the graph is 60Hz, 30Hz, 15Hz...
+      float scale = 1000.0f / 60;
+      while (scale < max_ms && scale < 1000.0f) scale *= 2;
+
+      char line[graph_columns + 1];
+      for (unsigned row = 0; row != graph_rows; ++row) {
+        float low = scale * (graph_rows - 1 - row) / graph_rows;
+        for (unsigned col = 0; col != graph_columns; ++col) {
+          float ms = profiler::get_frame_ms(graph_columns - 1 - col);
+          line[col] = ms > low ? '#' : '.';
+        }
+        line[graph_columns] = 0;
+        buffer.printf("%5.1f %s\n", scale * (graph_rows - row) / graph_rows, line);
+      }
+    }
+
+    void add_cpu_blocks() {
+      const dynarray<profiler::summary_entry> &summary = profiler::get_summary();
+      for (unsigned i = 0; i != summary.size(); ++i) {
+        const profiler::summary_entry &e = summary[i];
+        unsigned indent = min(e.depth * 2, 16u);
+        buffer.printf("%*s%-*.*s %6.2fms %6.2fms\n", indent, "", 28 - indent, 28 - indent, e.name, e.avg_ms, e.max_ms);
+      }
+    }
+
+    void add_gpu_passes() {
+      if (!gpu_timer::has_timer_queries()) {
+        buffer.printf("gpu timer queries not available\n");
+        return;
+      }
+      for (unsigned i = 0; i != passes.size(); ++i) {
+        gpu_timer *timer = passes[i].timer;
+        if (timer->is_valid()) {
+          buffer.printf("gpu %-20s %6.2fms\n", passes[i].name, timer->get_ms());
+        } else {
+          buffer.printf("gpu %-20s --\n", passes[i].name);
+        }
+      }
+    }
+
+    void add_counters() {
+      if (scene) {
+        const render_stats &stats = scene->get_render_stats();
+        buffer.printf("draws %u for %u objects, %u triangles\n", stats.draw_calls, stats.instances, stats.triangles);
+        if (scene->get_occlusion_culling()) {
+          buffer.printf("occlusion %d objects hidden, %u occluder triangles\n", scene->get_num_occluded_instances(), scene->get_occlusion_buffer().get_stats().triangles);
+        }
+        buffer.printf("state changes %u, %u uniform uploads\n", stats.get_state_changes(), stats.uniform_uploads);
+        buffer.printf("binds: program %u material %u texture %u mesh %u\n", stats.program_binds, stats.material_binds, stats.texture_binds, stats.mesh_binds);
+      }
+
+      const gl_state::stats &calls = gl_state::get_frame_stats();
+      buffer.printf("gl calls %u issued, %u elided\n", calls.get_issued(), calls.get_elided());
+      buffer.printf("allocator %u bytes live, %u peak\n", (unsigned)allocator::get_num_bytes(), (unsigned)allocator::get_peak_bytes());
+
+      #ifdef OCTET_BULLET
+        if (world) {
+          buffer.printf("bullet %d bodies, %d pairs, %d manifolds\n",
+            world->getNumCollisionObjects(),
+            world->getPairCache()->getNumOverlappingPairs(),
+            world->getDispatcher()->getNumManifolds()
+          );
+        }
+      #endif
+    }
+
+  public:
+    perf_hud() {
+      #ifdef OCTET_BULLET
+        world = NULL;
+      #endif
+      current_pass = NULL;
+      visible = false;
+    }
+
+    /// Show the counters of this scene.
+    void set_scene(visual_scene *value) {
+      scene = value;
+    }
+
+    #ifdef OCTET_BULLET
+      /// Show the number of bodies and pairs in this world.
+      void set_world(btCollisionWorld *value) {
+        world = value;
+      }
+    #endif
+
+    bool is_visible() const {
+      return visible;
+    }
+
+    void set_visible(bool value) {
+      visible = value;
+    }
+
+    void toggle() {
+      visible = !visible;
+    }
+
+    /// Start timing a pass on the GPU. name must be a string literal. Passes must not overlap.
+    void begin_gpu_pass(const char *name) {
+      if (!visible || current_pass) return;
+      for (unsigned i = 0; i != passes.size(); ++i) {
+        if (passes[i].name == name) {
+          current_pass = passes[i].timer;
+          break;
+        }
+      }
+      if (!current_pass) {
+        gpu_pass pass;
+        pass.name = name;
+        pass.timer = new gpu_timer();
+        passes.push_back(pass);
+        current_pass = pass.timer;
+      }
+      current_pass->begin();
+    }
+
+    /// Stop timing the pass started by begin_gpu_pass().
+    void end_gpu_pass() {
+      if (!current_pass) return;
+      current_pass->end();
+      current_pass = NULL;
+    }
+
+    /// The text of the HUD, as drawn by render().
+    const char *get_text() {
+      float sum_ms = 0, max_ms = 0;
+      unsigned num_frames = 0;
+      for (unsigned i = 0; i != profiler::summary_frames; ++i) {
+        float ms = profiler::get_frame_ms(i);
+        if (ms == 0) break;
+        sum_ms += ms;
+        max_ms = max(max_ms, ms);
+        num_frames++;
+      }
+      float avg_ms = num_frames ? sum_ms / num_frames : 0;
+
+      buffer = "";
+      buffer.printf("frame %.2fms avg %.2fms max %.2fms %.0ffps\n", profiler::get_frame_ms(), avg_ms, max_ms, avg_ms > 0 ? 1000.0f / avg_ms : 0.0f);
+      add_graph();
+      add_cpu_blocks();
+      add_gpu_passes();
+      add_counters();
+      return buffer.c_str();
+    }
+
+    /// Draw the HUD in the top right of a vx by vy viewport.
+    void render(int vx, int vy) {
+      if (!visible) return;
+      OCTET_PROFILE("perf_hud");
+
+      if (!overlay) {
+        overlay = new text_overlay();
+        text = new mesh_text(overlay->get_default_font(), "");
+        overlay->add_mesh_text(text);
+      }
+
+      float half_width = width * 0.5f;
+      float half_height = vy * 0.5f - margin;
+      text->set_bounds(aabb(vec3(vx * 0.5f - margin - half_width, 0, 0), vec3(half_width, half_height, 0)));
+      text->set_text(get_text());
+      text->update();
+      overlay->render(vx, vy);
+    }
+  };
+}}
@@ -0,0 +1,338 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+//
+// Persistent audio voices with virtualization
+
+namespace octet { namespace helpers {
+  /// Class for sharing a fixed number of OpenAL sources between any number of sound emitters.
+  ///
+  /// An emitter is a sound that a game object wants to make: a buffer, a gain, a priority
+  /// and whether it should be playing. Each update() gives the sources (voices) to the
+  /// loudest emitters that want to play; the rest are virtual and cost no AL calls.
+  /// An emitter keeps its voice from frame to frame, and AL is only called when
+  /// the buffer, gain, looping or play state of a voice actually changes.
+  ///
+  /// Example:
+  ///
+  ///     voice_manager voices;
+  ///     voices.init(8);
+  ///     int engine = voices.add_emitter(buffer, 10.0f, true);
+  ///     ...
+  ///     voices.set_playing(engine, speed != 0);
+  ///     voices.update();
+  class voice_manager : public resource {
+    struct emitter_t {
+      ALuint buffer;
+      float gain;
+      float priority;
+      bool looping;
+      bool playing; // the emitter wants to be heard
+      bool triggered; // restart a one shot sound at the next update
+      bool in_use; // false for removed emitters
+      int voice; // index of the voice playing this emitter, -1 if virtual
+    };
+
+    // the state we last gave to an AL source
+    struct voice_t {
+      ALuint source;
+      int emitter; // -1 if free
+      ALuint buffer;
+      float gain;
+      bool looping;
+      bool playing;
+    };
+
+    dynarray<emitter_t> emitters;
+    dynarray<voice_t> voices;
+    dynarray<int> free_emitters;
+    dynarray<int> chosen; // emitters that get a voice this update, loudest first
+
+    unsigned al_calls; // AL calls since the start of the current update
+    unsigned last_al_calls;
+    unsigned total_al_calls;
+    unsigned num_steals;
+    unsigned num_virtual;
+
+    // an incumbent keeps its voice unless a newcomer is this much louder
+    static float keep_bias() { return 1.25f; }
+
+    // smaller gain changes are not worth an AL call
+    static float gain_epsilon() { return 1.0f / 64; }
+
+    float get_audibility(const emitter_t &e) const {
+      if (!e.in_use || !(e.playing || e.triggered) || e.gain <= 0) return 0;
+      return e.gain * e.priority * (e.voice != -1 ? keep_bias() : 1.0f);
+    }
+
+    // pick the loudest emitters, at most one per voice
+    void choose_emitters() {
+      chosen.resize(0);
+      unsigned max_chosen = voices.size();
+      if (max_chosen == 0) return;
+      for (unsigned i = 0; i != emitters.size(); ++i) {
+        float a = get_audibility(emitters[i]);
+        if (a <= 0) continue;
+        if (chosen.size() == max_chosen && a <= get_audibility(emitters[chosen.back()])) continue;
+
+        // insert in order, dropping the quietest if we are full
+        if (chosen.size() < max_chosen) chosen.push_back((int)i);
+        unsigned j = chosen.size() - 1;
+        while (j != 0 && get_audibility(emitters[chosen[j-1]]) < a) {
+          chosen[j] = chosen[j-1];
+          --j;
+        }
+        chosen[j] = (int)i;
+      }
+    }
+
+    void release_voice(emitter_t &e) {
+      voice_t &v = voices[e.voice];
+      if (v.playing) {
+        alSourceStop(v.source);
+        al_calls++;
+        v.playing = false;
+      }
+      v.emitter = -1;
+      e.voice = -1;
+    }
+
+    // bring an AL source up to date with its emitter, only calling AL for changes
+    void sync_voice(voice_t &v) {
+      emitter_t &e = emitters[v.emitter];
+      bool restart = e.triggered;
+
+      if (v.buffer != e.buffer) {
+        if (v.playing) {
+          alSourceStop(v.source);
+          al_calls++;
+          v.playing = false;
+        }
+        alSourcei(v.source, AL_BUFFER, e.buffer);
+        al_calls++;
+        v.buffer = e.buffer;
+      }
+      if (v.looping != e.looping) {
+        alSourcei(v.source, AL_LOOPING, e.looping);
+        al_calls++;
+        v.looping = e.looping;
+      }
+      if (fabsf(v.gain - e.gain) > gain_epsilon() || (e.gain == 0) != (v.gain == 0)) {
+        alSourcef(v.source, AL_GAIN, e.gain);
+        al_calls++;
+        v.gain = e.gain;
+      }
+
+      // one shot sounds stop by themselves
+      if (v.playing && !v.looping && !restart) {
+        unsigned state = AL_PLAYING;
+        getSourceState(v.source, state);
+        al_calls++;
+        if (state != AL_PLAYING) {
+          v.playing = false;
+          e.playing = false;
+        }
+      }
+
+      bool want = e.playing || restart;
+      if (want && (!v.playing || restart)) {
+        alSourcePlay(v.source);
+        al_calls++;
+        v.playing = true;
+        e.playing = !e.looping ? true : e.playing;
+      } else if (!want && v.playing) {
+        alSourceStop(v.source);
+        al_calls++;
+        v.playing = false;
+      }
+      e.triggered = false;
+    }
+
+  public:
+    /// Counters for the last update().
+    struct stats {
+      unsigned al_calls; ///< AL calls made by the last update
+      unsigned total_al_calls; ///< AL calls since init
+      unsigned num_emitters; ///< emitters in use
+      unsigned num_voices; ///< AL sources owned by the manager
+      unsigned num_playing; ///< voices playing after the last update
+      unsigned num_virtual; ///< emitters that wanted to play but had no voice
+      unsigned num_steals; ///< voices taken from a quieter emitter since init
+    };
+
+    voice_manager() {
+      al_calls = last_al_calls = total_al_calls = 0;
+      num_steals = num_virtual = 0;
+    }
+
+    /// Create the AL sources. Most drivers allow 16 to 256 sources in total.
+    void init(unsigned num_voices = 8) {
+      dynarray<ALuint> sources;
+      sources.resize(num_voices);
+      alGenSources(num_voices, sources.data());
+      voices.resize(num_voices);
+      for (unsigned i = 0; i != num_voices; ++i) {
+        voice_t &v = voices[i];
+        v.source = sources[i];
+        v.emitter = -1;
+        v.buffer = 0;
+        v.gain = 1;
+        v.looping = false;
+        v.playing = false;
+      }
+      // put every source in a known state so that we never have to ask AL
+      for (unsigned i = 0; i != num_voices; ++i) {
+        alSourcei(voices[i].source, AL_LOOPING, 0);
+        alSourcef(voices[i].source, AL_GAIN, 1);
+      }
+      total_al_calls += 1 + num_voices * 2;
+    }
+
+    /// Add an emitter. Higher priorities win voices over lower ones of the same gain.
+    int add_emitter(ALuint buffer, float priority = 1.0f, bool looping = false) {
+      int index;
+      if (free_emitters.size()) {
+        index = free_emitters.back();
+        free_emitters.pop_back();
+      } else {
+        index = emitters.size();
+        emitters.resize(index + 1);
+      }
+      emitter_t &e = emitters[index];
+      e.buffer = buffer;
+      e.gain = 1;
+      e.priority = priority;
+      e.looping = looping;
+      e.playing = false;
+      e.triggered = false;
+      e.in_use = true;
+      e.voice = -1;
+      return index;
+    }
+
+    /// Remove an emitter, stopping its sound now.
+    void remove_emitter(int index) {
+      emitter_t &e = emitters[index];
+      if (e.voice != -1) {
+        // the voice must be free before add_emitter() hands this index out again.
+        al_calls = 0;
+        release_voice(e);
+        total_al_calls += al_calls;
+      }
+      e.in_use = false;
+      e.playing = false;
+      e.triggered = false;
+      free_emitters.push_back(index);
+    }
+
+    /// Start or stop a looping sound. Cheap to call every frame with the same value.
+    void set_playing(int index, bool value) {
+      emitters[index].playing = value;
+    }
+
+    /// Play a one shot sound from the start at the next update.
+    void trigger(int index) {
+      emitters[index].triggered = true;
+    }
+
+    /// Set the gain (0 to 1), louder emitters win voices.
+    void set_gain(int index, float gain) {
+      emitters[index].gain = gain;
+    }
+
+    /// Set the priority of an emitter.
+    void set_priority(int index, float priority) {
+      emitters[index].priority = priority;
+    }
+
+    /// Change the sound of an emitter.
+    void set_buffer(int index, ALuint buffer) {
+      emitters[index].buffer = buffer;
+    }
+
+    /// Is the emitter being played by a voice?
+    bool is_audible(int index) const {
+      return emitters[index].voice != -1;
+    }
+
+    /// Give the voices to the loudest emitters and push the changes to AL. Call once per frame.
+    void update() {
+      al_calls = 0;
+      choose_emitters();
+
+      // emitters that did not make the cut give up their voices
+      for (unsigned i = 0; i != voices.size(); ++i) {
+        int emitter = voices[i].emitter;
+        if (emitter == -1) continue;
+        emitter_t &e = emitters[emitter];
+        bool keep = false;
+        for (unsigned j = 0; j != chosen.size(); ++j) {
+          if (chosen[j] == emitter) { keep = true; break; }
+        }
+        if (!keep) {
+          if (get_audibility(e) > 0) num_steals++;
+          release_voice(e);
+          // one shot sounds that lose their voice are over
+          if (!e.looping) e.playing = false;
+        }
+      }
+
+      // give free voices to the newcomers
+      unsigned next_voice = 0;
+      for (unsigned j = 0; j != chosen.size(); ++j) {
+        emitter_t &e = emitters[chosen[j]];
+        if (e.voice != -1) continue;
+        while (voices[next_voice].emitter != -1) next_voice++;
+        voices[next_voice].emitter = chosen[j];
+        e.voice = next_voice;
+      }
+
+      num_virtual = 0;
+      for (unsigned i = 0; i != emitters.size(); ++i) {
+        emitter_t &e = emitters[i];
+        if (e.voice == -1 && get_audibility(e) > 0) {
+          num_virtual++;
+          // a one shot sound with no voice is not heard at all
+          e.triggered = false;
+          if (!e.looping) e.playing = false;
+        }
+      }
+
+      for (unsigned i = 0; i != voices.size(); ++i) {
+        if (voices[i].emitter != -1) sync_voice(voices[i]);
+      }
+
+      last_al_calls = al_calls;
+      total_al_calls += al_calls;
+    }
+
+    /// Counters for the last update().
+    stats get_stats() const {
+      stats s;
+      s.al_calls = last_al_calls;
+      s.total_al_calls = total_al_calls;
+      s.num_emitters = emitters.size() - free_emitters.size();
+      s.num_voices = voices.size();
+      s.num_playing = 0;
+      for (unsigned i = 0; i != voices.size(); ++i) {
+        if (voices[i].playing) s.num_playing++;
+      }
+      s.num_virtual = num_virtual;
+      s.num_steals = num_steals;
+      return s;
+    }
+
+    ~voice_manager() {
+      dynarray<ALuint> sources;
+      sources.resize(voices.size());
+      for (unsigned i = 0; i != voices.size(); ++i) {
+        if (voices[i].playing) alSourceStop(voices[i].source);
+        sources[i] = voices[i].source;
+      }
+      if (sources.size()) alDeleteSources(sources.size(), sources.data());
+    }
+  };
+}}
@@ -850,7 +850,7 @@ namespace octet { namespace loaders {
       for (int ni = 0; ni != node_elems.size(); ++ni) {
         TiXmlElement *node_elem = node_elems[ni];
         scene_node *node = nodes[ni];
-        mat4t &matrix = node->access_nodeToParent();
+        mat4t matrix;
         matrix.loadIdentity();
 
         for (TiXmlElement *child = node_elem->FirstChildElement(); child != NULL; child = child->NextSiblingElement()) {
@@ -883,6 +883,7 @@ namespace octet { namespace loaders {
             }
           }
         }
+        node->set_nodeToParent(matrix);
       }
     }
 
@@ -1215,6 +1216,7 @@ namespace octet { namespace loaders {
 
     // public function to load a collada file
     bool load_xml(const char *url) {
+      OCTET_PROFILE("collada_builder::load_xml");
       doc_path = url;
       doc_path.truncate(doc_path.filename_pos());
       const char *path = app_utils::get_path(url);
@@ -1239,6 +1241,7 @@ namespace octet { namespace loaders {
 
     // once loaded, use this to access the first component in the mesh
     void get_mesh(mesh &s, const char *id, resource_dict &dict) {
+      OCTET_PROFILE("collada_builder::get_mesh");
       TiXmlElement *geometry = find_id(id);
       s.init();
 
@@ -1273,6 +1276,7 @@ namespace octet { namespace loaders {
 
     // extract resources from the collada file into a collection.
     void get_resources(resource_dict &dict) {
+      OCTET_PROFILE("collada_builder::get_resources");
       add_images(dict);
 
       add_materials(dict);
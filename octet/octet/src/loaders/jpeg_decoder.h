@@ -590,6 +590,7 @@ namespace octet { namespace loaders {
   public:
     // get an opengl texture from a file in memory
     void get_image(dynarray<uint8_t> &image, uint16_t &format, uint16_t &width_, uint16_t &height_, const uint8_t *src, const uint8_t *src_max) {
+      OCTET_PROFILE("jpeg_decoder::get_image");
       while (src < src_max) {
         if (src[0] != 0xff) {
           printf("warning: bad JPEG file\n");
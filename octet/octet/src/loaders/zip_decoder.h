@@ -330,6 +330,7 @@ namespace octet { namespace loaders {
     }
 
     void decode(uint8_t *dest, uint8_t *dest_max, const uint8_t *src, const uint8_t *src_max) {
+      OCTET_PROFILE("zip_decoder::decode");
       unsigned bitptr = 0;
       unsigned is_last_block;
 
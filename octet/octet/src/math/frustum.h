@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// View frustum for culling
+//
+
+namespace octet { namespace math {
+  /// View frustum: six half spaces extracted from a world to projection matrix.
+  /// Used to skip objects that are not on the screen.
+  ///
+  /// Boxes can be tested four at a time with intersects4(). The four boxes are
+  /// stored as a block of 24 floats: center x[4], center y[4], center z[4],
+  /// half extent x[4], half extent y[4], half extent z[4].
+  class frustum {
+    enum { num_planes = 6 };
+
+    /// dot(normal, p) + offset >= 0 inside. x, y, z is the normal, w is the offset.
+    vec4 planes[num_planes];
+
+  public:
+    /// Default constructor: a frustum that contains everything.
+    frustum() {
+      for (int i = 0; i != num_planes; ++i) {
+        planes[i] = vec4(0, 0, 0, 1);
+      }
+    }
+
+    /// Build the frustum from a world to projection matrix.
+    frustum(const mat4t &worldToProjection) {
+      init(worldToProjection);
+    }
+
+    /// Build the frustum from a world to projection matrix.
+    /// Clip space is -w <= x, y, z <= w, each bound gives one plane.
+    void init(const mat4t &worldToProjection) {
+      const mat4t &m = worldToProjection;
+      vec4 col[4];
+      for (int j = 0; j != 4; ++j) {
+        col[j] = vec4(m[0][j], m[1][j], m[2][j], m[3][j]);
+      }
+      planes[0] = col[3] + col[0]; // left
+      planes[1] = col[3] - col[0]; // right
+      planes[2] = col[3] + col[1]; // bottom
+      planes[3] = col[3] - col[1]; // top
+      planes[4] = col[3] + col[2]; // near
+      planes[5] = col[3] - col[2]; // far
+    }
+
+    /// Get one of the six planes as (normal, offset).
+    vec4_ret get_plane(int index) const {
+      return planes[index];
+    }
+
+    /// Is point inside the frustum?
+    bool intersects(const vec3 &rhs) const {
+      for (int i = 0; i != num_planes; ++i) {
+        if (dot(planes[i].xyz(), rhs) + planes[i].w() < 0) return false;
+      }
+      return true;
+    }
+
+    /// Is the aabb at least partly inside the frustum?
+    /// This is conservative: large boxes near the corners of the frustum may pass.
+    bool intersects(const aabb &rhs) const {
+      vec3 center = rhs.get_center();
+      vec3 half = rhs.get_half_extent();
+      for (int i = 0; i != num_planes; ++i) {
+        vec3 normal = planes[i].xyz();
+        float distance = dot(normal, center) + planes[i].w();
+        float fatness = dot(abs(normal), half);
+        if (distance < -fatness) return false;
+      }
+      return true;
+    }
+
+    /// Test four boxes, stored as a block of 24 floats (see above).
+    /// Returns a mask with bit i set if box i is at least partly inside.
+    unsigned intersects4(const float *block) const {
+      #if OCTET_SIMD
+        __m128 cx = _mm_loadu_ps(block + 0), cy = _mm_loadu_ps(block + 4), cz = _mm_loadu_ps(block + 8);
+        __m128 hx = _mm_loadu_ps(block + 12), hy = _mm_loadu_ps(block + 16), hz = _mm_loadu_ps(block + 20);
+        __m128 outside = _mm_setzero_ps();
+        for (int i = 0; i != num_planes; ++i) {
+          const vec4 &p = planes[i];
+          __m128 nx = _mm_set1_ps(p.x()), ny = _mm_set1_ps(p.y()), nz = _mm_set1_ps(p.z());
+          __m128 ax = _mm_set1_ps(fabsf(p.x())), ay = _mm_set1_ps(fabsf(p.y())), az = _mm_set1_ps(fabsf(p.z()));
+          // distance of the center plus the reach of the box towards the plane
+          __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(p.w())));
+          __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, hx), _mm_mul_ps(ay, hy)), _mm_mul_ps(az, hz));
+          outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        return ~(unsigned)_mm_movemask_ps(outside) & 15;
+      #else
+        const float *cx = block + 0, *cy = block + 4, *cz = block + 8;
+        const float *hx = block + 12, *hy = block + 16, *hz = block + 20;
+        unsigned outside = 0;
+        for (int i = 0; i != num_planes; ++i) {
+          const vec4 &p = planes[i];
+          float nx = p.x(), ny = p.y(), nz = p.z(), w = p.w();
+          float ax = fabsf(nx), ay = fabsf(ny), az = fabsf(nz);
+          for (int j = 0; j != 4; ++j) {
+            float d = nx * cx[j] + ny * cy[j] + nz * cz[j] + w;
+            float r = ax * hx[j] + ay * hy[j] + az * hz[j];
+            outside |= (d + r < 0) << j;
+          }
+        }
+        return ~outside & 15;
+      #endif
+    }
+
+    /// Store box i (0-3) in a block of four for intersects4().
+    static void set_block(float *block, int i, const aabb &box) {
+      vec3 center = box.get_center();
+      vec3 half = box.get_half_extent();
+      block[i + 0] = center.x();
+      block[i + 4] = center.y();
+      block[i + 8] = center.z();
+      block[i + 12] = half.x();
+      block[i + 16] = half.y();
+      block[i + 20] = half.z();
+    }
+
+    /// Get a string representation of the frustum.
+    const char *toString(char *dest, size_t len) const {
+      char tmp[num_planes][64];
+      for (int i = 0; i != num_planes; ++i) {
+        planes[i].toString(tmp[i], sizeof(tmp[i]));
+      }
+      snprintf(dest, len, "[%s, %s, %s, %s, %s, %s]", tmp[0], tmp[1], tmp[2], tmp[3], tmp[4], tmp[5]);
+      return dest;
+    }
+  };
+}}
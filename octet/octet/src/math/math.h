@@ -53,6 +53,7 @@ namespace octet {
     OCTET_HUNGARIANS(sphere)
     OCTET_HUNGARIANS(plane)
     OCTET_HUNGARIANS(half_space)
+    OCTET_HUNGARIANS(frustum)
     OCTET_HUNGARIANS(ray)
     OCTET_HUNGARIANS(random)
     OCTET_HUNGARIANS(zcylinder)
@@ -82,6 +83,7 @@ namespace octet {
 #include "sphere.h"
 #include "plane.h"
 #include "half_space.h"
+#include "frustum.h"
 #include "ray.h"
 #include "polygon.h"
 #include "zcylinder.h"
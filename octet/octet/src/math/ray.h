@@ -109,7 +109,7 @@ namespace octet { namespace math {
     }
 
     vec3 get_distance() const {
-      return origin + distance;
+      return distance;
     }
   };
 
@@ -102,6 +102,8 @@
   // target specific support: Windows, Mac, Linux, PS Vita
   #include "platform/machine_specific.h"
   #include "platform/args_parser.h"
+  #include "platform/profiler.h"
+  #include "platform/thread_pool.h"
 
   // math library
   #include "math/math.h"
@@ -127,6 +129,7 @@
   // physics
   #ifdef OCTET_BULLET
     #include "../open_source/bullet/bullet.h"
+    #include "physics/bullet_shape_cache.h"
   #endif
 
   // scene (layer2)
@@ -140,6 +143,8 @@
 
   // high level helpers (layer2)
   #include "helpers/text_overlay.h"
+  #include "helpers/perf_hud.h"
+  #include "helpers/voice_manager.h"
 
 
   // asset loaders
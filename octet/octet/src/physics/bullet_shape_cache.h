@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Shared bullet collision shapes for primitive meshes.
+//
+
+namespace octet { namespace physics {
+  /// Interning cache for primitive bullet shapes.
+  ///
+  /// Boxes, z cylinders and spheres with the same dimensions share one btCollisionShape.
+  /// Each get_ call adds a reference, release() removes one and deletes the shape
+  /// when the last reference goes. The shape's user pointer holds its cache entry,
+  /// so do not call setUserPointer on a shared shape.
+  ///
+  /// Example:
+  ///
+  ///     btCollisionShape *shape = bullet_shape_cache::get_box(btVector3(1, 1, 1));
+  ///     btVector3 inertia;
+  ///     bullet_shape_cache::get_local_inertia(shape, mass, inertia);
+  ///     ...
+  ///     bullet_shape_cache::release(shape);
+  class bullet_shape_cache {
+    struct entry {
+      btCollisionShape *shape;
+      btVector3 unit_inertia; // inertia for a mass of one, scaled by the mass on request
+      int ref_count;
+      char key[32]; // used to clear the dictionary slot on release
+    };
+
+    // keyed by shape type and the bits of the dimensions, released entries stay as NULL
+    typedef dictionary<entry *> entries_t;
+
+    static entries_t &entries() { static entries_t instance; return instance; }
+
+  public:
+    /// Counters for the shape cache.
+    struct stats {
+      unsigned hits;
+      unsigned misses;
+      unsigned live_shapes;
+    };
+
+  private:
+    static stats &access_stats() { static stats instance; return instance; }
+
+    static void make_key(char *key, char kind, const btVector3 &dims) {
+      unsigned bits[3];
+      float f[3] = { (float)dims.x(), (float)dims.y(), (float)dims.z() };
+      memcpy(bits, f, sizeof(bits));
+      sprintf(key, "%c%08x%08x%08x", kind, bits[0], bits[1], bits[2]);
+    }
+
+    // find an entry, or NULL if it has not been created (or has been released)
+    static btCollisionShape *find(const char *key) {
+      int index = entries().get_index(key);
+      entry *e = index == -1 ? NULL : entries().get_value(index);
+      if (!e) return NULL;
+      e->ref_count++;
+      access_stats().hits++;
+      return e->shape;
+    }
+
+    static btCollisionShape *add(const char *key, btCollisionShape *shape) {
+      entry *e = new entry();
+      e->shape = shape;
+      e->ref_count = 1;
+      strcpy(e->key, key);
+      shape->calculateLocalInertia(1, e->unit_inertia);
+      shape->setUserPointer(e);
+      entries()[key] = e;
+      access_stats().misses++;
+      access_stats().live_shapes++;
+      return shape;
+    }
+
+  public:
+    /// Get a shared box shape with this half extent.
+    static btCollisionShape *get_box(const btVector3 &half_extent) {
+      char key[32];
+      make_key(key, 'b', half_extent);
+      btCollisionShape *result = find(key);
+      return result ? result : add(key, new btBoxShape(half_extent));
+    }
+
+    /// Get a shared cylinder shape aligned to z with this half extent (radius, radius, half length).
+    static btCollisionShape *get_cylinder_z(const btVector3 &half_extent) {
+      char key[32];
+      make_key(key, 'z', half_extent);
+      btCollisionShape *result = find(key);
+      return result ? result : add(key, new btCylinderShapeZ(half_extent));
+    }
+
+    /// Get a shared sphere shape with this radius.
+    static btCollisionShape *get_sphere(btScalar radius) {
+      char key[32];
+      make_key(key, 's', btVector3(radius, 0, 0));
+      btCollisionShape *result = find(key);
+      return result ? result : add(key, new btSphereShape(radius));
+    }
+
+    /// Is this shape owned by the cache?
+    static bool is_shared(btCollisionShape *shape) {
+      return shape && shape->getUserPointer() != NULL && ((entry*)shape->getUserPointer())->shape == shape;
+    }
+
+    /// Add a reference to a shared shape.
+    static void add_ref(btCollisionShape *shape) {
+      if (is_shared(shape)) {
+        ((entry*)shape->getUserPointer())->ref_count++;
+      }
+    }
+
+    /// Remove a reference to a shared shape, deleting it when nothing uses it.
+    /// Shapes that did not come from the cache are left alone.
+    static void release(btCollisionShape *shape) {
+      if (!is_shared(shape)) return;
+      entry *e = (entry*)shape->getUserPointer();
+      if (--e->ref_count != 0) return;
+
+      entries()[e->key] = NULL;
+      delete e->shape;
+      delete e;
+      access_stats().live_shapes--;
+    }
+
+    /// Get the local inertia of a shape for a mass.
+    /// Shared shapes use the inertia computed when they were created.
+    static void get_local_inertia(btCollisionShape *shape, btScalar mass, btVector3 &inertia) {
+      if (is_shared(shape)) {
+        inertia = ((entry*)shape->getUserPointer())->unit_inertia * mass;
+      } else {
+        shape->calculateLocalInertia(mass, inertia);
+      }
+    }
+
+    /// Hit, miss and live shape counts since startup.
+    static const stats &get_stats() {
+      return access_stats();
+    }
+  };
+}}
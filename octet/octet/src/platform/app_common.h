@@ -22,6 +22,7 @@ namespace octet {
     attribute_blendindices = 7,
     attribute_texcoord = 8,
     attribute_uv = 8,
+    attribute_instance_matrix = 9, // four slots, 9-12, one per row
     attribute_tangent = 14,
     attribute_bitangent = 15,
     attribute_binormal = 15,
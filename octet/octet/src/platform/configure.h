@@ -35,6 +35,38 @@
   #define GL_UNIFORM_BUFFER 0
 #endif
 
+// instanced draws need OpenGL 3.3 or ES3. GLES2 and the Mac's legacy context draw one object at a time.
+#ifndef OCTET_INSTANCING
+  #if defined(OCTET_GLES2) || OCTET_MAC
+    #define OCTET_INSTANCING 0
+  #else
+    #define OCTET_INSTANCING 1
+  #endif
+#endif
+
+#ifndef OCTET_VERTEX_ARRAYS
+  #define OCTET_VERTEX_ARRAYS OCTET_INSTANCING
+#endif
+
+#ifndef OCTET_FENCES
+  #define OCTET_FENCES OCTET_INSTANCING
+#endif
+
+// GL_TIME_ELAPSED queries are desktop GL 3.3 only.
+#ifndef OCTET_TIMER_QUERIES
+  #define OCTET_TIMER_QUERIES OCTET_INSTANCING
+#endif
+
+// the 4 wide culling, occlusion and ray paths use only SSE2 intrinsics, so they build with any x86 compiler.
+// unlike OCTET_SSE, which also changes the vector classes and the allocator and is Windows only.
+#ifndef OCTET_SIMD
+  #if defined(WIN32) || defined(__SSE2__)
+    #define OCTET_SIMD 1
+  #else
+    #define OCTET_SIMD 0
+  #endif
+#endif
+
 // use <> to include from standard directories
 // use "" to include from our own project
 #include <stdio.h>
@@ -50,6 +82,10 @@
   #include <direct.h>
 #endif
 
+#if OCTET_SIMD
+  #include <emmintrin.h>
+#endif
+
 namespace octet {
   /// write some text to log.txt
   inline static FILE * log(const char *fmt, ...) {
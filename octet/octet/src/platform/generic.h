@@ -21,6 +21,12 @@
 
 typedef float float_t;
 
+// app_common passes a window handle to move_camera, there are no windows here.
+typedef void *HWND;
+
+// getcwd()
+#include <unistd.h>
+
 #include "gl_skeleton.h"
 #include "al_defs.h"
 
@@ -118,6 +124,7 @@ namespace octet {
 
     static void init_all(int argc, char **argv) {
       gl_ctxt(new gl_context());
+      alcMakeContextCurrent(alcCreateContext(alcOpenDevice(NULL), NULL));
       //get_the_app()->init();
     }
 
@@ -512,6 +512,7 @@ enum {
   GL_CURRENT_QUERY = 0x8865,
   GL_QUERY_RESULT = 0x8866,
   GL_QUERY_RESULT_AVAILABLE = 0x8867,
+  GL_TIME_ELAPSED = 0x88BF,
   GL_BUFFER_MAPPED = 0x88BC,
   GL_BUFFER_MAP_POINTER = 0x88BD,
   GL_STREAM_READ = 0x88E1,
@@ -61,6 +61,7 @@ typedef struct __GLsync *GLsync;
 #define GL_TRIANGLES                                     0x0004
 #define GL_TRIANGLE_STRIP                                0x0005
 #define GL_TRIANGLE_FAN                                  0x0006
+#define GL_POLYGON                                       0x0009
 
 /* BlendingFactorDest */
 #define GL_ZERO                                          0
@@ -497,6 +498,7 @@ typedef struct __GLsync *GLsync;
 #define GL_CURRENT_QUERY                                 0x8865
 #define GL_QUERY_RESULT                                  0x8866
 #define GL_QUERY_RESULT_AVAILABLE                        0x8867
+#define GL_TIME_ELAPSED                                  0x88BF
 #define GL_BUFFER_MAPPED                                 0x88BC
 #define GL_BUFFER_MAP_POINTER                            0x88BD
 #define GL_STREAM_READ                                   0x88E1
@@ -832,11 +834,25 @@ class gl_framebuffer : public gl_container {
 class gl_context : public gl_container {
 
   unsigned error;
+  GLuint last_name;
 public:
+  gl_context() {
+    error = 0;
+    last_name = 0;
+  }
 
   void set_error(unsigned value) {
     error = value;
   }
+
+  // names are never reused, so every object gets a different non zero handle as it would on a real driver.
+  GLuint new_name() {
+    return ++last_name;
+  }
+
+  void new_names(GLsizei n, GLuint *names) {
+    for (GLsizei i = 0; i < n; ++i) names[i] = new_name();
+  }
 };
 
 gl_context *gl_ctxt(gl_context *in = 0) {
@@ -1002,13 +1018,13 @@ GL_APICALL void GL_APIENTRY glCopyTexSubImage2D (GLenum target, GLint level, GLi
 
 GL_APICALL GLuint GL_APIENTRY glCreateProgram (void) {
   gl_context *ctxt = gl_ctxt();
-  return 0;
+  return ctxt->new_name();
 }
 
 
 GL_APICALL GLuint GL_APIENTRY glCreateShader (GLenum type) {
   gl_context *ctxt = gl_ctxt();
-  return 0;
+  return ctxt->new_name();
 }
 
 
@@ -1124,6 +1140,7 @@ GL_APICALL void GL_APIENTRY glFrontFace (GLenum mode) {
 
 GL_APICALL void GL_APIENTRY glGenBuffers (GLsizei n, GLuint* buffers) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, buffers);
 }
 
 
@@ -1134,16 +1151,19 @@ GL_APICALL void GL_APIENTRY glGenerateMipmap (GLenum target) {
 
 GL_APICALL void GL_APIENTRY glGenFramebuffers (GLsizei n, GLuint* framebuffers) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, framebuffers);
 }
 
 
 GL_APICALL void GL_APIENTRY glGenRenderbuffers (GLsizei n, GLuint* renderbuffers) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, renderbuffers);
 }
 
 
 GL_APICALL void GL_APIENTRY glGenTextures (GLsizei n, GLuint* textures) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, textures);
 }
 
 
@@ -1164,6 +1184,7 @@ GL_APICALL void GL_APIENTRY glGetAttachedShaders (GLuint program, GLsizei maxcou
 
 GL_APICALL GLint GL_APIENTRY glGetAttribLocation (GLuint program, const GLchar* name) {
   gl_context *ctxt = gl_ctxt();
+  return 0;
 }
 
 
@@ -1179,6 +1200,7 @@ GL_APICALL void GL_APIENTRY glGetBufferParameteriv (GLenum target, GLenum pname,
 
 GL_APICALL GLenum GL_APIENTRY glGetError (void) {
   gl_context *ctxt = gl_ctxt();
+  return 0;
 }
 
 
@@ -1194,6 +1216,7 @@ GL_APICALL void GL_APIENTRY glGetFramebufferAttachmentParameteriv (GLenum target
 
 GL_APICALL void GL_APIENTRY glGetIntegerv (GLenum pname, GLint* params) {
   gl_context *ctxt = gl_ctxt();
+  *params = 0;
 }
 
 
@@ -1286,6 +1309,7 @@ GL_APICALL void GL_APIENTRY glHint (GLenum target, GLenum mode) {
 
 GL_APICALL GLboolean GL_APIENTRY glIsBuffer (GLuint buffer) {
   gl_context *ctxt = gl_ctxt();
+  return 0;
 }
 
 
@@ -1635,6 +1659,7 @@ GL_APICALL void GL_APIENTRY glCompressedTexSubImage3D (GLenum target, GLint leve
 
 GL_APICALL void GL_APIENTRY glGenQueries (GLsizei n, GLuint* ids) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, ids);
 }
 
 
@@ -1753,6 +1778,7 @@ GL_APICALL void GL_APIENTRY glDeleteVertexArrays (GLsizei n, const GLuint* array
 
 GL_APICALL void GL_APIENTRY glGenVertexArrays (GLsizei n, GLuint* arrays) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, arrays);
 }
 
 
@@ -2005,6 +2031,7 @@ GL_APICALL void GL_APIENTRY glGetBufferParameteri64v (GLenum target, GLenum pnam
 
 GL_APICALL void GL_APIENTRY glGenSamplers (GLsizei count, GLuint* samplers) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(count, samplers);
 }
 
 
@@ -2071,6 +2098,7 @@ GL_APICALL void GL_APIENTRY glDeleteTransformFeedbacks (GLsizei n, const GLuint*
 
 GL_APICALL void GL_APIENTRY glGenTransformFeedbacks (GLsizei n, GLuint* ids) {
   gl_context *ctxt = gl_ctxt();
+  ctxt->new_names(n, ids);
 }
 
 
@@ -2129,3 +2157,11 @@ GL_APICALL void GL_APIENTRY glGetInternalformativ (GLenum target, GLenum interna
   gl_context *ctxt = gl_ctxt();
 }
 
+
+
+/* OpenGL ES 3.1 */
+
+#define GL_COMPUTE_SHADER                                0x91B9
+
+GL_APICALL void GL_APIENTRY glDispatchCompute (GLuint /*num_groups_x*/, GLuint /*num_groups_y*/, GLuint /*num_groups_z*/) {
+}
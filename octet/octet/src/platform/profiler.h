@@ -0,0 +1,438 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Scoped CPU timing markers with Chrome trace output
+//
+
+#if defined(WIN32)
+  #define OCTET_THREAD_LOCAL __declspec(thread)
+#else
+  #include <time.h>
+  #if defined(__APPLE__)
+    #include <mach/mach_time.h>
+  #endif
+  #define OCTET_THREAD_LOCAL __thread
+#endif
+
+#ifndef OCTET_PROFILER
+  #define OCTET_PROFILER 1
+#endif
+
+#define OCTET_PROFILE_JOIN2(A, B) A##B
+#define OCTET_PROFILE_JOIN(A, B) OCTET_PROFILE_JOIN2(A, B)
+
+/// Time the rest of the enclosing block. NAME must be a string literal.
+///
+///     void update() {
+///       OCTET_PROFILE("update");
+///       ...
+///     }
+#if OCTET_PROFILER
+  #define OCTET_PROFILE(NAME) octet::platform::profile_scope OCTET_PROFILE_JOIN(octet_profile_, __LINE__)(NAME)
+#else
+  #define OCTET_PROFILE(NAME) (void)0
+#endif
+
+namespace octet { namespace platform {
+  /// Records the start and end of named blocks of code on every thread.
+  ///
+  /// Each thread writes to its own buffer, so markers are safe in thread_pool jobs.
+  /// A thread that exits should call remove_thread() so that a new thread can reuse its buffer;
+  /// thread_pool workers do this. Past max_threads live threads, new threads record nothing.
+  /// Call end_frame() once a frame on the main thread, while no jobs are running, to update
+  /// the rolling summary. Between begin_capture() and write_trace() the events are kept and
+  /// written as Chrome trace_event JSON (open it in chrome://tracing).
+  class profiler {
+  public:
+    /// Time spent in one named block, averaged over the last summary_frames frames.
+    struct summary_entry {
+      const char *name;
+      unsigned depth; // nesting depth, for indenting
+      float avg_ms; // per frame
+      float max_ms; // worst frame
+      float calls; // per frame
+      float sum_ms; // used while gathering
+      float frame_ms; // used while gathering
+      unsigned num_calls; // used while gathering
+    };
+
+    enum {
+      max_threads = 64,
+      events_per_thread = 0x10000,
+      summary_frames = 30,
+      history_frames = 128
+    };
+
+  private:
+    struct event {
+      const char *name;
+      uint64_t begin;
+      uint64_t end; // zero while the block is still running
+      uint16_t depth;
+      bool summarized;
+    };
+
+    struct thread_buffer {
+      event *events;
+      unsigned num_events;
+      unsigned max_events;
+      unsigned depth;
+      unsigned generation; // changes when the events are thrown away
+      unsigned dropped;
+      unsigned id;
+      volatile unsigned in_use; // zero when the thread has gone and a new one may take the buffer
+    };
+
+    struct state_t {
+      thread_buffer *threads[max_threads];
+      volatile unsigned num_threads;
+      bool enabled;
+      bool capturing;
+      bool warned_full;
+      uint64_t frame_start;
+      uint64_t capture_start;
+      float frame_ms[history_frames];
+      unsigned num_frames;
+      unsigned window_frames;
+      dynarray<summary_entry> window;
+      dynarray<summary_entry> summary;
+
+      state_t() {
+        memset(threads, 0, sizeof(threads));
+        num_threads = 0;
+        enabled = true;
+        capturing = false;
+        warned_full = false;
+        frame_start = capture_start = get_ticks();
+        memset(frame_ms, 0, sizeof(frame_ms));
+        num_frames = 0;
+        window_frames = 0;
+      }
+    };
+
+    static state_t &get() {
+      static state_t state;
+      return state;
+    }
+
+    static unsigned atomic_increment(volatile unsigned &value) {
+      #if defined(WIN32)
+        return (unsigned)InterlockedIncrement((volatile LONG*)&value) - 1;
+      #else
+        return __sync_fetch_and_add(&value, 1);
+      #endif
+    }
+
+    // set value from 0 to 1, returns false if it was not 0.
+    static bool atomic_claim(volatile unsigned &value) {
+      #if defined(WIN32)
+        return InterlockedCompareExchange((volatile LONG*)&value, 1, 0) == 0;
+      #else
+        return __sync_bool_compare_and_swap(&value, 0, 1);
+      #endif
+    }
+
+    static void atomic_release(volatile unsigned &value) {
+      #if defined(WIN32)
+        InterlockedExchange((volatile LONG*)&value, 0);
+      #else
+        __sync_lock_release(&value);
+      #endif
+    }
+
+    // buffers come from malloc as thread_pool jobs must not use octet's allocator.
+    static thread_buffer *add_thread() {
+      state_t &s = get();
+
+      // take over the buffer of a thread that has gone, keeping its events for end_frame().
+      for (unsigned i = 0; i != s.num_threads && i != max_threads; ++i) {
+        thread_buffer *buf = s.threads[i];
+        if (buf && atomic_claim(buf->in_use)) {
+          buf->depth = 0;
+          return buf;
+        }
+      }
+
+      thread_buffer *buf = (thread_buffer*)malloc(sizeof(thread_buffer));
+      memset(buf, 0, sizeof(*buf));
+      buf->in_use = 1;
+      unsigned id = atomic_increment(s.num_threads);
+      if (id < max_threads) {
+        buf->events = (event*)malloc(sizeof(event) * events_per_thread);
+        buf->max_events = events_per_thread;
+        buf->id = id;
+        s.threads[id] = buf;
+      } else if (!s.warned_full) {
+        s.warned_full = true;
+        fprintf(stderr, "profiler: more than %d threads, new threads will not be profiled\n", (int)max_threads);
+      }
+      return buf;
+    }
+
+    static thread_buffer *&access_thread_buffer() {
+      static OCTET_THREAD_LOCAL thread_buffer *buffer;
+      return buffer;
+    }
+
+    static thread_buffer *get_thread_buffer() {
+      thread_buffer *&buffer = access_thread_buffer();
+      if (!buffer) buffer = add_thread();
+      return buffer;
+    }
+
+    static double get_ticks_per_ms() {
+      #if defined(WIN32)
+        static double value;
+        if (value == 0) {
+          LARGE_INTEGER freq;
+          QueryPerformanceFrequency(&freq);
+          value = (double)freq.QuadPart * 0.001;
+        }
+        return value;
+      #elif defined(__APPLE__)
+        static double value;
+        if (value == 0) {
+          mach_timebase_info_data_t info;
+          mach_timebase_info(&info);
+          value = 1000000.0 * info.denom / info.numer;
+        }
+        return value;
+      #else
+        return 1000000.0;
+      #endif
+    }
+
+    static float ticks_to_ms(uint64_t ticks) {
+      return (float)(ticks / get_ticks_per_ms());
+    }
+
+    static summary_entry &find_entry(dynarray<summary_entry> &entries, const char *name, unsigned depth) {
+      for (unsigned i = 0; i != entries.size(); ++i) {
+        if (entries[i].name == name) {
+          if (depth < entries[i].depth) entries[i].depth = depth;
+          return entries[i];
+        }
+      }
+      summary_entry e;
+      memset(&e, 0, sizeof(e));
+      e.name = name;
+      e.depth = depth;
+      entries.push_back(e);
+      return entries.back();
+    }
+
+    static void clear_events() {
+      state_t &s = get();
+      for (unsigned i = 0; i != s.num_threads && i != max_threads; ++i) {
+        thread_buffer *buf = s.threads[i];
+        if (buf) {
+          buf->num_events = 0;
+          buf->dropped = 0;
+          buf->generation++;
+        }
+      }
+    }
+
+    static void write_json_string(FILE *file, const char *str) {
+      fputc('"', file);
+      for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') fputc('\\', file);
+        fputc(*str, file);
+      }
+      fputc('"', file);
+    }
+
+  public:
+    /// A high resolution time stamp.
+    static uint64_t get_ticks() {
+      #if defined(WIN32)
+        LARGE_INTEGER value;
+        QueryPerformanceCounter(&value);
+        return (uint64_t)value.QuadPart;
+      #elif defined(__APPLE__)
+        return mach_absolute_time();
+      #else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+      #endif
+    }
+
+    /// Start a block, returns a handle for end(). Use OCTET_PROFILE rather than calling this.
+    static unsigned begin(const char *name, unsigned &generation) {
+      thread_buffer *buf = get_thread_buffer();
+      unsigned depth = buf->depth++;
+      generation = buf->generation;
+      if (!get().enabled || buf->num_events == buf->max_events) {
+        buf->dropped++;
+        return ~0u;
+      }
+      event &e = buf->events[buf->num_events];
+      e.name = name;
+      e.begin = get_ticks();
+      e.end = 0;
+      e.depth = (uint16_t)depth;
+      e.summarized = false;
+      return buf->num_events++;
+    }
+
+    /// End a block started by begin().
+    static void end(unsigned index, unsigned generation) {
+      thread_buffer *buf = get_thread_buffer();
+      buf->depth--;
+      if (index != ~0u && generation == buf->generation) {
+        buf->events[index].end = get_ticks();
+      }
+    }
+
+    /// Give this thread's buffer to the next new thread. Call just before a thread exits.
+    static void remove_thread() {
+      thread_buffer *&buffer = access_thread_buffer();
+      if (!buffer) return;
+      if (buffer->events) {
+        atomic_release(buffer->in_use);
+      } else {
+        free(buffer);
+      }
+      buffer = NULL;
+    }
+
+    /// Turn recording on or off.
+    static void set_enabled(bool value) {
+      get().enabled = value;
+    }
+
+    /// Finish a frame: add its times to the summary and, unless capturing, throw the events away.
+    static void end_frame() {
+      state_t &s = get();
+      uint64_t now = get_ticks();
+      s.frame_ms[s.num_frames++ % history_frames] = ticks_to_ms(now - s.frame_start);
+      s.frame_start = now;
+
+      dynarray<summary_entry> &window = s.window;
+      for (unsigned t = 0; t != s.num_threads && t != max_threads; ++t) {
+        thread_buffer *buf = s.threads[t];
+        if (!buf) continue;
+        for (unsigned i = 0; i != buf->num_events; ++i) {
+          event &e = buf->events[i];
+          // when capturing, the buffer holds earlier frames too.
+          if (e.end == 0 || e.summarized) continue;
+          e.summarized = true;
+          summary_entry &entry = find_entry(window, e.name, e.depth);
+          entry.frame_ms += ticks_to_ms(e.end - e.begin);
+          entry.num_calls++;
+        }
+      }
+
+      for (unsigned i = 0; i != window.size(); ++i) {
+        summary_entry &entry = window[i];
+        entry.sum_ms += entry.frame_ms;
+        if (entry.frame_ms > entry.max_ms) entry.max_ms = entry.frame_ms;
+        entry.frame_ms = 0;
+      }
+
+      if (++s.window_frames == summary_frames) {
+        s.summary.resize(0);
+        for (unsigned i = 0; i != window.size(); ++i) {
+          summary_entry &entry = window[i];
+          if (entry.num_calls == 0) continue;
+          summary_entry result = entry;
+          result.avg_ms = entry.sum_ms / summary_frames;
+          result.calls = (float)entry.num_calls / summary_frames;
+          s.summary.push_back(result);
+        }
+        window.resize(0);
+        s.window_frames = 0;
+      }
+
+      if (!s.capturing) {
+        clear_events();
+      }
+    }
+
+    /// Blocks seen in the last summary_frames frames, in the order they first started.
+    static const dynarray<summary_entry> &get_summary() {
+      return get().summary;
+    }
+
+    /// Length of an earlier frame; 0 is the last frame.
+    static float get_frame_ms(unsigned frames_ago = 0) {
+      state_t &s = get();
+      if (frames_ago >= s.num_frames || frames_ago >= history_frames) return 0;
+      return s.frame_ms[(s.num_frames - 1 - frames_ago) % history_frames];
+    }
+
+    /// Print the summary, one block per line.
+    static void dump_summary(FILE *file) {
+      const dynarray<summary_entry> &summary = get_summary();
+      for (unsigned i = 0; i != summary.size(); ++i) {
+        const summary_entry &e = summary[i];
+        fprintf(file, "%*s%-*s %8.3fms avg %8.3fms max %6.1f calls\n", e.depth * 2, "", 32 - e.depth * 2, e.name, e.avg_ms, e.max_ms, e.calls);
+      }
+    }
+
+    /// Keep events from now on for write_trace().
+    static void begin_capture() {
+      state_t &s = get();
+      clear_events();
+      s.capturing = true;
+      s.capture_start = get_ticks();
+    }
+
+    /// Is a capture running?
+    static bool is_capturing() {
+      return get().capturing;
+    }
+
+    /// Write the captured events as Chrome trace_event JSON and stop capturing. Returns false if the file can't be written.
+    static bool write_trace(const char *filename) {
+      state_t &s = get();
+      FILE *file = fopen(filename, "w");
+      if (!file) return false;
+
+      double ticks_per_us = get_ticks_per_ms() * 0.001;
+      const char *sep = "";
+      unsigned dropped = 0;
+      fprintf(file, "{\"traceEvents\":[\n");
+      for (unsigned t = 0; t != s.num_threads && t != max_threads; ++t) {
+        thread_buffer *buf = s.threads[t];
+        if (!buf) continue;
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", sep, buf->id, buf->id);
+        sep = ",\n";
+        for (unsigned i = 0; i != buf->num_events; ++i) {
+          const event &e = buf->events[i];
+          if (e.end == 0) continue;
+          fprintf(file, "%s{\"name\":", sep);
+          write_json_string(file, e.name);
+          fprintf(file, ",\"cat\":\"octet\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+            (e.begin - s.capture_start) / ticks_per_us, (e.end - e.begin) / ticks_per_us, buf->id
+          );
+        }
+        dropped += buf->dropped;
+      }
+      fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%u}}\n", dropped);
+      fclose(file);
+
+      s.capturing = false;
+      clear_events();
+      return true;
+    }
+  };
+
+  /// Times its lifetime. Made by OCTET_PROFILE.
+  class profile_scope {
+    unsigned index;
+    unsigned generation;
+  public:
+    profile_scope(const char *name) {
+      index = profiler::begin(name, generation);
+    }
+
+    ~profile_scope() {
+      profiler::end(index, generation);
+    }
+  };
+}}
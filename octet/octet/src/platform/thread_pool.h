@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Worker threads for data parallel jobs
+//
+
+#if defined(WIN32)
+  #include <windows.h>
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+namespace octet { namespace platform {
+  /// A fixed set of worker threads that split a range of items between them.
+  ///
+  /// run() hands out the range in chunks; the calling thread works on chunks too and
+  /// returns when every item is done. Jobs must not allocate through octet's allocator
+  /// or touch OpenGL: do that on the main thread before calling run().
+  ///
+  /// Example:
+  ///
+  ///     static void square(void *context, unsigned begin, unsigned end) {
+  ///       float *values = (float*)context;
+  ///       for (unsigned i = begin; i != end; ++i) values[i] *= values[i];
+  ///     }
+  ///     ...
+  ///     thread_pool pool;
+  ///     pool.init();
+  ///     pool.run(square, values, num_values, 64);
+  class thread_pool {
+  public:
+    /// A job processes items [begin, end).
+    typedef void (*job_fn)(void *context, unsigned begin, unsigned end);
+
+  private:
+    #if defined(WIN32)
+      typedef HANDLE thread_t;
+      CRITICAL_SECTION mutex;
+      CONDITION_VARIABLE work_ready;
+      CONDITION_VARIABLE work_done;
+      void lock() { EnterCriticalSection(&mutex); }
+      void unlock() { LeaveCriticalSection(&mutex); }
+      void wait(CONDITION_VARIABLE &cv) { SleepConditionVariableCS(&cv, &mutex, INFINITE); }
+      static void wake_all(CONDITION_VARIABLE &cv) { WakeAllConditionVariable(&cv); }
+      static unsigned atomic_add(volatile unsigned &value, unsigned amount) {
+        return (unsigned)InterlockedExchangeAdd((volatile LONG*)&value, (LONG)amount);
+      }
+      static DWORD WINAPI thread_main(LPVOID arg) { ((thread_pool*)arg)->worker(); return 0; }
+    #else
+      typedef pthread_t thread_t;
+      pthread_mutex_t mutex;
+      pthread_cond_t work_ready;
+      pthread_cond_t work_done;
+      void lock() { pthread_mutex_lock(&mutex); }
+      void unlock() { pthread_mutex_unlock(&mutex); }
+      void wait(pthread_cond_t &cv) { pthread_cond_wait(&cv, &mutex); }
+      static void wake_all(pthread_cond_t &cv) { pthread_cond_broadcast(&cv); }
+      static unsigned atomic_add(volatile unsigned &value, unsigned amount) {
+        return __sync_fetch_and_add(&value, amount);
+      }
+      static void *thread_main(void *arg) { ((thread_pool*)arg)->worker(); return 0; }
+    #endif
+
+    dynarray<thread_t> threads;
+
+    // the current job, guarded by mutex except for next_item
+    job_fn job;
+    void *context;
+    unsigned num_items;
+    unsigned chunk_size;
+    volatile unsigned next_item;
+    unsigned generation; // incremented for every job
+    unsigned start_generation; // generation when the workers were started
+    unsigned num_busy; // workers still working on this generation
+    bool quit;
+
+    void do_chunks() {
+      for (;;) {
+        unsigned begin = atomic_add(next_item, chunk_size);
+        if (begin >= num_items) break;
+        unsigned end = num_items - begin < chunk_size ? num_items : begin + chunk_size;
+        job(context, begin, end);
+      }
+    }
+
+    void worker() {
+      unsigned seen = start_generation;
+      lock();
+      for (;;) {
+        while (generation == seen && !quit) wait(work_ready);
+        if (quit) break;
+        seen = generation;
+        unlock();
+        do_chunks();
+        lock();
+        if (--num_busy == 0) wake_all(work_done);
+      }
+      unlock();
+      profiler::remove_thread();
+    }
+
+  public:
+    thread_pool() {
+      #if defined(WIN32)
+        InitializeCriticalSection(&mutex);
+        InitializeConditionVariable(&work_ready);
+        InitializeConditionVariable(&work_done);
+      #else
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&work_ready, NULL);
+        pthread_cond_init(&work_done, NULL);
+      #endif
+      job = NULL;
+      context = NULL;
+      num_items = chunk_size = next_item = 0;
+      generation = start_generation = num_busy = 0;
+      quit = false;
+    }
+
+    /// Number of processors in the machine.
+    static unsigned get_num_cpus() {
+      #if defined(WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors ? (unsigned)info.dwNumberOfProcessors : 1;
+      #else
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? (unsigned)n : 1;
+      #endif
+    }
+
+    /// Start num_threads threads in total, including the caller of run().
+    /// The default is one per processor.
+    void init(unsigned num_threads = 0) {
+      shutdown();
+      if (num_threads == 0) num_threads = get_num_cpus();
+      start_generation = generation;
+      threads.resize(num_threads - 1);
+      for (unsigned i = 0; i != threads.size(); ++i) {
+        #if defined(WIN32)
+          threads[i] = CreateThread(NULL, 0, thread_main, this, 0, NULL);
+        #else
+          pthread_create(&threads[i], NULL, thread_main, this);
+        #endif
+      }
+    }
+
+    /// Stop the worker threads. run() still works, on the calling thread only.
+    void shutdown() {
+      if (threads.size() == 0) return;
+      lock();
+      quit = true;
+      wake_all(work_ready);
+      unlock();
+      for (unsigned i = 0; i != threads.size(); ++i) {
+        #if defined(WIN32)
+          WaitForSingleObject(threads[i], INFINITE);
+          CloseHandle(threads[i]);
+        #else
+          pthread_join(threads[i], NULL);
+        #endif
+      }
+      threads.reset();
+      quit = false;
+    }
+
+    /// Number of threads that run() uses, including the caller.
+    unsigned get_num_threads() const {
+      return threads.size() + 1;
+    }
+
+    /// Call fn on chunks of [0, count) from all the threads and wait for them to finish.
+    void run(job_fn fn, void *ctx, unsigned count, unsigned chunk = 1) {
+      if (count == 0) return;
+      job = fn;
+      context = ctx;
+      num_items = count;
+      chunk_size = chunk ? chunk : 1;
+      next_item = 0;
+
+      if (threads.size() == 0 || count <= chunk_size) {
+        do_chunks();
+        return;
+      }
+
+      lock();
+      num_busy = threads.size();
+      generation++;
+      wake_all(work_ready);
+      unlock();
+
+      do_chunks();
+
+      lock();
+      while (num_busy != 0) wait(work_done);
+      unlock();
+    }
+
+    ~thread_pool() {
+      shutdown();
+      #if defined(WIN32)
+        DeleteCriticalSection(&mutex);
+      #else
+        pthread_cond_destroy(&work_done);
+        pthread_cond_destroy(&work_ready);
+        pthread_mutex_destroy(&mutex);
+      #endif
+    }
+  };
+}}
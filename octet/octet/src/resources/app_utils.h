@@ -191,8 +191,7 @@ namespace octet { namespace resources {
       // make a new texture handle
       GLuint handle = 0;
       glGenTextures(1, &handle);
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, handle);
+      gl_state::bind_texture(0, GL_TEXTURE_2D, handle);
 
       glTexImage2D(GL_TEXTURE_2D, 0, gl_kind, width, height, 0, in_format, GL_UNSIGNED_BYTE, (void*)image);
 
@@ -6,6 +6,12 @@
 //
 // map a file to memory
 
+#ifndef WIN32
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+#endif
+
 class file_map {
   #ifdef WIN32
     HANDLE file_handle;
@@ -21,6 +27,12 @@ public:
     error = 0;
     data = 0;
     size = 0;
+    #ifdef WIN32
+      file_handle = INVALID_HANDLE_VALUE;
+      mapping_handle = NULL;
+    #else
+      file_handle = -1;
+    #endif
 
     if (file_name == NULL) {
       error = "no file name";
@@ -28,8 +40,6 @@ public:
     }
 
     #ifdef WIN32
-      mapping_handle = INVALID_HANDLE_VALUE;
-
       file_handle = CreateFileA(
         file_name, GENERIC_READ, FILE_SHARE_READ, 0,
         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0
@@ -44,24 +54,60 @@ public:
       size = ((uint64_t)sizehi << 32) | sizelo;
       mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
 
-      if (mapping_handle == INVALID_HANDLE_VALUE) {
+      if (mapping_handle == NULL) {
         error = "could not map file";
         return;
       }
 
       data = (const uint8_t *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
     #else
-      //file_handle = open(file_name, O_RDONLY);
-      //mmap
+      file_handle = open(file_name, O_RDONLY);
+      if (file_handle < 0) {
+        error = "could not open file";
+        return;
+      }
+
+      struct stat st;
+      if (fstat(file_handle, &st) != 0) {
+        error = "could not stat file";
+        return;
+      }
+
+      size = (uint64_t)st.st_size;
+      if (size != 0) {
+        void *ptr = mmap(0, (size_t)size, PROT_READ, MAP_PRIVATE, file_handle, 0);
+        if (ptr == MAP_FAILED) {
+          error = "could not map file";
+          size = 0;
+          return;
+        }
+        data = (const uint8_t *)ptr;
+      }
     #endif
   }
 
   ~file_map() {
     #ifdef WIN32
-      UnmapViewOfFile(data);
-      CloseHandle(file_handle);
-      CloseHandle(mapping_handle);
+      if (data) UnmapViewOfFile(data);
+      if (mapping_handle) CloseHandle(mapping_handle);
+      if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+    #else
+      if (data) munmap((void*)data, (size_t)size);
+      if (file_handle >= 0) close(file_handle);
+    #endif
+  }
+
+  /// Last time the file was written, in platform units (only for comparing files), or 0 if it does not exist.
+  static uint64_t get_modified_time(const char *file_name) {
+    if (file_name == NULL) return 0;
+    #ifdef WIN32
+      WIN32_FILE_ATTRIBUTE_DATA attributes;
+      if (!GetFileAttributesExA(file_name, GetFileExInfoStandard, &attributes)) return 0;
+      return ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
     #else
+      struct stat st;
+      if (stat(file_name, &st) != 0) return 0;
+      return (uint64_t)st.st_mtime;
     #endif
   }
 
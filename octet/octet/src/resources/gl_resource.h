@@ -9,6 +9,12 @@
 
 namespace octet { namespace resources {
   /// Wrapper for an OpenGL resource.
+  ///
+  /// Buffers allocated with GL_DYNAMIC_DRAW or GL_STREAM_DRAW are for data rewritten every frame.
+  /// A write-only lock on them never waits for the GPU to finish with the old contents:
+  /// where fences are available, writes go round a ring of buffers with one buffer per write
+  /// per frame in flight, and only wait if the GPU is frames behind; elsewhere the old storage is orphaned.
+  /// Either way the old contents are lost, so write everything the draws will read.
   class gl_resource : public resource {
     #ifdef OCTET_GLES2
       // in GLES2, we need to have a second buffer containing the data
@@ -18,11 +24,107 @@ namespace octet { namespace resources {
     #endif
 
     // This buffer object contains the bytes in GPU memory
-    GLuint buffer;
+    mutable GLuint buffer;
 
     // GL_ARRAY_BUFFER etc.
     GLuint target;
 
+    // GL_STATIC_DRAW etc.
+    GLuint usage;
+
+    #if OCTET_FENCES
+      // dynamic buffers cycle through these, buffer is ring[ring_index].
+      // The ring starts with a buffer for each frame in flight and grows when a buffer is written
+      // more than once a frame, so that we never wait for draws from the frame we are building.
+      enum { frames_in_flight = 3, max_ring = 16 };
+      mutable GLuint ring[max_ring];
+      mutable GLsync fences[max_ring]; // set when we move on from a buffer, the GPU may still be reading it until then
+      mutable unsigned ring_frames[max_ring]; // gl_state frame number of the last write to each buffer
+      mutable uint8_t ring_size;
+      mutable uint8_t ring_index;
+    #endif
+
+    // changes every time the contents may have been written, unique across all resources
+    mutable unsigned version;
+
+    static unsigned &access_next_version() { static unsigned value; return value; }
+
+    void bump_version() const {
+      version = ++access_next_version();
+    }
+
+    // bind a buffer of ours to the target. The element array binding belongs to the bound vertex array,
+    // so go back to the default one rather than changing a mesh's.
+    void bind_buffer(GLuint value) const {
+      #if OCTET_VERTEX_ARRAYS
+        if (target == GL_ELEMENT_ARRAY_BUFFER) gl_state::bind_vertex_array(0);
+      #endif
+      gl_state::bind_buffer(target, value);
+    }
+
+    #ifndef OCTET_GLES2
+      // map storage for a dynamic buffer that the GPU is not reading.
+      void *lock_next_region() const {
+        #if OCTET_FENCES
+          if (ring_size > 1) {
+            // every draw reading the current buffer has been issued by now.
+            if (fences[ring_index]) glDeleteSync(fences[ring_index]);
+            fences[ring_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            unsigned frame = gl_state::get_frame_number();
+            unsigned next = ring_index + 1u == ring_size ? 0 : ring_index + 1u;
+            bool recent = ring_frames[next] != ~0u && frame - ring_frames[next] < frames_in_flight;
+            if (recent && ring_size < max_ring) {
+              // the GPU may still be drawing from the next buffer: make another rather than wait.
+              next = ring_index + 1u;
+              for (unsigned i = ring_size; i != next; --i) {
+                ring[i] = ring[i-1];
+                fences[i] = fences[i-1];
+                ring_frames[i] = ring_frames[i-1];
+              }
+              ring_size++;
+              glGenBuffers(1, &ring[next]);
+              bind_buffer(ring[next]);
+              glBufferData(target, size, NULL, usage);
+              fences[next] = 0;
+              ring_frames[next] = ~0u;
+            }
+            bool this_frame = ring_frames[next] == frame;
+
+            ring_index = (uint8_t)next;
+            ring_frames[ring_index] = frame;
+            buffer = ring[ring_index];
+            bool idle = true;
+            if (fences[ring_index]) {
+              // only waits if the GPU is more than frames_in_flight frames behind, never for this frame's draws.
+              GLenum result = !this_frame ?
+                glClientWaitSync(fences[ring_index], GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000) :
+                GL_TIMEOUT_EXPIRED
+              ;
+              idle = result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+              glDeleteSync(fences[ring_index]);
+              fences[ring_index] = 0;
+            }
+
+            if (idle) {
+              bind_buffer(buffer);
+              return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT|GL_MAP_UNSYNCHRONIZED_BIT);
+            }
+            // the GPU may still be reading this buffer (timeout, failed wait or a full ring), so orphan it.
+          }
+        #endif
+
+        // orphan the old storage, the driver keeps it until the GPU is done with it.
+        bind_buffer(buffer);
+        glBufferData(target, size, NULL, usage);
+        #ifdef __APPLE__
+          return glMapBuffer(target, GL_WRITE_ONLY);
+        #else
+          return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+        #endif
+      }
+    #endif
+
   public:
     /// Helper class to make a write-only lock
     class wolock {
@@ -71,6 +173,12 @@ namespace octet { namespace resources {
     gl_resource(unsigned target=0, unsigned size=0) {
       buffer = 0;
       this->target = target;
+      usage = GL_STATIC_DRAW;
+      #if OCTET_FENCES
+        ring_size = 0;
+        ring_index = 0;
+      #endif
+      bump_version();
       if (size) {
         allocate(target, size);
       }
@@ -82,32 +190,77 @@ namespace octet { namespace resources {
         v.visit(bytes, atom_bytes);
       #endif
       v.visit(target, atom_target);
+      bump_version();
+    }
+
+    /// Can we use fences to know when the GPU has finished with a buffer?
+    static bool has_fences() {
+      #if !OCTET_FENCES
+        return false;
+      #elif defined(WIN32)
+        return glFenceSync != NULL && glClientWaitSync != NULL && glDeleteSync != NULL;
+      #else
+        return true;
+      #endif
     }
 
     /// Allocate a new OpenGL object.
+    /// kind is GL_STATIC_DRAW, or GL_DYNAMIC_DRAW or GL_STREAM_DRAW for buffers rewritten every frame.
     void allocate(GLuint target, size_t size, GLuint kind = GL_STATIC_DRAW) {
       reset();
-      glGenBuffers(1, &buffer);
-      glBindBuffer(target, buffer);
-      glBufferData(target, size, NULL, kind);
+      this->target = target;
+      usage = kind;
       #ifdef OCTET_GLES2
         bytes.resize(size);
       #else
         this->size = size;
       #endif
-      this->target = target;
-      glBindBuffer(target, 0);
+
+      #if OCTET_FENCES
+        ring_size = is_dynamic() && has_fences() ? frames_in_flight : 1;
+        ring_index = 0;
+        glGenBuffers(ring_size, ring);
+        for (unsigned i = 0; i != ring_size; ++i) {
+          bind_buffer(ring[i]);
+          glBufferData(target, size, NULL, kind);
+          fences[i] = 0;
+          ring_frames[i] = ~0u;
+        }
+        buffer = ring[0];
+      #else
+        glGenBuffers(1, &buffer);
+        bind_buffer(buffer);
+        glBufferData(target, size, NULL, kind);
+      #endif
+      bind_buffer(0);
+      bump_version();
     }
 
     /// Clear the OpenGL object
     void reset() {
-      if (buffer != 0) {
-        glDeleteBuffers(1, &buffer);
-      }
+      #if OCTET_FENCES
+        for (unsigned i = 0; i != ring_size; ++i) {
+          gl_state::forget_buffer(ring[i]);
+          if (fences[i]) glDeleteSync(fences[i]);
+        }
+        if (ring_size) glDeleteBuffers(ring_size, ring);
+        ring_size = 0;
+      #else
+        if (buffer != 0) {
+          gl_state::forget_buffer(buffer);
+          glDeleteBuffers(1, &buffer);
+        }
+      #endif
       #ifdef OCTET_GLES2
         bytes.reset();
       #endif
       buffer = 0;
+      bump_version();
+    }
+
+    /// Is this buffer rewritten every frame?
+    bool is_dynamic() const {
+      return usage != GL_STATIC_DRAW;
     }
 
     /// Destructor
@@ -129,6 +282,12 @@ namespace octet { namespace resources {
       #endif
     }
 
+    /// Changes whenever the contents may have changed (after a write or read-write lock, or a new allocation).
+    /// Versions are unique across all resources, so use this to know when data derived from the buffer is stale.
+    unsigned get_version() const {
+      return version;
+    }
+
     /// get the GL buffer object we are wrapping.
     GLuint get_buffer() const {
       return buffer;
@@ -140,7 +299,7 @@ namespace octet { namespace resources {
       #ifdef OCTET_GLES2
         return (const void*)&bytes[0];
       #else
-        glBindBuffer(target, buffer);
+        bind_buffer(buffer);
         #ifdef __APPLE__
           // OSX does not support glMapBufferRange 
           return glMapBuffer(target, GL_READ_ONLY);
@@ -154,7 +313,7 @@ namespace octet { namespace resources {
     /// deprecated
     void unlock_read_only() const {
       #ifndef OCTET_GLES2
-        glBindBuffer(target, buffer);
+        bind_buffer(buffer);
         glUnmapBuffer(target);
       #endif
     }
@@ -165,7 +324,7 @@ namespace octet { namespace resources {
       #ifdef OCTET_GLES2
         return (void*)&bytes[0];
       #else
-        glBindBuffer(target, buffer);
+        bind_buffer(buffer);
         #ifdef __APPLE__
           // OSX does not support glMapBufferRange 
           void *res = glMapBuffer(target, GL_READ_WRITE);
@@ -180,20 +339,24 @@ namespace octet { namespace resources {
     /// deprecated
     void unlock() const {
       #ifdef OCTET_GLES2
-        glBindBuffer(target, buffer);
+        bind_buffer(buffer);
         glBufferSubData(target, 0, bytes.size(), &bytes[0]);
       #else
         glUnmapBuffer(target);
       #endif
+      bump_version();
     }
 
-    /// get a read-write lock on this buffer
-    /// deprecated
+    /// get a write-only lock on this buffer.
+    /// Dynamic buffers lose their old contents and do not wait for the GPU.
     void *lock_write_only() const {
       #ifdef OCTET_GLES2
         return (void*)&bytes[0];
       #else
-        glBindBuffer(target, buffer);
+        if (is_dynamic()) {
+          return lock_next_region();
+        }
+        bind_buffer(buffer);
         #ifdef __APPLE__
           // OSX does not support glMapBufferRange 
           return glMapBuffer(target, GL_WRITE_ONLY);
@@ -203,20 +366,26 @@ namespace octet { namespace resources {
       #endif
     }
 
-    /// release a read-write lock
-    /// deprecated
+    /// release a write-only lock
     void unlock_write_only() const {
       #ifdef OCTET_GLES2
-        glBindBuffer(target, buffer);
-        glBufferSubData(target, 0, bytes.size(), &bytes[0]);
+        bind_buffer(buffer);
+        if (is_dynamic()) {
+          // a new store rather than waiting for draws that use the old one.
+          glBufferData(target, bytes.size(), &bytes[0], usage);
+        } else {
+          glBufferSubData(target, 0, bytes.size(), &bytes[0]);
+        }
       #else
+        bind_buffer(buffer);
         glUnmapBuffer(target);
       #endif
+      bump_version();
     }
 
-    /// bind the resource to the target
+    /// bind the resource to the target, eg. to draw with it. Index buffers bind to the current vertex array.
     void bind() const {
-      glBindBuffer(target, buffer);
+      gl_state::bind_buffer(target, buffer);
     }
 
     /// copy data into the resource
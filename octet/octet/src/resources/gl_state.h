@@ -0,0 +1,278 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Cache of OpenGL binding state
+//
+
+namespace octet { namespace resources {
+  /// Remembers the program, buffers, textures and enables last set through it and
+  /// skips calls that would set them to what they already are.
+  ///
+  /// octet's own binds go through here. If you call glBindBuffer, glUseProgram etc. yourself,
+  /// call invalidate() afterwards so that the next bind is not skipped by mistake.
+  ///
+  /// Counters of issued and skipped calls are kept for each frame (see end_frame()).
+  class gl_state {
+  public:
+    enum kind {
+      kind_program,
+      kind_buffer,
+      kind_texture,
+      kind_enable,
+      kind_query,
+      kind_vertex_array,
+      kind_framebuffer,
+      num_kinds
+    };
+
+    struct stats {
+      unsigned issued[num_kinds];
+      unsigned elided[num_kinds];
+
+      stats() {
+        reset();
+      }
+
+      void reset() {
+        memset(issued, 0, sizeof(issued));
+        memset(elided, 0, sizeof(elided));
+      }
+
+      unsigned get_issued() const {
+        unsigned total = 0;
+        for (unsigned i = 0; i != num_kinds; ++i) total += issued[i];
+        return total;
+      }
+
+      unsigned get_elided() const {
+        unsigned total = 0;
+        for (unsigned i = 0; i != num_kinds; ++i) total += elided[i];
+        return total;
+      }
+    };
+
+    enum { max_texture_slots = 16, unknown = ~0u };
+
+  private:
+    // capabilities we track with glEnable and glDisable, others are passed straight through.
+    enum { num_caps = 7 };
+
+    static int get_cap_index(GLenum cap) {
+      switch (cap) {
+        case GL_DEPTH_TEST: return 0;
+        case GL_BLEND: return 1;
+        case GL_CULL_FACE: return 2;
+        case GL_SAMPLE_ALPHA_TO_COVERAGE: return 3;
+        case GL_SAMPLE_COVERAGE: return 4;
+        case GL_SCISSOR_TEST: return 5;
+        case GL_STENCIL_TEST: return 6;
+        default: return -1;
+      }
+    }
+
+    struct state_t {
+      GLuint program;
+      GLuint vertex_array;
+      GLuint array_buffer;
+      GLuint element_buffer;
+      GLuint framebuffer;
+      unsigned active_texture;
+      GLuint textures[max_texture_slots];
+      unsigned caps[num_caps]; // 0 = disabled, 1 = enabled, unknown
+      GLint sample_buffers;
+      unsigned frame_number;
+      stats frame;
+      stats last_frame;
+
+      state_t() {
+        forget();
+        sample_buffers = -1;
+        frame_number = 0;
+      }
+
+      void forget() {
+        program = vertex_array = array_buffer = element_buffer = framebuffer = unknown;
+        active_texture = unknown;
+        for (unsigned i = 0; i != max_texture_slots; ++i) textures[i] = unknown;
+        for (unsigned i = 0; i != num_caps; ++i) caps[i] = unknown;
+      }
+    };
+
+    static state_t &get() {
+      static state_t state;
+      return state;
+    }
+
+    // count a call and return true if it needs to be made.
+    static bool check(unsigned &current, unsigned value, kind k) {
+      state_t &s = get();
+      if (current == value) {
+        s.frame.elided[k]++;
+        return false;
+      }
+      current = value;
+      s.frame.issued[k]++;
+      return true;
+    }
+
+    static GLuint *get_buffer_slot(GLenum target) {
+      state_t &s = get();
+      switch (target) {
+        case GL_ARRAY_BUFFER: return &s.array_buffer;
+        case GL_ELEMENT_ARRAY_BUFFER: return &s.element_buffer;
+        default: return NULL;
+      }
+    }
+
+  public:
+    /// glUseProgram, returns true if the call was made.
+    static bool use_program(GLuint program) {
+      if (!check(get().program, program, kind_program)) return false;
+      glUseProgram(program);
+      return true;
+    }
+
+    /// glBindBuffer, returns true if the call was made.
+    static bool bind_buffer(GLenum target, GLuint buffer) {
+      GLuint *current = get_buffer_slot(target);
+      if (!current) {
+        get().frame.issued[kind_buffer]++;
+      } else if (!check(*current, buffer, kind_buffer)) {
+        return false;
+      }
+      glBindBuffer(target, buffer);
+      return true;
+    }
+
+    /// Call before glDeleteBuffers: deleting a bound buffer unbinds it.
+    static void forget_buffer(GLuint buffer) {
+      state_t &s = get();
+      if (s.array_buffer == buffer) s.array_buffer = 0;
+      if (s.element_buffer == buffer) s.element_buffer = 0;
+    }
+
+    #if OCTET_VERTEX_ARRAYS
+      /// glBindVertexArray, returns true if the call was made.
+      /// The element array buffer belongs to the vertex array, so binding one forgets it.
+      static bool bind_vertex_array(GLuint vertex_array) {
+        state_t &s = get();
+        if (!check(s.vertex_array, vertex_array, kind_vertex_array)) return false;
+        glBindVertexArray(vertex_array);
+        s.element_buffer = unknown;
+        return true;
+      }
+
+      /// Call before glDeleteVertexArrays: deleting the bound vertex array binds zero.
+      static void forget_vertex_array(GLuint vertex_array) {
+        state_t &s = get();
+        if (s.vertex_array == vertex_array) {
+          s.vertex_array = 0;
+          s.element_buffer = unknown;
+        }
+      }
+    #endif
+
+    /// glBindFramebuffer, returns true if the call was made.
+    /// GL_SAMPLE_BUFFERS belongs to the bound framebuffer, so get_sample_buffers() asks again after a change.
+    static bool bind_framebuffer(GLenum target, GLuint framebuffer) {
+      state_t &s = get();
+      if (target != GL_FRAMEBUFFER) {
+        // a read or draw binding on its own: we no longer know what is bound to both.
+        s.framebuffer = unknown;
+        s.frame.issued[kind_framebuffer]++;
+      } else if (!check(s.framebuffer, framebuffer, kind_framebuffer)) {
+        return false;
+      }
+      glBindFramebuffer(target, framebuffer);
+      s.sample_buffers = -1;
+      return true;
+    }
+
+    /// glActiveTexture(GL_TEXTURE0 + slot)
+    static void active_texture(unsigned slot) {
+      if (!check(get().active_texture, slot, kind_texture)) return;
+      glActiveTexture(GL_TEXTURE0 + slot);
+    }
+
+    /// glBindTexture on a texture unit, returns true if the bind was made.
+    static bool bind_texture(unsigned slot, GLenum target, GLuint texture) {
+      state_t &s = get();
+      if (slot < max_texture_slots) {
+        if (s.textures[slot] == texture) {
+          s.frame.elided[kind_texture]++;
+          return false;
+        }
+        s.textures[slot] = texture;
+      }
+      active_texture(slot);
+      glBindTexture(target, texture);
+      s.frame.issued[kind_texture]++;
+      return true;
+    }
+
+    /// glEnable or glDisable.
+    static void set_enabled(GLenum cap, bool value) {
+      int index = get_cap_index(cap);
+      if (index >= 0) {
+        if (!check(get().caps[index], value ? 1 : 0, kind_enable)) return;
+      } else {
+        get().frame.issued[kind_enable]++;
+      }
+      if (value) glEnable(cap); else glDisable(cap);
+    }
+
+    static void enable(GLenum cap) {
+      set_enabled(cap, true);
+    }
+
+    static void disable(GLenum cap) {
+      set_enabled(cap, false);
+    }
+
+    /// GL_SAMPLE_BUFFERS of the bound framebuffer. glGetIntegerv waits for the GPU,
+    /// so ask only once for each binding made through bind_framebuffer().
+    static GLint get_sample_buffers() {
+      state_t &s = get();
+      if (s.sample_buffers < 0) {
+        glGetIntegerv(GL_SAMPLE_BUFFERS, &s.sample_buffers);
+        s.frame.issued[kind_query]++;
+      } else {
+        s.frame.elided[kind_query]++;
+      }
+      return s.sample_buffers;
+    }
+
+    /// Forget everything, after calling GL directly or changing context.
+    static void invalidate() {
+      state_t &s = get();
+      s.forget();
+      s.sample_buffers = -1;
+    }
+
+    /// Start counting a new frame. get_frame_stats() returns the frame just finished.
+    static void end_frame() {
+      state_t &s = get();
+      s.last_frame = s.frame;
+      s.frame.reset();
+      s.frame_number++;
+    }
+
+    /// Number of calls to end_frame() so far.
+    static unsigned get_frame_number() {
+      return get().frame_number;
+    }
+
+    /// Calls made and skipped in the last whole frame.
+    static const stats &get_frame_stats() {
+      return get().last_frame;
+    }
+
+    /// Calls made and skipped so far this frame.
+    static const stats &get_stats() {
+      return get().frame;
+    }
+  };
+}}
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// GPU time taken by a block of GL calls
+//
+
+namespace octet { namespace resources {
+  /// Measures how long the GPU spends on the GL calls between begin() and end() with GL_TIME_ELAPSED queries.
+  ///
+  /// The GPU runs a few frames behind the CPU, so asking for a result straight away would stall.
+  /// Each timer keeps a ring of queries and only reads one when GL says its result is available,
+  /// which is usually latency - 1 frames later. If it is still not ready the frame is not timed.
+  ///
+  /// Only one GL_TIME_ELAPSED query may run at a time, so timed blocks must not overlap or nest.
+  class gpu_timer : public resource {
+    enum { latency = 4 };
+
+    GLuint queries[latency];
+    bool pending[latency];
+    unsigned next;
+    bool running;
+    bool has_result;
+    float ms;
+    unsigned num_skipped;
+
+    // read the query we are about to reuse. Returns false if the GPU has not finished with it.
+    bool read(unsigned slot) {
+      #if OCTET_TIMER_QUERIES
+        if (!pending[slot]) return true;
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        GLuint ns = 0;
+        glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT, &ns);
+        ms = ns * 1e-6f;
+        has_result = true;
+        pending[slot] = false;
+      #else
+        (void)slot;
+      #endif
+      return true;
+    }
+
+  public:
+    gpu_timer() {
+      memset(queries, 0, sizeof(queries));
+      memset(pending, 0, sizeof(pending));
+      next = 0;
+      running = false;
+      has_result = false;
+      ms = 0;
+      num_skipped = 0;
+    }
+
+    ~gpu_timer() {
+      #if OCTET_TIMER_QUERIES
+        if (queries[0]) glDeleteQueries(latency, queries);
+      #endif
+    }
+
+    /// Can we time the GPU?
+    static bool has_timer_queries() {
+      #if !OCTET_TIMER_QUERIES
+        return false;
+      #elif defined(WIN32)
+        return glGenQueries != NULL && glBeginQuery != NULL && glEndQuery != NULL && glGetQueryObjectuiv != NULL;
+      #else
+        return true;
+      #endif
+    }
+
+    /// Start timing. Does nothing if the query slot is still waiting for the GPU.
+    void begin() {
+      #if OCTET_TIMER_QUERIES
+        if (running || !has_timer_queries()) return;
+        if (!queries[0]) glGenQueries(latency, queries);
+        if (!read(next)) {
+          num_skipped++;
+          return;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+        running = true;
+      #endif
+    }
+
+    /// Stop timing.
+    void end() {
+      #if OCTET_TIMER_QUERIES
+        if (!running) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % latency;
+        running = false;
+      #endif
+    }
+
+    /// Has a result come back yet?
+    bool is_valid() const {
+      return has_result;
+    }
+
+    /// Milliseconds of GPU time in the last block whose result has come back.
+    float get_ms() const {
+      return ms;
+    }
+
+    /// Number of times begin() found the GPU too far behind to start a new query.
+    unsigned get_num_skipped() const {
+      return num_skipped;
+    }
+  };
+}}
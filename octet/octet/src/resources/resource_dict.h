@@ -30,6 +30,11 @@ namespace octet { namespace resources {
     static textures_t &textures() { static textures_t instance;  return instance; }
     static sounds_t &sounds() { static sounds_t instance;  return instance; }
 
+    // shared images, keyed by url (defined in resources.inl where the scene classes are complete)
+    typedef dictionary<ref<scene::image> > images_t;
+
+    static images_t &images();
+
     static GLuint get_texture_handle_internal(unsigned gl_kind, const char *name);
 
     static unsigned u4(unsigned char *src) {
@@ -133,6 +138,28 @@ namespace octet { namespace resources {
       return result;
     }
 
+    /// Cache counters for get_shared_image().
+    struct cache_stats {
+      unsigned image_hits;
+      unsigned image_misses;
+    };
+
+    /// Hit and miss counts of the image cache since startup.
+    static cache_stats &get_cache_stats() {
+      static cache_stats instance;
+      return instance;
+    }
+
+    /// factory for images: every call with the same url returns the same image,
+    /// so the file is decoded and uploaded to GL once.
+    static scene::image *get_shared_image(const char *url);
+
+    /// Drop the cache's references to shared images.
+    /// Images still in use elsewhere stay alive until they are released.
+    static void reset_caches() {
+      images().reset();
+    }
+
     #define OCTET_CLASS(N, X) N::X *get_##X(const char *id) { resource *res = get_resource(id); return res ? res->get_##X() : 0; }
     //#pragma message("resource_dict.h")
     #include "classes.h"
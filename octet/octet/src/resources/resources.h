@@ -19,6 +19,7 @@
   // resources
   #include "../resources/file_map.h"
   #include "../resources/zip_file.h"
+  #include "../resources/gl_state.h"
   #include "../resources/app_utils.h"
   #include "../resources/visitor.h"
   #include "../resources/binary_writer.h"
@@ -28,6 +29,7 @@
   #include "../resources/resource.h"
   #include "../resources/resource_dict.h"
   #include "../resources/gl_resource.h"
+  #include "../resources/gpu_timer.h"
   #include "../resources/bitmap_font.h"
   #include "../resources/mesh_builder.h"
 
@@ -14,6 +14,7 @@ GLuint octet::resources::resource_dict::get_texture_handle_internal(unsigned gl_
   } else if (url[0] == '#') {
     return app_utils::get_solid_texture(gl_kind, url+1);
   } else {
+    OCTET_PROFILE("resource_dict::get_texture_handle");
     dynarray<uint8_t> buffer;
     dynarray<uint8_t> image;
     app_utils::get_url(buffer, url);
@@ -45,6 +46,23 @@ GLuint octet::resources::resource_dict::get_texture_handle_internal(unsigned gl_
   }
 }
 
+inline octet::resources::resource_dict::images_t &octet::resources::resource_dict::images() {
+  static images_t instance;
+  return instance;
+}
+
+inline octet::scene::image *octet::resources::resource_dict::get_shared_image(const char *url) {
+  ref<scene::image> &result = images()[url];
+  if (result) {
+    get_cache_stats().image_hits++;
+  } else {
+    OCTET_PROFILE("resource_dict::get_shared_image");
+    get_cache_stats().image_misses++;
+    result = new scene::image(url);
+  }
+  return result;
+}
+
 inline octet::resources::resource *octet::resources::resource::new_type(atom_t type) {
   switch ((int)type) {
     #define OCTET_CLASS(N, X) case atom_##X: return new X();
@@ -165,7 +165,7 @@ namespace octet { namespace scene {
       mat4t result;
       result.loadIdentity();
       if (node) {
-        mat4t worldToCamera = node->calcModelToWorld().inverse3x4();
+        mat4t worldToCamera = node->get_nodeToWorld().inverse3x4();
         result = worldToCamera * cameraToProjection;
       }
       return result;
@@ -0,0 +1,412 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Batched lines, boxes, spheres and labels for debugging
+//
+
+namespace octet { namespace scene {
+  /// Collects debug lines, boxes, spheres and text for one frame and draws them with two draw calls.
+  ///
+  /// Boxes, spheres and axes are broken into lines as they are added. All the lines of a frame go into
+  /// one growing vertex stream which is copied to a dynamic gl_resource and drawn with one GL_LINES call.
+  /// Labels are placed at the screen position of a world space point and drawn with one more call.
+  ///
+  /// With OCTET_BULLET, this is also a btIDebugDraw, so pass it to btCollisionWorld::setDebugDrawer
+  /// and call debugDrawWorld() to see shapes, contact points and constraint frames.
+  class debug_draw : public resource
+    #ifdef OCTET_BULLET
+      , public btIDebugDraw
+    #endif
+  {
+    struct line_vertex {
+      vec3p pos;
+      uint32_t color;
+    };
+
+    struct label {
+      vec3p pos;
+      uint32_t color;
+      unsigned text_offset;
+    };
+
+    typedef bitmap_font::vertex text_vertex;
+
+    enum {
+      sphere_segments = 16,
+      min_vertices = 1024,
+      label_width = 1024,   // pixels, labels do not wrap
+      label_height = 256
+    };
+
+    // this frame's lines and labels
+    dynarray<line_vertex> lines;
+    dynarray<label> labels;
+    dynarray<char> label_text;
+
+    // labels formatted for drawing
+    dynarray<text_vertex> text_vertices;
+    dynarray<uint32_t> text_indices;
+
+    ref<gl_resource> line_buffer;
+    ref<gl_resource> text_vertex_buffer;
+    ref<gl_resource> text_index_buffer;
+
+    vertex_color_shader line_shader;
+    vertex_color_shader text_shader;
+    bool shaders_ready;
+
+    ref<image> font_page;
+    ref<bitmap_font> font;
+
+    vec2 circle[sphere_segments];
+    float contact_length;
+    int debug_mode;
+    int viewport_width;
+    int viewport_height;
+
+    unsigned num_lines_drawn;
+    unsigned num_text_quads_drawn;
+
+    static uint32_t make_color(const vec4 &color) {
+      vec4 c = color.max(vec4(0, 0, 0, 0)).min(vec4(1, 1, 1, 1)) * 255.0f + vec4(0.5f, 0.5f, 0.5f, 0.5f);
+      return (uint32_t)c.x() | (uint32_t)c.y() << 8 | (uint32_t)c.z() << 16 | (uint32_t)c.w() << 24;
+    }
+
+    // make room for n more vertices, doubling the capacity to keep adding cheap.
+    line_vertex *add_vertices(unsigned n) {
+      unsigned size = lines.size();
+      if (size + n > lines.capacity()) {
+        unsigned capacity = max((unsigned)min_vertices, (unsigned)lines.capacity() * 2);
+        while (capacity < size + n) capacity *= 2;
+        lines.reserve(capacity);
+      }
+      lines.resize(size + n);
+      return &lines[size];
+    }
+
+    // copy data to a dynamic buffer, growing it by powers of two.
+    static void upload(ref<gl_resource> &buffer, GLenum target, const void *data, unsigned bytes) {
+      if (!buffer || buffer->get_size() < bytes) {
+        size_t capacity = 0x1000;
+        while (capacity < bytes) capacity *= 2;
+        if (!buffer) buffer = new gl_resource();
+        buffer->allocate(target, capacity, GL_DYNAMIC_DRAW);
+      }
+      gl_resource::wolock lock(buffer);
+      memcpy(lock.u8(), data, bytes);
+    }
+
+    void init_shaders() {
+      if (shaders_ready) return;
+      line_shader.init(false);
+      text_shader.init(true);
+      shaders_ready = true;
+    }
+
+    // format the labels at their screen positions. Returns false if there is nothing to draw.
+    bool build_text(const mat4t &worldToProjection, float vx, float vy) {
+      text_vertices.resize(0);
+      text_indices.resize(0);
+      if (labels.size() == 0 || vx <= 0 || vy <= 0) return false;
+
+      if (!font) {
+        font_page = new image("assets/courier_18_0.gif");
+        font_page->load();
+        font = new bitmap_font(font_page->get_width(), font_page->get_height(), "assets/courier_18.fnt");
+      }
+
+      for (unsigned i = 0; i != labels.size(); ++i) {
+        const label &l = labels[i];
+        vec4 clip = vec3(l.pos).xyz1() * worldToProjection;
+        if (clip.w() <= 0) continue;
+        float x = clip.x() / clip.w() * vx * 0.5f;
+        float y = clip.y() / clip.w() * vy * 0.5f;
+        if (fabsf(x) > vx * 0.5f || fabsf(y) > vy * 0.5f) continue;
+
+        const char *text = &label_text[l.text_offset];
+        unsigned max_quads = (unsigned)strlen(text);
+        unsigned first_vertex = text_vertices.size();
+        unsigned first_index = text_indices.size();
+        text_vertices.resize(first_vertex + max_quads * 4);
+        text_indices.resize(first_index + max_quads * 6);
+
+        aabb bb(vec3(x + label_width * 0.5f, y - label_height * 0.5f, 0), vec3(label_width * 0.5f, label_height * 0.5f, 0));
+        unsigned num_quads = font->build_mesh(bb, &text_vertices[first_vertex], &text_indices[first_index], max_quads, text, NULL);
+
+        text_vertices.resize(first_vertex + num_quads * 4);
+        text_indices.resize(first_index + num_quads * 6);
+        for (unsigned j = first_vertex; j != text_vertices.size(); ++j) {
+          text_vertices[j].color = l.color;
+        }
+        for (unsigned j = first_index; j != text_indices.size(); ++j) {
+          text_indices[j] += first_vertex;
+        }
+      }
+      return text_indices.size() != 0;
+    }
+
+    void draw_lines(const mat4t &worldToProjection, render_state &state) {
+      upload(line_buffer, GL_ARRAY_BUFFER, lines.data(), lines.size() * sizeof(line_vertex));
+
+      line_shader.render(worldToProjection);
+      state.set_attributes(1 << attribute_pos | 1 << attribute_color);
+      state.bind_buffer(GL_ARRAY_BUFFER, line_buffer->get_buffer());
+      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, sizeof(line_vertex), (void*)0);
+      glVertexAttribPointer(attribute_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(line_vertex), (void*)offsetof(line_vertex, color));
+      glDrawArrays(GL_LINES, 0, lines.size());
+      state.add_draw();
+    }
+
+    void draw_text(float vx, float vy, render_state &state) {
+      upload(text_vertex_buffer, GL_ARRAY_BUFFER, text_vertices.data(), text_vertices.size() * sizeof(text_vertex));
+      upload(text_index_buffer, GL_ELEMENT_ARRAY_BUFFER, text_indices.data(), text_indices.size() * sizeof(uint32_t));
+
+      // screen pixels with the origin in the middle, as text_overlay does.
+      mat4t pixelToProjection;
+      pixelToProjection.loadIdentity();
+      pixelToProjection.scale(2.0f / vx, 2.0f / vy, 1);
+      text_shader.render(pixelToProjection, 0);
+      state.bind_texture(0, GL_TEXTURE_2D, font_page->get_gl_texture());
+
+      // labels go on top of the scene.
+      gl_state::disable(GL_DEPTH_TEST);
+      state.set_attributes(1 << attribute_pos | 1 << attribute_uv | 1 << attribute_color);
+      state.bind_buffer(GL_ARRAY_BUFFER, text_vertex_buffer->get_buffer());
+      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)offsetof(text_vertex, x));
+      glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)offsetof(text_vertex, u));
+      glVertexAttribPointer(attribute_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(text_vertex), (void*)offsetof(text_vertex, color));
+      state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, text_index_buffer->get_buffer());
+      glDrawElements(GL_TRIANGLES, text_indices.size(), GL_UNSIGNED_INT, (GLvoid*)0);
+      state.add_draw(1, text_indices.size() / 3);
+      gl_state::enable(GL_DEPTH_TEST);
+    }
+
+  public:
+    debug_draw() {
+      for (unsigned i = 0; i != sphere_segments; ++i) {
+        float angle = i * (2 * 3.14159265f / sphere_segments);
+        circle[i] = vec2(cosf(angle), sinf(angle));
+      }
+      shaders_ready = false;
+      contact_length = 0.5f;
+      viewport_width = viewport_height = 0;
+      num_lines_drawn = 0;
+      num_text_quads_drawn = 0;
+      #ifdef OCTET_BULLET
+        debug_mode = DBG_DrawWireframe | DBG_DrawContactPoints | DBG_DrawConstraints;
+      #else
+        debug_mode = 0;
+      #endif
+    }
+
+    /// Forget this frame's lines and labels. Keeps the memory for the next frame.
+    void clear() {
+      lines.resize(0);
+      labels.resize(0);
+      label_text.resize(0);
+    }
+
+    /// Add a line in world space.
+    void add_line(vec3_in start, vec3_in end, vec4_in color = vec4(1, 0, 0, 1)) {
+      uint32_t c = make_color(color);
+      line_vertex *v = add_vertices(2);
+      v[0].pos = start; v[0].color = c;
+      v[1].pos = end; v[1].color = c;
+    }
+
+    /// Add a line that fades from start_color to end_color.
+    void add_line(vec3_in start, vec3_in end, vec4_in start_color, vec4_in end_color) {
+      line_vertex *v = add_vertices(2);
+      v[0].pos = start; v[0].color = make_color(start_color);
+      v[1].pos = end; v[1].color = make_color(end_color);
+    }
+
+    /// Add the twelve edges of a box in world space.
+    void add_box(const aabb &bb, vec4_in color = vec4(1, 0, 0, 1)) {
+      mat4t boxToWorld;
+      boxToWorld.loadIdentity();
+      add_box(bb, boxToWorld, color);
+    }
+
+    /// Add the twelve edges of a box in model space, eg. an oriented bounding box.
+    void add_box(const aabb &bb, const mat4t &modelToWorld, vec4_in color = vec4(1, 0, 0, 1)) {
+      vec3 pos[8];
+      vec3 center = bb.get_center();
+      vec3 half = bb.get_half_extent();
+      for (int i = 0; i != 8; ++i) {
+        vec3 corner = center + half * vec3(
+          (i & 1 ? 1.0f : -1.0f),
+          (i & 2 ? 1.0f : -1.0f),
+          (i & 4 ? 1.0f : -1.0f)
+        );
+        pos[i] = (corner.xyz1() * modelToWorld).xyz();
+      }
+
+      static const uint8_t edges[] = {
+        0, 1, 2, 3, 4, 5, 6, 7,
+        0, 2, 1, 3, 4, 6, 5, 7,
+        0, 4, 1, 5, 2, 6, 3, 7
+      };
+
+      uint32_t c = make_color(color);
+      line_vertex *v = add_vertices(24);
+      for (unsigned i = 0; i != 24; ++i) {
+        v[i].pos = pos[edges[i]];
+        v[i].color = c;
+      }
+    }
+
+    /// Add a sphere as three circles around its axes.
+    void add_sphere(vec3_in center, float radius, vec4_in color = vec4(1, 0, 0, 1)) {
+      uint32_t c = make_color(color);
+      line_vertex *v = add_vertices(sphere_segments * 6);
+      for (unsigned i = 0; i != sphere_segments; ++i) {
+        vec2 a = circle[i] * radius;
+        vec2 b = circle[(i + 1) % sphere_segments] * radius;
+        v[0].pos = center + vec3(a.x(), a.y(), 0);
+        v[1].pos = center + vec3(b.x(), b.y(), 0);
+        v[2].pos = center + vec3(0, a.x(), a.y());
+        v[3].pos = center + vec3(0, b.x(), b.y());
+        v[4].pos = center + vec3(a.y(), 0, a.x());
+        v[5].pos = center + vec3(b.y(), 0, b.x());
+        for (unsigned j = 0; j != 6; ++j) v[j].color = c;
+        v += 6;
+      }
+    }
+
+    /// Add the x, y and z axes of a matrix in red, green and blue.
+    void add_axes(const mat4t &modelToWorld, float length = 1.0f) {
+      vec3 origin = modelToWorld.w().xyz();
+      add_line(origin, origin + modelToWorld.x().xyz() * length, vec4(1, 0, 0, 1));
+      add_line(origin, origin + modelToWorld.y().xyz() * length, vec4(0, 1, 0, 1));
+      add_line(origin, origin + modelToWorld.z().xyz() * length, vec4(0, 0, 1, 1));
+    }
+
+    /// Add a label drawn on top of the scene with its top left corner at a point in world space.
+    void add_text(vec3_in pos, const char *text, vec4_in color = vec4(1, 1, 1, 1)) {
+      label l;
+      l.pos = pos;
+      l.color = make_color(color);
+      l.text_offset = label_text.size();
+      unsigned length = (unsigned)strlen(text) + 1;
+      label_text.resize(l.text_offset + length);
+      memcpy(&label_text[l.text_offset], text, length);
+      labels.push_back(l);
+    }
+
+    /// Number of lines added since the last clear().
+    unsigned get_num_lines() const {
+      return lines.size() / 2;
+    }
+
+    /// Number of labels added since the last clear().
+    unsigned get_num_labels() const {
+      return labels.size();
+    }
+
+    /// Lines and characters drawn by the last render().
+    unsigned get_num_lines_drawn() const {
+      return num_lines_drawn;
+    }
+
+    unsigned get_num_text_quads_drawn() const {
+      return num_text_quads_drawn;
+    }
+
+    /// Size of the viewport in pixels. Labels are only drawn once this is set.
+    void set_viewport(int vx, int vy) {
+      viewport_width = vx;
+      viewport_height = vy;
+    }
+
+    /// Length of the normal drawn at each bullet contact point.
+    void set_contact_length(float value) {
+      contact_length = value;
+    }
+
+    /// Draw the lines in one call and the labels in another.
+    void render(const mat4t &worldToProjection, render_state &state) {
+      num_lines_drawn = 0;
+      num_text_quads_drawn = 0;
+      if (lines.size() == 0 && labels.size() == 0) return;
+
+      init_shaders();
+
+      // our buffers go in the default vertex array, not the last mesh's.
+      state.reset();
+      state.set_attributes(0);
+
+      if (lines.size()) {
+        draw_lines(worldToProjection, state);
+        num_lines_drawn = lines.size() / 2;
+      }
+
+      float vx = (float)viewport_width, vy = (float)viewport_height;
+      if (build_text(worldToProjection, vx, vy)) {
+        draw_text(vx, vy, state);
+        num_text_quads_drawn = text_indices.size() / 6;
+      }
+
+      state.set_attributes(0);
+      state.reset();
+    }
+
+    #ifdef OCTET_BULLET
+      static vec3 get_vec3(const btVector3 &v) {
+        return vec3(v.x(), v.y(), v.z());
+      }
+
+      static vec4 get_color(const btVector3 &v) {
+        return vec4(v.x(), v.y(), v.z(), 1);
+      }
+
+      /// btIDebugDraw: the shapes and constraints of a world.
+      void drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color) {
+        add_line(get_vec3(from), get_vec3(to), get_color(color));
+      }
+
+      void drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &fromColor, const btVector3 &toColor) {
+        add_line(get_vec3(from), get_vec3(to), get_color(fromColor), get_color(toColor));
+      }
+
+      void drawSphere(const btVector3 &p, btScalar radius, const btVector3 &color) {
+        add_sphere(get_vec3(p), radius, get_color(color));
+      }
+
+      void drawAabb(const btVector3 &from, const btVector3 &to, const btVector3 &color) {
+        add_box(aabb((get_vec3(from) + get_vec3(to)) * 0.5f, (get_vec3(to) - get_vec3(from)) * 0.5f), get_color(color));
+      }
+
+      void drawTransform(const btTransform &transform, btScalar orthoLen) {
+        mat4t modelToWorld;
+        transform.getOpenGLMatrix(modelToWorld.get());
+        add_axes(modelToWorld, orthoLen);
+      }
+
+      /// btIDebugDraw: the normal at a contact point.
+      void drawContactPoint(const btVector3 &PointOnB, const btVector3 &normalOnB, btScalar /*distance*/, int /*lifeTime*/, const btVector3 &color) {
+        vec3 pos = get_vec3(PointOnB);
+        add_line(pos, pos + get_vec3(normalOnB) * contact_length, get_color(color));
+      }
+
+      void reportErrorWarning(const char *warningString) {
+        log("bullet: %s\n", warningString);
+      }
+
+      void draw3dText(const btVector3 &location, const char *textString) {
+        add_text(get_vec3(location), textString);
+      }
+
+      void setDebugMode(int debugMode) {
+        debug_mode = debugMode;
+      }
+
+      int getDebugMode() const {
+        return debug_mode;
+      }
+    #endif
+  };
+}}
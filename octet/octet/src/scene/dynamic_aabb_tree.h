@@ -0,0 +1,481 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Dynamic AABB tree for scene queries
+//
+
+namespace octet { namespace scene {
+  /// Bounding volume hierarchy of boxes that can move.
+  ///
+  /// Each leaf (proxy) holds a box a little larger than the object ("fat" box) and a user value.
+  /// Moving an object only changes the tree when it leaves its fat box, then the leaf is
+  /// removed and reinserted. Inserts pick the sibling that grows the tree's surface area the least
+  /// and rotations keep the tree balanced, so queries visit O(log n) nodes.
+  ///
+  /// Example:
+  ///
+  ///     dynamic_aabb_tree tree;
+  ///     int proxy = tree.insert(box, my_index);
+  ///     tree.move(proxy, new_box);
+  ///     dynarray<int> hits;
+  ///     tree.query(aabb(vec3(0, 0, 0), vec3(10, 10, 10)), hits);
+  class dynamic_aabb_tree {
+  public:
+    enum { null_node = -1 };
+
+  private:
+    struct node_t {
+      vec3 min;
+      vec3 max;
+      int parent; // next free node if this node is free
+      int child[2]; // null_node for leaves
+      int height; // 0 for leaves, -1 for free nodes
+      int user; // user value of leaves
+    };
+
+    dynarray<node_t> nodes;
+    int root;
+    int free_list;
+    int num_leaves;
+
+    // how much to grow the boxes of leaves
+    float margin;
+
+    // scratch space for queries
+    dynarray<int> stack;
+
+    static float get_area(vec3_in min, vec3_in max) {
+      vec3 d = max - min;
+      return d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+    }
+
+    static bool overlaps(const node_t &n, vec3_in min, vec3_in max) {
+      return all(n.min <= max) && all(min <= n.max);
+    }
+
+    // squared distance from a point to a node's box, 0 if inside
+    static float get_squared_distance(const node_t &n, vec3_in point) {
+      vec3 d = math::max(math::max(n.min - point, point - n.max), vec3(0, 0, 0));
+      return dot(d, d);
+    }
+
+    // t where org + dir * t enters the node's box, clipped to [0, max_t], -1 if it misses.
+    // inv is 1 / dir, 0 where dir is 0.
+    static float entry_t(const node_t &n, const float *org, const float *inv, float max_t) {
+      float tmin = 0, tmax = max_t;
+      for (int i = 0; i != 3; ++i) {
+        if (inv[i] == 0) {
+          if (org[i] < n.min[i] || org[i] > n.max[i]) return -1;
+        } else {
+          float t0 = (n.min[i] - org[i]) * inv[i];
+          float t1 = (n.max[i] - org[i]) * inv[i];
+          if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+          tmin = t0 > tmin ? t0 : tmin;
+          tmax = t1 < tmax ? t1 : tmax;
+          if (tmin > tmax) return -1;
+        }
+      }
+      return tmin;
+    }
+
+    bool is_leaf(int index) const {
+      return nodes[index].child[0] == null_node;
+    }
+
+    int alloc_node() {
+      if (free_list == null_node) {
+        int index = nodes.size();
+        nodes.resize(index + 1);
+        nodes[index].height = -1;
+        nodes[index].parent = null_node;
+        free_list = index;
+      }
+      int index = free_list;
+      node_t &n = nodes[index];
+      free_list = n.parent;
+      n.parent = null_node;
+      n.child[0] = n.child[1] = null_node;
+      n.height = 0;
+      n.user = -1;
+      return index;
+    }
+
+    void free_node(int index) {
+      nodes[index].parent = free_list;
+      nodes[index].height = -1;
+      free_list = index;
+    }
+
+    // recompute the box and height of an interior node from its children
+    void refit_node(int index) {
+      node_t &n = nodes[index];
+      const node_t &a = nodes[n.child[0]];
+      const node_t &b = nodes[n.child[1]];
+      n.min = math::min(a.min, b.min);
+      n.max = math::max(a.max, b.max);
+      n.height = 1 + (a.height > b.height ? a.height : b.height);
+    }
+
+    void insert_leaf(int leaf) {
+      if (root == null_node) {
+        root = leaf;
+        nodes[root].parent = null_node;
+        return;
+      }
+
+      // find the best sibling by descending while it is cheaper than stopping here
+      vec3 leaf_min = nodes[leaf].min, leaf_max = nodes[leaf].max;
+      int index = root;
+      while (!is_leaf(index)) {
+        const node_t &n = nodes[index];
+        float area = get_area(n.min, n.max);
+        float combined_area = get_area(math::min(n.min, leaf_min), math::max(n.max, leaf_max));
+
+        // cost of making a new parent for this node and the leaf
+        float cost = 2 * combined_area;
+
+        // minimum cost of pushing the leaf further down the tree
+        float inheritance_cost = 2 * (combined_area - area);
+
+        float child_cost[2];
+        for (int i = 0; i != 2; ++i) {
+          const node_t &c = nodes[n.child[i]];
+          float new_area = get_area(math::min(c.min, leaf_min), math::max(c.max, leaf_max));
+          child_cost[i] = (is_leaf(n.child[i]) ? new_area : new_area - get_area(c.min, c.max)) + inheritance_cost;
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1]) break;
+        index = child_cost[0] < child_cost[1] ? n.child[0] : n.child[1];
+      }
+
+      // make a new parent for the sibling and the leaf
+      int sibling = index;
+      int old_parent = nodes[sibling].parent;
+      int new_parent = alloc_node();
+      nodes[new_parent].parent = old_parent;
+      nodes[new_parent].child[0] = sibling;
+      nodes[new_parent].child[1] = leaf;
+      nodes[sibling].parent = new_parent;
+      nodes[leaf].parent = new_parent;
+      refit_node(new_parent);
+
+      if (old_parent == null_node) {
+        root = new_parent;
+      } else {
+        node_t &p = nodes[old_parent];
+        p.child[p.child[0] == sibling ? 0 : 1] = new_parent;
+      }
+
+      refit_ancestors(old_parent);
+    }
+
+    void remove_leaf(int leaf) {
+      if (leaf == root) {
+        root = null_node;
+        return;
+      }
+
+      int parent = nodes[leaf].parent;
+      int grand_parent = nodes[parent].parent;
+      int sibling = nodes[parent].child[nodes[parent].child[0] == leaf ? 1 : 0];
+
+      if (grand_parent == null_node) {
+        root = sibling;
+        nodes[sibling].parent = null_node;
+        free_node(parent);
+      } else {
+        node_t &g = nodes[grand_parent];
+        g.child[g.child[0] == parent ? 0 : 1] = sibling;
+        nodes[sibling].parent = grand_parent;
+        free_node(parent);
+        refit_ancestors(grand_parent);
+      }
+    }
+
+    // walk up from index fixing boxes and heights, rotating to keep the tree balanced
+    void refit_ancestors(int index) {
+      while (index != null_node) {
+        index = balance(index);
+        refit_node(index);
+        index = nodes[index].parent;
+      }
+    }
+
+    // if one child of a is two levels taller than the other, rotate it up. returns the new root of the subtree.
+    int balance(int a) {
+      if (is_leaf(a) || nodes[a].height < 2) return a;
+
+      int b = nodes[a].child[0];
+      int c = nodes[a].child[1];
+      int diff = nodes[c].height - nodes[b].height;
+
+      if (diff > 1) return rotate(a, 1);
+      if (diff < -1) return rotate(a, 0);
+      return a;
+    }
+
+    // rotate the taller child (side) of a up to replace a.
+    int rotate(int a, int side) {
+      int c = nodes[a].child[side]; // the taller child, becomes the parent of a
+      int f = nodes[c].child[0];
+      int g = nodes[c].child[1];
+
+      // swap a and c
+      nodes[c].child[0] = a;
+      nodes[c].parent = nodes[a].parent;
+      nodes[a].parent = c;
+
+      if (nodes[c].parent == null_node) {
+        root = c;
+      } else {
+        node_t &p = nodes[nodes[c].parent];
+        p.child[p.child[0] == a ? 0 : 1] = c;
+      }
+
+      // keep the taller grandchild under c, give the shorter to a
+      int keep = nodes[f].height > nodes[g].height ? f : g;
+      int give = keep == f ? g : f;
+      nodes[c].child[1] = keep;
+      nodes[a].child[side] = give;
+      nodes[give].parent = a;
+
+      refit_node(a);
+      refit_node(c);
+      return c;
+    }
+
+  public:
+    /// Create an empty tree; leaves are grown by margin on each side.
+    dynamic_aabb_tree(float margin = 0.1f) {
+      root = null_node;
+      free_list = null_node;
+      num_leaves = 0;
+      this->margin = margin;
+    }
+
+    /// Set the amount leaf boxes grow by. Larger margins mean fewer reinserts for moving objects but looser queries.
+    void set_margin(float value) {
+      margin = value;
+    }
+
+    /// Add a box to the tree, returns a proxy used to move or remove it.
+    int insert(const aabb &box, int user) {
+      int leaf = alloc_node();
+      node_t &n = nodes[leaf];
+      vec3 fat(margin, margin, margin);
+      n.min = box.get_min() - fat;
+      n.max = box.get_max() + fat;
+      n.user = user;
+      insert_leaf(leaf);
+      num_leaves++;
+      return leaf;
+    }
+
+    /// Remove a proxy from the tree.
+    void remove(int proxy) {
+      remove_leaf(proxy);
+      free_node(proxy);
+      num_leaves--;
+    }
+
+    /// Update the box of a proxy. Returns true if the proxy left its fat box and was reinserted.
+    bool move(int proxy, const aabb &box) {
+      node_t &n = nodes[proxy];
+      vec3 min = box.get_min(), max = box.get_max();
+      if (all(n.min <= min) && all(max <= n.max)) {
+        return false;
+      }
+
+      remove_leaf(proxy);
+      vec3 fat(margin, margin, margin);
+      nodes[proxy].min = min - fat;
+      nodes[proxy].max = max + fat;
+      insert_leaf(proxy);
+      return true;
+    }
+
+    /// Get the user value of a proxy.
+    int get_user(int proxy) const {
+      return nodes[proxy].user;
+    }
+
+    /// Get the fat box of a proxy.
+    aabb get_fat_aabb(int proxy) const {
+      const node_t &n = nodes[proxy];
+      return aabb((n.min + n.max) * 0.5f, (n.max - n.min) * 0.5f);
+    }
+
+    /// Number of proxies in the tree.
+    int get_num_leaves() const {
+      return num_leaves;
+    }
+
+    /// Height of the tree, 0 for a single leaf, -1 if empty.
+    int get_height() const {
+      return root == null_node ? -1 : nodes[root].height;
+    }
+
+    /// Remove all the proxies.
+    void reset() {
+      nodes.reset();
+      root = null_node;
+      free_list = null_node;
+      num_leaves = 0;
+    }
+
+    /// Append the user values of proxies whose fat boxes overlap this box.
+    void query(const aabb &box, dynarray<int> &result) {
+      if (root == null_node) return;
+      vec3 min = box.get_min(), max = box.get_max();
+      stack.resize(0);
+      stack.push_back(root);
+      while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const node_t &n = nodes[index];
+        if (!overlaps(n, min, max)) continue;
+        if (n.child[0] == null_node) {
+          result.push_back(n.user);
+        } else {
+          stack.push_back(n.child[0]);
+          stack.push_back(n.child[1]);
+        }
+      }
+    }
+
+    /// Append the user values of proxies whose fat boxes touch this sphere.
+    void query(const sphere &sph, dynarray<int> &result) {
+      if (root == null_node) return;
+      vec3 center = sph.get_center();
+      float radius2 = sph.get_radius() * sph.get_radius();
+      stack.resize(0);
+      stack.push_back(root);
+      while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const node_t &n = nodes[index];
+        if (get_squared_distance(n, center) > radius2) continue;
+        if (n.child[0] == null_node) {
+          result.push_back(n.user);
+        } else {
+          stack.push_back(n.child[0]);
+          stack.push_back(n.child[1]);
+        }
+      }
+    }
+
+    /// Append the user values of proxies whose fat boxes the ray segment passes through.
+    void query(const ray &the_ray, dynarray<int> &result) {
+      if (root == null_node) return;
+      vec3 start = the_ray.get_start(), distance = the_ray.get_end() - start;
+      float o[3] = { start.x(), start.y(), start.z() };
+      float inv[3];
+      for (int i = 0; i != 3; ++i) {
+        inv[i] = distance[i] != 0 ? 1.0f / distance[i] : 0;
+      }
+      stack.resize(0);
+      stack.push_back(root);
+      while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const node_t &n = nodes[index];
+        if (entry_t(n, o, inv, 1) < 0) continue;
+        if (n.child[0] == null_node) {
+          result.push_back(n.user);
+        } else {
+          stack.push_back(n.child[0]);
+          stack.push_back(n.child[1]);
+        }
+      }
+    }
+
+    /// Find the nearest hit along org + dir * t for 0 <= t < max_distance, visiting nearer boxes first.
+    /// cast(user, max_t) tests one object and returns the t of its hit, or max_t if it is missed;
+    /// every hit shortens the search. On return max_distance is the nearest hit, the result is its user value or -1.
+    /// Does not use the scratch stack, so any number of threads may call this at once.
+    template <class cast_fn> int ray_cast(vec3_in org, vec3_in dir, float &max_distance, cast_fn &cast) const {
+      if (root == null_node) return -1;
+      float max_t = max_distance;
+      float o[3] = { org.x(), org.y(), org.z() };
+      float inv[3];
+      for (int i = 0; i != 3; ++i) {
+        inv[i] = dir[i] != 0 ? 1.0f / dir[i] : 0;
+      }
+
+      // the tree is balanced, so 64 levels covers any number of leaves we could store
+      enum { max_stack = 64 };
+      int stack[max_stack];
+      float stack_t[max_stack]; // where the ray enters each box
+      int sp = 0;
+      int best = -1;
+      float root_t = entry_t(nodes[root], o, inv, max_t);
+      if (root_t < 0) return -1;
+      stack[sp] = root;
+      stack_t[sp++] = root_t;
+      while (sp) {
+        --sp;
+        // skip boxes that are beyond a hit found since they were pushed
+        if (stack_t[sp] >= max_t) continue;
+        const node_t &n = nodes[stack[sp]];
+        if (n.child[0] == null_node) {
+          float t = cast(n.user, max_t);
+          if (t < max_t) {
+            max_t = t;
+            best = n.user;
+          }
+          continue;
+        }
+        // push the further child first so that the nearer one is popped first
+        float t0 = entry_t(nodes[n.child[0]], o, inv, max_t);
+        float t1 = entry_t(nodes[n.child[1]], o, inv, max_t);
+        int near_child = n.child[0], far_child = n.child[1];
+        if (t1 >= 0 && (t0 < 0 || t1 < t0)) {
+          near_child = n.child[1];
+          far_child = n.child[0];
+          float tmp = t0; t0 = t1; t1 = tmp;
+        }
+        if (t1 >= 0 && sp < max_stack) { stack[sp] = far_child; stack_t[sp++] = t1; }
+        if (t0 >= 0 && sp < max_stack) { stack[sp] = near_child; stack_t[sp++] = t0; }
+      }
+      max_distance = max_t;
+      return best;
+    }
+
+    /// Find the user value of the nearest proxy to a point, or -1 if none is within max_distance.
+    /// get_distance2(user, point) returns the exact squared distance to the object,
+    /// which must not be less than the distance to its box.
+    template <class distance_fn> int find_nearest(vec3_in point, float max_distance, distance_fn &get_distance2) {
+      if (root == null_node) return -1;
+      int best = -1;
+      float best_distance2 = max_distance * max_distance;
+      stack.resize(0);
+      stack.push_back(root);
+      while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        const node_t &n = nodes[index];
+        if (get_squared_distance(n, point) > best_distance2) continue;
+        if (n.child[0] == null_node) {
+          float d2 = get_distance2(n.user, point);
+          if (d2 <= best_distance2) {
+            best_distance2 = d2;
+            best = n.user;
+          }
+        } else {
+          // visit the nearer child first so that it shrinks the search for the other
+          int first = n.child[0], second = n.child[1];
+          if (get_squared_distance(nodes[second], point) < get_squared_distance(nodes[first], point)) {
+            first = n.child[1];
+            second = n.child[0];
+          }
+          stack.push_back(second);
+          stack.push_back(first);
+        }
+      }
+      return best;
+    }
+  };
+}}
@@ -214,7 +214,7 @@ namespace octet { namespace scene {
     }
 
     void add_texture() {
-      glBindTexture(gl_target, gl_texture);
+      gl_state::bind_texture(0, gl_target, gl_texture);
 
       if (mip_levels == 1 || gl_target != GL_TEXTURE_2D) {
         if (gl_target == GL_TEXTURE_2D) {
@@ -335,6 +335,7 @@ namespace octet { namespace scene {
     }
 
     void load_part(const char *_url) {
+      OCTET_PROFILE("image::load");
       dynarray<uint8_t> buffer;
       app_utils::get_url(buffer, _url);
       const unsigned char *src = &buffer[0];
@@ -373,13 +374,12 @@ namespace octet { namespace scene {
 
         // make a new texture handle
         glGenTextures(1, &gl_texture);
-        glActiveTexture(GL_TEXTURE0);
 
         // todo: handle compressed textures
         if (format == GL_RGB || format == GL_RGBA) {
           add_texture();
         } else if (format == COMPRESSED_RGB_S3TC_DXT1_EXT || format == COMPRESSED_RGBA_S3TC_DXT1_EXT || format == COMPRESSED_RGBA_S3TC_DXT3_EXT || format == COMPRESSED_RGBA_S3TC_DXT5_EXT) {
-          glBindTexture(gl_target, gl_texture);
+          gl_state::bind_texture(0, gl_target, gl_texture);
           unsigned w = width;
           unsigned h = height;
           uint8_t *src = &bytes[0];
@@ -413,7 +413,7 @@ namespace octet { namespace scene {
     void reload(GLuint format, GLuint type, void *pixels) {
       if (gl_target == 0) return;
 
-      glBindTexture(gl_target, gl_texture);
+      gl_state::bind_texture(0, gl_target, gl_texture);
       glTexSubImage2D(gl_target, 0, 0, 0, width, height, format, type, pixels);
     }
   };
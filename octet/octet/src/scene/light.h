@@ -93,7 +93,7 @@ namespace octet { namespace scene {
     /// Compute parameters for a fragment shader.
     /// in the fragment shader, we give the position and direction for diffuse and specular calculation
     void get_fragment_uniforms(scene_node *node, vec4 *uniforms, const mat4t &worldToCamera) {
-      mat4t lightToCamera = node->calcModelToWorld() * worldToCamera;
+      mat4t lightToCamera = node->get_nodeToWorld() * worldToCamera;
       uniforms[0] = lightToCamera.w();
       uniforms[1] = lightToCamera.z();
       uniforms[2] = color;
@@ -27,6 +27,19 @@ namespace octet { namespace scene {
     int dynamic_size;
     int static_size;
 
+    // where the parameters go in the main (0) and instanced (1) programs
+    uniform_table tables[2];
+
+    // changes when the static buffer or the user uniforms change, unique across all materials
+    // so that a new material at the address of a deleted one never matches a shader's uniform owner.
+    unsigned version;
+
+    static unsigned &access_next_version() { static unsigned value; return value; }
+
+    void bump_version() {
+      version = ++access_next_version();
+    }
+
     // create the parameters that change frequently such as the matrices and lighting
     void create_dynamic_params() {
       static_buffer.resize(0x100);
@@ -48,6 +61,26 @@ namespace octet { namespace scene {
       params.push_back(new param_attribute(atom_normal, GL_FLOAT_VEC3));
     }
 
+    // the table for the main (0) or instanced (1) shader, built when the program or parameters change.
+    const uniform_table &get_table(unsigned which, shader *shdr) {
+      uniform_table &table = tables[which];
+      if (!table.is_valid(shdr->get_program(), params.size())) {
+        table.init(shdr->get_program(), params);
+      }
+      return table;
+    }
+
+    // set the uniforms of the current program that come from this material, if it does not already have them.
+    // returns the number of glUniform calls.
+    unsigned render_material(shader *shdr, const uniform_table &table) {
+      if (!shdr->set_uniform_owner(this, version)) return 0;
+      return table.render_material(dynamic_buffer.data(), static_buffer.data());
+    }
+
+    void init_tables() {
+      bump_version();
+    }
+
   public:
     RESOURCE_META(material)
 
@@ -59,10 +92,12 @@ namespace octet { namespace scene {
 
     /// Default constructor makes a blank material.
     material() {
+      init_tables();
     }
 
     /// Alternative constructor.
     material(const vec4 &color, param_shader *shader = NULL) {
+      init_tables();
       // materials are constructed from parameters which build the final shader.
       // this allows us to use OpenGLES2 (uniforms) and 3 (buffers) as well as new shader features.
       params.reserve(16);
@@ -83,6 +118,7 @@ namespace octet { namespace scene {
 
     /// create a material from an existing image
     material(image *img, sampler *smpl = NULL, param_shader *shader = NULL) {
+      init_tables();
       if (!smpl) smpl = new sampler();
 
       params.reserve(16);
@@ -102,6 +138,7 @@ namespace octet { namespace scene {
     }
 
     material(param *diffuse, param *ambient, param *emission, param *specular, param *bump, param *shininess) {
+      init_tables();
     }
 
     /// Serialize.
@@ -110,42 +147,56 @@ namespace octet { namespace scene {
 
     /// Set the uniforms for this material.
     void render(const mat4t &modelToProjection, const mat4t &modelToCamera, vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
-      /*char tmp[256];
-      log("lu[0] = %s\n", light_uniforms[0].toString(tmp, sizeof(tmp)));
-      log("lu[1] = %s\n", light_uniforms[1].toString(tmp, sizeof(tmp)));
-      log("lu[2] = %s\n", light_uniforms[2].toString(tmp, sizeof(tmp)));
-      log("lu[3] = %s\n", light_uniforms[3].toString(tmp, sizeof(tmp)));*/
-      {
-        // matrices and lighting go in the dynamic uniform buffer
-        param_uniform *modelToProjection_param = get_param_uniform(atom_modelToProjection);
-        if (modelToProjection_param) modelToProjection_param->set_value(dynamic_buffer.data(), modelToProjection.get(), sizeof(modelToProjection));
-
-        param_uniform *modelToCamera_param = get_param_uniform(atom_modelToCamera);
-        if (modelToCamera_param) modelToCamera_param->set_value(dynamic_buffer.data(), modelToCamera.get(), sizeof(modelToCamera));
-
-        param_uniform *lighting_param = get_param_uniform(atom_lighting);
-        if (lighting_param) lighting_param->set_value(dynamic_buffer.data(), light_uniforms, sizeof(vec4) * num_light_uniforms);
-
-        param_uniform *num_lights_param = get_param_uniform(atom_num_lights);
-        if (num_lights_param) num_lights_param->set_value(dynamic_buffer.data(), &num_lights, sizeof(int32_t));
-      }
-
       custom_shader->render();
 
-      {
-        // colours and textures go in the static uniform buffer
-        for (unsigned i = 0; i != params.size(); ++i) {
-          param_uniform *pu = params[i]->get_param_uniform();
-          if (pu) {
-            //printf("%s: %d\n", pu->get_name(), pu->get_uniform_buffer_index());
-            if (pu->get_uniform_buffer_index()) {
-              pu->render(static_buffer.data());
-            } else {
-              pu->render(dynamic_buffer.data());
-            }
-          }
-        }
-      }
+      const uniform_table &table = get_table(0, custom_shader);
+      render_material(custom_shader, table);
+      table.render_lighting(light_uniforms, num_light_uniforms, num_lights);
+      table.render_matrices(modelToProjection, modelToCamera);
+      table.bind_textures();
+    }
+
+    /// Bind the shader and set the colours, textures and lighting through a render_state.
+    /// Call render_matrices() for each object drawn with this material.
+    void render_static(vec4 *light_uniforms, int num_light_uniforms, int num_lights, render_state &state) {
+      state.use_program(custom_shader->get_program());
+
+      const uniform_table &table = get_table(0, custom_shader);
+      state.add_uniform_uploads(render_material(custom_shader, table));
+      state.add_uniform_uploads(table.render_lighting(light_uniforms, num_light_uniforms, num_lights));
+      table.bind_textures(state);
+    }
+
+    /// The program for drawing many objects with this material in one call, or 0 if the shader can't.
+    GLuint get_instanced_program() {
+      return custom_shader ? custom_shader->get_instanced_program() : 0;
+    }
+
+    /// Bind the instanced shader and set everything but the per object matrices, which come from the instance buffer.
+    /// Returns false if the shader has no instanced variant.
+    bool render_instanced_static(const mat4t &cameraToProjection, vec4 *light_uniforms, int num_light_uniforms, int num_lights, render_state &state) {
+      shader *instanced = custom_shader ? custom_shader->get_instanced_shader() : NULL;
+      if (!instanced) return false;
+
+      state.use_program(instanced->get_program());
+
+      const uniform_table &table = get_table(1, instanced);
+      state.add_uniform_uploads(render_material(instanced, table));
+      state.add_uniform_uploads(table.render_lighting(light_uniforms, num_light_uniforms, num_lights));
+      table.render_cameraToProjection(cameraToProjection);
+      state.add_uniform_uploads(1);
+      table.bind_textures(state);
+      return true;
+    }
+
+    /// Set the matrices for one object after render_static().
+    void render_matrices(const mat4t &modelToProjection, const mat4t &modelToCamera) {
+      tables[0].render_matrices(modelToProjection, modelToCamera);
+    }
+
+    /// The OpenGL program used by this material.
+    GLuint get_program() const {
+      return custom_shader ? custom_shader->get_program() : 0;
     }
 
     /// Set the uniforms for this material on skinned meshes.
@@ -174,11 +225,14 @@ namespace octet { namespace scene {
     void set_diffuse(const vec4 &color) {
       if (param *p = get_param_uniform(atom_diffuse)) {
         p->get_param_uniform()->set_value(static_buffer.data(), &color, sizeof(color));
+        bump_version();
       }
     }
 
+    /// set the value of a uniform added with add_uniform()
     void set_uniform(param_uniform *param, void *data, size_t size) {
       memcpy(dynamic_buffer.data() + param->get_offset(), data, size);
+      bump_version();
     }
 
     dynarray<ref<param> > &get_params() {
@@ -191,6 +245,7 @@ namespace octet { namespace scene {
       param_uniform *result = new param_uniform(pbi, data, name, _type, _repeat, _stage);
       params.push_back(result);
       dynamic_size = pbi.size;
+      bump_version();
 
       param_bind_info pbind;
       pbind.program = custom_shader->get_program();
@@ -47,6 +47,19 @@ namespace octet { namespace scene {
     // bounding box
     aabb mesh_aabb;
 
+    // optional triangle tree for ray_cast, built on demand
+    ref<mesh_bvh> bvh;
+    bool use_bvh;
+
+    // meshes smaller than this are quicker to ray cast without a tree
+    enum { min_bvh_triangles = 32 };
+
+    // attribute setup kept by GL, built on demand and rebuilt when the layout or buffers change
+    mutable GLuint vertex_array;
+    mutable unsigned vertex_array_mask; // attributes enabled in the vertex array
+    mutable GLuint vertex_array_buffers[2]; // vertex and index buffers in the vertex array, dynamic buffers change them
+    mutable bool vertex_array_valid;
+
     struct general_vertex {
       const uint8_t *bytes;
       unsigned size;
@@ -117,10 +130,12 @@ namespace octet { namespace scene {
 
     /// make a new, empty, mesh.
     mesh(skin *_skin=0) {
+      vertex_array = 0;
       init(_skin, 0, 0);
     }
 
     mesh(unsigned num_vertices, unsigned num_indices) {
+      vertex_array = 0;
       init(0, num_vertices, num_indices);
     }
 
@@ -138,10 +153,17 @@ namespace octet { namespace scene {
       v.visit(num_slots, atom_num_slots);
       v.visit(mesh_skin, atom_mesh_skin);
       v.visit(mesh_aabb, atom_aabb);
+      invalidate_vertex_array();
     }
 
     // Destructor
     ~mesh() {
+      #if OCTET_VERTEX_ARRAYS
+        if (vertex_array) {
+          gl_state::forget_vertex_array(vertex_array);
+          glDeleteVertexArrays(1, &vertex_array);
+        }
+      #endif
     }
 
     // Init function used for aggregated meshes. (Deprecated).
@@ -164,6 +186,12 @@ namespace octet { namespace scene {
 
       mesh_skin = _skin;
 
+      bvh = 0;
+      use_bvh = true;
+
+      vertex_array_mask = 0;
+      invalidate_vertex_array();
+
       if (max_vertices || max_indices) {
         set_default_attributes();
         allocate(max_vertices * sizeof(vertex), max_indices * sizeof(uint32_t));
@@ -181,6 +209,7 @@ namespace octet { namespace scene {
     /// reset the mesh to empty.
     void clear_attributes() {
       num_slots = 0;
+      invalidate_vertex_array();
     }
 
     /// Add an extra attribute to the mesh. eg. add_attribute(attribute_pos, 3, GL_FLOAT, 0)
@@ -188,6 +217,7 @@ namespace octet { namespace scene {
       assert(num_slots < max_slots);
       format[num_slots] = (offset << 9) + (attr << 5) + ((size-1) << 3) + (kind - GL_BYTE);
       if (norm) normalized |= 1 << num_slots;
+      invalidate_vertex_array();
       return num_slots++;
     }
 
@@ -237,6 +267,17 @@ namespace octet { namespace scene {
       return mode;
     }
 
+    /// Get the number of triangles drawn, zero for points and lines.
+    unsigned get_num_triangles() const {
+      unsigned n = index_type ? num_indices : num_vertices;
+      switch (mode) {
+        case GL_TRIANGLES: return n / 3;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN: return n >= 3 ? n - 2 : 0;
+        default: return 0;
+      }
+    }
+
     /// get the type of the indices (ie. GL_UNSIGNED_SHORT/GL_UNSIGNED_INT)
     unsigned get_index_type() const {
       return index_type;
@@ -246,6 +287,7 @@ namespace octet { namespace scene {
     void set_index_type(unsigned value) {
       assert(value == 0 || value == GL_UNSIGNED_SHORT || value == GL_UNSIGNED_INT);
       index_type = value;
+      invalidate_vertex_array();
     }
 
     /// Get the number of slots (attributes) we have.
@@ -416,9 +458,11 @@ namespace octet { namespace scene {
     }
 
     /// Allocate VBO and IBO objects together.
-    void allocate(size_t vsize, size_t isize) {
-      vertices->allocate(GL_ARRAY_BUFFER, vsize);
-      indices->allocate(GL_ELEMENT_ARRAY_BUFFER, isize);
+    /// Use GL_DYNAMIC_DRAW for meshes rewritten every frame with write-only locks.
+    void allocate(size_t vsize, size_t isize, GLuint kind = GL_STATIC_DRAW) {
+      vertices->allocate(GL_ARRAY_BUFFER, vsize, kind);
+      indices->allocate(GL_ELEMENT_ARRAY_BUFFER, isize, kind);
+      invalidate_vertex_array();
     }
 
     /// allocate and assign data to IBO and VBO
@@ -434,6 +478,7 @@ namespace octet { namespace scene {
       num_vertices = (uint32_t)num_vertices_;
       mode = mode_;
       index_type = index_type_;
+      invalidate_vertex_array();
     }
 
     /// dump the mesh to a file in ASCII. Used to debug mesh transforms.
@@ -457,9 +502,50 @@ namespace octet { namespace scene {
       fprintf(file, "</model>\n");
     }
 
+    /// Rebuild the vertex array on the next draw. Call this after changing the buffers
+    /// or attribute layout behind the mesh's back.
+    void invalidate_vertex_array() {
+      vertex_array_valid = false;
+    }
+
+    /// Get a vertex array object with this mesh's attributes and index buffer set up, building it if needed.
+    /// Leaves it bound. Only call this if render_state::has_vertex_arrays().
+    GLuint get_vertex_array() const {
+      #if OCTET_VERTEX_ARRAYS
+        if (!vertex_array) {
+          glGenVertexArrays(1, &vertex_array);
+          vertex_array_mask = 0;
+        }
+        gl_state::bind_vertex_array(vertex_array);
+        if (!vertex_array_valid || vertex_array_buffers[0] != vertices->get_buffer() || vertex_array_buffers[1] != indices->get_buffer()) {
+          vertex_array_buffers[0] = vertices->get_buffer();
+          vertex_array_buffers[1] = indices->get_buffer();
+          gl_state::bind_buffer(GL_ARRAY_BUFFER, vertices->get_buffer());
+          unsigned n = normalized;
+          for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
+            glVertexAttribPointer(get_attr(slot), get_size(slot), get_kind(slot), n & 1, get_stride(), (void*)(size_t)get_offset(slot));
+            n >>= 1;
+          }
+          unsigned mask = get_attribute_mask();
+          render_state::change_attributes(vertex_array_mask, mask);
+          vertex_array_mask = mask;
+          if (get_index_type()) {
+            gl_state::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices->get_buffer());
+          }
+          vertex_array_valid = true;
+        }
+      #endif
+      return vertex_array;
+    }
+
     /// When rendering a mesh, call this first to enable the attributes.
     /// assume the shader, uniforms and render params are already set up.
     void enable_attributes() const {
+      if (render_state::has_vertex_arrays()) {
+        get_vertex_array();
+        return;
+      }
+
       vertices->bind();
 
       unsigned n = normalized;
@@ -468,7 +554,7 @@ namespace octet { namespace scene {
         unsigned kind = get_kind(slot);
         unsigned attr = get_attr(slot);
         unsigned offset = get_offset(slot);
-        glVertexAttribPointer(attr, size, kind, n & 1, get_stride(), (void*)(offset));
+        glVertexAttribPointer(attr, size, kind, n & 1, get_stride(), (void*)(size_t)offset);
         glEnableVertexAttribArray(attr);
         n >>= 1;
       }
@@ -487,12 +573,104 @@ namespace octet { namespace scene {
 
     /// When rendering a mesh, call this last to disable attributes.
     void disable_attributes() {
+      #if OCTET_VERTEX_ARRAYS
+        if (render_state::has_vertex_arrays()) {
+          gl_state::bind_vertex_array(0);
+          return;
+        }
+      #endif
+
       for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
         unsigned attr = get_attr(slot);
         glDisableVertexAttribArray(attr);
       }
     }
 
+    /// Bit n is set if attribute n is used by this mesh.
+    unsigned get_attribute_mask() const {
+      unsigned mask = 0;
+      for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
+        mask |= 1 << get_attr(slot);
+      }
+      return mask;
+    }
+
+    /// Set up the attributes and index buffer through a render_state, skipping anything
+    /// already set up by the previous mesh. Attributes stay enabled until render_state::set_attributes(0).
+    /// With vertex arrays, this is one bind; call render_state::set_attributes() to go back to the default array.
+    void enable_attributes(render_state &state) const {
+      if (render_state::has_vertex_arrays()) {
+        if (state.set_mesh(this)) get_vertex_array();
+        return;
+      }
+
+      if (state.set_mesh(this)) {
+        state.bind_buffer(GL_ARRAY_BUFFER, vertices->get_buffer());
+
+        unsigned n = normalized;
+        for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
+          glVertexAttribPointer(get_attr(slot), get_size(slot), get_kind(slot), n & 1, get_stride(), (void*)(size_t)get_offset(slot));
+          n >>= 1;
+        }
+
+        if (get_index_type()) {
+          state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices->get_buffer());
+        }
+      }
+      state.set_attributes(get_attribute_mask());
+    }
+
+    /// Draw the primitives after enable_attributes(state).
+    void draw(render_state &state) const {
+      if (get_index_type()) {
+        glDrawElements(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)0);
+      } else {
+        glDrawArrays(get_mode(), 0, get_num_vertices());
+      }
+      state.add_draw(1, get_num_triangles());
+    }
+
+    /// Draw count copies of the primitives after enable_attributes(state).
+    /// Copy i takes its modelToCamera matrix from instance_buffer at offset + i * sizeof(mat4t).
+    /// Only call this if render_state::has_instancing().
+    void draw_instanced(render_state &state, GLuint instance_buffer, unsigned offset, unsigned count) const {
+      #if OCTET_INSTANCING
+        state.bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+        for (unsigned row = 0; row != 4; ++row) {
+          unsigned attr = attribute_instance_matrix + row;
+          glVertexAttribPointer(attr, 4, GL_FLOAT, GL_FALSE, sizeof(mat4t), (void*)(size_t)(offset + row * sizeof(vec4)));
+          glVertexAttribDivisor(attr, 1);
+        }
+        unsigned mask = get_attribute_mask() | 0x0f << attribute_instance_matrix;
+        if (render_state::has_vertex_arrays()) {
+          render_state::change_attributes(vertex_array_mask, mask);
+          vertex_array_mask = mask;
+        } else {
+          state.set_attributes(mask);
+        }
+
+        if (get_index_type()) {
+          glDrawElementsInstanced(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)0, count);
+        } else {
+          glDrawArraysInstanced(get_mode(), 0, get_num_vertices(), count);
+        }
+        state.add_draw(count, get_num_triangles());
+
+        // put the attributes back as enable_attributes() left them for the next plain draw of this mesh.
+        for (unsigned row = 0; row != 4; ++row) {
+          glVertexAttribDivisor(attribute_instance_matrix + row, 0);
+        }
+        if (render_state::has_vertex_arrays()) {
+          render_state::change_attributes(vertex_array_mask, get_attribute_mask());
+          vertex_array_mask = get_attribute_mask();
+        } else {
+          state.set_attributes(get_attribute_mask());
+        }
+      #else
+        (void)state; (void)instance_buffer; (void)offset; (void)count;
+      #endif
+    }
+
     /// render in one pass.
     void render() {
       enable_attributes();
@@ -699,12 +877,41 @@ namespace octet { namespace scene {
       mesh_aabb = aabb((vmax + vmin) * 0.5f, (vmax - vmin) * 0.5f);
     }
 
-    /// *very* slow ray cast.
+    /// Use a triangle tree to speed up ray_cast (default true). get_bvh() always makes one.
+    /// The tree is built by the first ray_cast and rebuilt if the vertices or indices change.
+    void set_use_bvh(bool value) {
+      use_bvh = value;
+      if (!value) bvh = 0;
+    }
+
+    /// Get the triangle tree of the mesh, building it if the vertices or indices have changed.
+    /// Returns NULL if the mesh can not be ray cast (see ray_cast).
+    /// Call this from the main thread, the tree can then be used from any thread.
+    mesh_bvh *get_bvh() {
+      unsigned pos_slot = get_slot(attribute_pos);
+      if (pos_slot == ~0u) return NULL;
+      if (get_index_type() != GL_UNSIGNED_INT) return NULL;
+      if (get_size(pos_slot) < 3) return NULL;
+      if (get_kind(pos_slot) != GL_FLOAT) return NULL;
+
+      unsigned pos_offset = get_offset(pos_slot);
+      if (!bvh || !bvh->is_valid(get_vertices(), get_indices(), stride, pos_offset, get_num_indices())) {
+        if (!bvh) bvh = new mesh_bvh();
+        gl_resource::rolock idx_lock(get_indices());
+        gl_resource::rolock vtx_lock(get_vertices());
+        bvh->build(get_vertices(), get_indices(), vtx_lock.u8(), idx_lock.u32(), stride, pos_offset, get_num_indices());
+      }
+      return bvh;
+    }
+
+    /// Ray cast against the triangles of the mesh.
+    /// Large meshes use a triangle tree (see set_use_bvh), small ones test every triangle.
     /// returns "barycentric" coordinates.
     /// eg. hit pos = bary[0] * pos0 + bary[1] * pos1 + bary[2] * pos2 (or ray.start + ray.distance * bary[3])
     /// eg. hit uv = bary[0] * uv0 + bary[1] * uv1 + bary[2] * uv2
     bool ray_cast(const ray &the_ray, int indices[], vec4 &bary_numer, float &bary_denom) {
       unsigned pos_slot = get_slot(attribute_pos);
+      if (pos_slot == ~0u) return false;
       if (get_index_type() != GL_UNSIGNED_INT) return false;
       if (get_size(pos_slot) < 3) return false;
       if (get_kind(pos_slot) != GL_FLOAT) return false;
@@ -714,6 +921,7 @@ namespace octet { namespace scene {
       //log("ray_cast: org=%s dir=%s\n", org.toString(), dir.toString());
 
       unsigned pos_offset = get_offset(pos_slot);
+      mesh_bvh *tree = use_bvh && get_num_indices() >= min_bvh_triangles * 3 ? get_bvh() : NULL;
       gl_resource::rolock idx_lock(get_indices());
       gl_resource::rolock vtx_lock(get_vertices());
       const uint32_t *idx = idx_lock.u32();
@@ -721,7 +929,30 @@ namespace octet { namespace scene {
 
       float best_denom = 0;
       vec4 best_numer(0, 0, 0, 0);
-      for (unsigned i = 0; i != get_num_indices(); i += 3) {
+      float best_t = 1e37f;
+      unsigned best_tri = ~0u;
+
+      if (tree) {
+        unsigned i = 0;
+        float t = 0;
+        if (tree->ray_cast(org, dir, i, t)) {
+          // recompute the winner exactly as below so that the results match
+          vec3 a = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+0]) - org;
+          vec3 b = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+1]) - org;
+          vec3 c = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+2]) - org;
+          vec3 d = dir;
+          best_numer = vec4(
+            dot(cross(b, c), d),
+            dot(cross(c, a), d),
+            dot(cross(a, b), d),
+            dot(cross(a, b), c)
+          );
+          best_denom = best_numer[0] + best_numer[1] + best_numer[2];
+          indices[0] = idx[i+0];
+          indices[1] = idx[i+1];
+          indices[2] = idx[i+2];
+        }
+      } else for (unsigned i = 0; i != get_num_indices(); i += 3) {
         vec3 a = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+0]) - org;
         vec3 b = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+1]) - org;
         vec3 c = (vec3)*(const vec3p*)(vtx + pos_offset + stride * idx[i+2]) - org;
@@ -753,17 +984,13 @@ namespace octet { namespace scene {
         // using a multiply lets us check the sign without using a divide.
         vec4 bary2 = numer * denom;
 
-        if (all(bary2 >= vec4(0, 0, 0, 0))) {
-          rational best_distance(best_numer[3], best_denom);
-          rational new_distance(numer[3], denom);
-          /*printf(
-            "t%d %9.3f %d %d %d  %s %s %s\n",
-            i, numer[3]/denom, idx[i+0], idx[i+1], idx[i+2],
-            (numer/denom).toString(), best_distance.toString(), new_distance.toString()
-          );*/
-
-          unsigned further = new_distance > best_distance;
-          if (!further) {
+        // triangles with no area (denom == 0) would pass the sign test and hide real hits.
+        if (denom != 0 && all(bary2 >= vec4(0, 0, 0, 0))) {
+          // the same comparison as mesh_bvh::intersect_group, so both paths pick the same triangle.
+          float t = numer[3] / denom;
+          if (t < best_t || (t == best_t && i > best_tri)) {
+            best_t = t;
+            best_tri = i;
             indices[0] = idx[i+0];
             indices[1] = idx[i+1];
             indices[2] = idx[i+2];
@@ -797,11 +1024,13 @@ namespace octet { namespace scene {
     /// set a new VBO object
     void set_vertices(gl_resource *value) {
       vertices = value;
+      invalidate_vertex_array();
     }
 
     /// set a new IBO object
     void set_indices(gl_resource *value) {
       indices = value;
+      invalidate_vertex_array();
     }
 
     /// Get all the edges in a hash map to avoid duplicates.
@@ -0,0 +1,385 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Triangle bounding volume hierarchy for ray casts
+//
+
+namespace octet { namespace scene {
+  /// Bounding volume hierarchy of the triangles of a mesh, used by mesh::ray_cast.
+  ///
+  /// The tree is built with a binned surface area heuristic. Nodes are stored in depth first
+  /// order with a skip index, so traversal needs no stack: a hit moves to the next node,
+  /// a miss jumps to the skip index. Each leaf holds up to four triangles, copied out of
+  /// the vertex buffer and stored four wide so that they can be tested together.
+  class mesh_bvh : public resource {
+    enum {
+      max_leaf_triangles = 4,
+      num_bins = 12,
+    };
+
+    struct node_t {
+      float min[3];
+      float max[3];
+      uint32_t skip; // next node if this node is missed, num_nodes at the end
+      uint32_t group; // index of the leaf's triangle group, ~0 for interior nodes
+    };
+
+    // four triangles stored as ax[4], ay[4], az[4], bx[4], ... cz[4]
+    struct group_t {
+      float pos[36];
+      uint32_t tri[4]; // first index of the triangle in the index buffer, ~0 for padding
+    };
+
+    struct build_tri {
+      vec3 min;
+      vec3 max;
+      vec3 centroid;
+      uint32_t tri;
+    };
+
+    dynarray<node_t> nodes;
+    dynarray<group_t> groups;
+
+    // what the tree was built from, see is_valid()
+    const gl_resource *vertices;
+    const gl_resource *indices;
+    unsigned vertices_version;
+    unsigned indices_version;
+    unsigned num_indices;
+    unsigned stride;
+    unsigned pos_offset;
+
+    static float get_area(vec3_in min, vec3_in max) {
+      vec3 d = max - min;
+      return d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+    }
+
+    // emit a leaf for tris [begin, end)
+    void make_leaf(unsigned node, const build_tri *tris, unsigned begin, unsigned end, const uint8_t *vtx, const uint32_t *idx) {
+      group_t &g = groups.back();
+      nodes[node].group = groups.size() - 1;
+      for (unsigned lane = 0; lane != 4; ++lane) {
+        if (begin + lane < end) {
+          uint32_t tri = tris[begin + lane].tri;
+          g.tri[lane] = tri;
+          for (unsigned v = 0; v != 3; ++v) {
+            vec3 p = *(const vec3p*)(vtx + pos_offset + stride * idx[tri + v]);
+            g.pos[v*12 + 0 + lane] = p.x();
+            g.pos[v*12 + 4 + lane] = p.y();
+            g.pos[v*12 + 8 + lane] = p.z();
+          }
+        } else {
+          // a triangle with no area never hits
+          g.tri[lane] = ~0u;
+          for (unsigned v = 0; v != 3; ++v) {
+            g.pos[v*12 + 0 + lane] = g.pos[v*12 + 4 + lane] = g.pos[v*12 + 8 + lane] = 0;
+          }
+        }
+      }
+    }
+
+    // build the subtree for tris [begin, end), return the index of its root
+    unsigned build_node(build_tri *tris, unsigned begin, unsigned end, const uint8_t *vtx, const uint32_t *idx, vec3_in epsilon) {
+      unsigned node = nodes.size();
+      nodes.resize(node + 1);
+
+      vec3 bmin = tris[begin].min, bmax = tris[begin].max;
+      vec3 cmin = tris[begin].centroid, cmax = cmin;
+      for (unsigned i = begin + 1; i != end; ++i) {
+        bmin = math::min(bmin, tris[i].min);
+        bmax = math::max(bmax, tris[i].max);
+        cmin = math::min(cmin, tris[i].centroid);
+        cmax = math::max(cmax, tris[i].centroid);
+      }
+      // grow the box a little so that rounding in the box test never misses a triangle
+      bmin = bmin - epsilon;
+      bmax = bmax + epsilon;
+      for (int i = 0; i != 3; ++i) {
+        nodes[node].min[i] = bmin[i];
+        nodes[node].max[i] = bmax[i];
+      }
+
+      unsigned split = choose_split(tris, begin, end, cmin, cmax, bmin, bmax);
+      if (split == begin) {
+        groups.resize(groups.size() + 1);
+        make_leaf(node, tris, begin, end, vtx, idx);
+      } else {
+        nodes[node].group = ~0u;
+        build_node(tris, begin, split, vtx, idx, epsilon);
+        build_node(tris, split, end, vtx, idx, epsilon);
+      }
+      nodes[node].skip = nodes.size();
+      return node;
+    }
+
+    // partition tris [begin, end) and return the split point, or begin to make a leaf
+    unsigned choose_split(build_tri *tris, unsigned begin, unsigned end, vec3_in cmin, vec3_in cmax, vec3_in bmin, vec3_in bmax) {
+      unsigned count = end - begin;
+      float leaf_cost = count <= max_leaf_triangles ? get_area(bmin, bmax) * count : 1e37f;
+      if (count <= 1) return begin;
+
+      float best_cost = leaf_cost;
+      int best_axis = -1;
+      unsigned best_bin = 0;
+
+      for (int axis = 0; axis != 3; ++axis) {
+        float lo = cmin[axis], hi = cmax[axis];
+        if (hi <= lo) continue;
+        float scale = num_bins / (hi - lo);
+
+        unsigned bin_count[num_bins] = { 0 };
+        vec3 bin_min[num_bins], bin_max[num_bins];
+        for (unsigned b = 0; b != num_bins; ++b) {
+          bin_min[b] = vec3(1e37f, 1e37f, 1e37f);
+          bin_max[b] = vec3(-1e37f, -1e37f, -1e37f);
+        }
+        for (unsigned i = begin; i != end; ++i) {
+          unsigned b = (unsigned)((tris[i].centroid[axis] - lo) * scale);
+          if (b >= num_bins) b = num_bins - 1;
+          bin_count[b]++;
+          bin_min[b] = math::min(bin_min[b], tris[i].min);
+          bin_max[b] = math::max(bin_max[b], tris[i].max);
+        }
+
+        // sweep from the right to get the cost of each right hand side
+        float right_cost[num_bins];
+        vec3 rmin(1e37f, 1e37f, 1e37f), rmax(-1e37f, -1e37f, -1e37f);
+        unsigned rcount = 0;
+        for (unsigned b = num_bins - 1; b != 0; --b) {
+          rmin = math::min(rmin, bin_min[b]);
+          rmax = math::max(rmax, bin_max[b]);
+          rcount += bin_count[b];
+          right_cost[b] = rcount ? get_area(rmin, rmax) * rcount : 0;
+        }
+
+        vec3 lmin(1e37f, 1e37f, 1e37f), lmax(-1e37f, -1e37f, -1e37f);
+        unsigned lcount = 0;
+        for (unsigned b = 1; b != num_bins; ++b) {
+          lmin = math::min(lmin, bin_min[b-1]);
+          lmax = math::max(lmax, bin_max[b-1]);
+          lcount += bin_count[b-1];
+          if (lcount == 0 || lcount == count) continue;
+          // traversal cost of one node plus the triangles weighted by the chance of visiting each side
+          float cost = get_area(bmin, bmax) + get_area(lmin, lmax) * lcount + right_cost[b];
+          if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = b;
+          }
+        }
+      }
+
+      if (best_axis == -1) {
+        if (count <= max_leaf_triangles) return begin;
+        // all the centroids are in one place: split down the middle
+        return begin + count / 2;
+      }
+
+      float lo = cmin[best_axis];
+      float scale = num_bins / (cmax[best_axis] - lo);
+      unsigned mid = begin;
+      for (unsigned i = begin; i != end; ++i) {
+        unsigned b = (unsigned)((tris[i].centroid[best_axis] - lo) * scale);
+        if (b >= num_bins) b = num_bins - 1;
+        if (b < best_bin) {
+          build_tri tmp = tris[i];
+          tris[i] = tris[mid];
+          tris[mid] = tmp;
+          mid++;
+        }
+      }
+      return mid;
+    }
+
+    // test a ray against four triangles, using the same equations as mesh::ray_cast.
+    // updates best_t and best_tri with the nearest hit.
+    static void intersect_group(const group_t &g, const float *org, const float *dir, float &best_t, uint32_t &best_tri) {
+      float t[4];
+      unsigned hit_mask = 0;
+      #if OCTET_SIMD
+        __m128 ox = _mm_set1_ps(org[0]), oy = _mm_set1_ps(org[1]), oz = _mm_set1_ps(org[2]);
+        __m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+        __m128 ax = _mm_sub_ps(_mm_loadu_ps(g.pos + 0), ox), ay = _mm_sub_ps(_mm_loadu_ps(g.pos + 4), oy), az = _mm_sub_ps(_mm_loadu_ps(g.pos + 8), oz);
+        __m128 bx = _mm_sub_ps(_mm_loadu_ps(g.pos + 12), ox), by = _mm_sub_ps(_mm_loadu_ps(g.pos + 16), oy), bz = _mm_sub_ps(_mm_loadu_ps(g.pos + 20), oz);
+        __m128 cx = _mm_sub_ps(_mm_loadu_ps(g.pos + 24), ox), cy = _mm_sub_ps(_mm_loadu_ps(g.pos + 28), oy), cz = _mm_sub_ps(_mm_loadu_ps(g.pos + 32), oz);
+
+        // cross(b, c), cross(c, a) and cross(a, b)
+        __m128 bcx = _mm_sub_ps(_mm_mul_ps(by, cz), _mm_mul_ps(bz, cy));
+        __m128 bcy = _mm_sub_ps(_mm_mul_ps(bz, cx), _mm_mul_ps(bx, cz));
+        __m128 bcz = _mm_sub_ps(_mm_mul_ps(bx, cy), _mm_mul_ps(by, cx));
+        __m128 cax = _mm_sub_ps(_mm_mul_ps(cy, az), _mm_mul_ps(cz, ay));
+        __m128 cay = _mm_sub_ps(_mm_mul_ps(cz, ax), _mm_mul_ps(cx, az));
+        __m128 caz = _mm_sub_ps(_mm_mul_ps(cx, ay), _mm_mul_ps(cy, ax));
+        __m128 abx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        __m128 aby = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        __m128 abz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+
+        __m128 n0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bcx, dx), _mm_mul_ps(bcy, dy)), _mm_mul_ps(bcz, dz));
+        __m128 n1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cax, dx), _mm_mul_ps(cay, dy)), _mm_mul_ps(caz, dz));
+        __m128 n2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, dx), _mm_mul_ps(aby, dy)), _mm_mul_ps(abz, dz));
+        __m128 n3 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, cx), _mm_mul_ps(aby, cy)), _mm_mul_ps(abz, cz));
+        __m128 denom = _mm_add_ps(_mm_add_ps(n0, n1), n2);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 ok = _mm_cmpneq_ps(denom, zero);
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(n0, denom), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(n1, denom), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(n2, denom), zero));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(_mm_mul_ps(n3, denom), zero));
+        hit_mask = (unsigned)_mm_movemask_ps(ok);
+        if (!hit_mask) return;
+        _mm_storeu_ps(t, _mm_div_ps(n3, denom));
+      #else
+        for (unsigned lane = 0; lane != 4; ++lane) {
+          float ax = g.pos[lane + 0] - org[0], ay = g.pos[lane + 4] - org[1], az = g.pos[lane + 8] - org[2];
+          float bx = g.pos[lane + 12] - org[0], by = g.pos[lane + 16] - org[1], bz = g.pos[lane + 20] - org[2];
+          float cx = g.pos[lane + 24] - org[0], cy = g.pos[lane + 28] - org[1], cz = g.pos[lane + 32] - org[2];
+          float abx = ay * bz - az * by, aby = az * bx - ax * bz, abz = ax * by - ay * bx;
+          float n0 = (by * cz - bz * cy) * dir[0] + (bz * cx - bx * cz) * dir[1] + (bx * cy - by * cx) * dir[2];
+          float n1 = (cy * az - cz * ay) * dir[0] + (cz * ax - cx * az) * dir[1] + (cx * ay - cy * ax) * dir[2];
+          float n2 = abx * dir[0] + aby * dir[1] + abz * dir[2];
+          float n3 = abx * cx + aby * cy + abz * cz;
+          float denom = n0 + n1 + n2;
+          if (denom != 0 && n0 * denom >= 0 && n1 * denom >= 0 && n2 * denom >= 0 && n3 * denom >= 0) {
+            hit_mask |= 1 << lane;
+            t[lane] = n3 / denom;
+          }
+        }
+        if (!hit_mask) return;
+      #endif
+
+      for (unsigned lane = 0; lane != 4; ++lane) {
+        if (!(hit_mask & (1 << lane))) continue;
+        // on a tie, mesh::ray_cast keeps the triangle that comes last in the index buffer
+        if (t[lane] < best_t || (t[lane] == best_t && g.tri[lane] > best_tri)) {
+          best_t = t[lane];
+          best_tri = g.tri[lane];
+        }
+      }
+    }
+
+  public:
+    /// Make an empty tree; call build() to fill it.
+    mesh_bvh() {
+      vertices = indices = 0;
+      vertices_version = indices_version = 0;
+      num_indices = stride = pos_offset = 0;
+    }
+
+    /// Build the tree from a triangle list with 32 bit indices.
+    /// vtx and idx are locked views of the vertices and indices resources.
+    void build(
+      const gl_resource *vertices, const gl_resource *indices,
+      const uint8_t *vtx, const uint32_t *idx,
+      unsigned stride, unsigned pos_offset, unsigned num_indices
+    ) {
+      this->vertices = vertices;
+      this->indices = indices;
+      this->vertices_version = vertices->get_version();
+      this->indices_version = indices->get_version();
+      this->num_indices = num_indices;
+      this->stride = stride;
+      this->pos_offset = pos_offset;
+
+      nodes.reset();
+      groups.reset();
+
+      unsigned num_tris = num_indices / 3;
+      if (num_tris == 0) return;
+
+      dynarray<build_tri> tris;
+      tris.resize(num_tris);
+      vec3 root_min(1e37f, 1e37f, 1e37f), root_max(-1e37f, -1e37f, -1e37f);
+      for (unsigned i = 0; i != num_tris; ++i) {
+        build_tri &bt = tris[i];
+        vec3 a = *(const vec3p*)(vtx + pos_offset + stride * idx[i*3+0]);
+        vec3 b = *(const vec3p*)(vtx + pos_offset + stride * idx[i*3+1]);
+        vec3 c = *(const vec3p*)(vtx + pos_offset + stride * idx[i*3+2]);
+        bt.min = math::min(math::min(a, b), c);
+        bt.max = math::max(math::max(a, b), c);
+        bt.centroid = (bt.min + bt.max) * 0.5f;
+        bt.tri = i * 3;
+        root_min = math::min(root_min, bt.min);
+        root_max = math::max(root_max, bt.max);
+      }
+
+      vec3 size = root_max - root_min;
+      float largest = size.x() > size.y() ? size.x() : size.y();
+      largest = largest > size.z() ? largest : size.z();
+      float e = largest * 1e-5f + 1e-6f;
+
+      nodes.reserve(num_tris * 2 / max_leaf_triangles + 1);
+      groups.reserve(num_tris / 2 + 1);
+      build_node(tris.data(), 0, num_tris, vtx, idx, vec3(e, e, e));
+    }
+
+    /// Is the tree still up to date with these buffers?
+    /// Any write to either resource changes its version and invalidates the tree.
+    bool is_valid(const gl_resource *vertices, const gl_resource *indices, unsigned stride, unsigned pos_offset, unsigned num_indices) const {
+      return
+        vertices == this->vertices && indices == this->indices &&
+        vertices->get_version() == vertices_version && indices->get_version() == indices_version &&
+        stride == this->stride && pos_offset == this->pos_offset && num_indices == this->num_indices
+      ;
+    }
+
+    /// Find the nearest triangle hit by points org + dir * t for 0 <= t < max_t.
+    /// Returns false if no triangle is hit, otherwise sets tri to the triangle's first index
+    /// in the index buffer and t to the hit. Const and allocation free, so safe to call from many threads.
+    bool ray_cast(vec3_in org, vec3_in dir, unsigned &tri, float &t, float max_t = 1e37f) const {
+      float o[3] = { org.x(), org.y(), org.z() };
+      float d[3] = { dir.x(), dir.y(), dir.z() };
+      float inv[3];
+      for (int i = 0; i != 3; ++i) {
+        inv[i] = d[i] != 0 ? 1.0f / d[i] : 0;
+      }
+
+      float best_t = max_t;
+      uint32_t best_tri = ~0u;
+
+      const node_t *n = nodes.data();
+      unsigned num_nodes = nodes.size();
+      unsigned i = 0;
+      while (i < num_nodes) {
+        const node_t &node = n[i];
+
+        // slab test of the box against t in [0, best_t]
+        float tmin = 0, tmax = best_t;
+        bool hit = true;
+        for (int axis = 0; axis != 3 && hit; ++axis) {
+          if (d[axis] == 0) {
+            hit = o[axis] >= node.min[axis] && o[axis] <= node.max[axis];
+          } else {
+            float t0 = (node.min[axis] - o[axis]) * inv[axis];
+            float t1 = (node.max[axis] - o[axis]) * inv[axis];
+            if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+            hit = tmin <= tmax;
+          }
+        }
+
+        if (!hit) {
+          i = node.skip;
+        } else {
+          if (node.group != ~0u) {
+            intersect_group(groups[node.group], o, d, best_t, best_tri);
+          }
+          i++;
+        }
+      }
+
+      tri = best_tri;
+      t = best_t;
+      return best_tri != ~0u;
+    }
+
+    /// Number of nodes in the tree.
+    unsigned get_num_nodes() const {
+      return nodes.size();
+    }
+  };
+}}
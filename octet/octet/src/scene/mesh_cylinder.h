@@ -49,14 +49,15 @@ namespace octet { namespace scene {
     }
 
     #ifdef OCTET_BULLET
-      /// Get a bullet shape object for this mesh
+      /// Get a bullet shape object for this mesh, shared with every primitive of the same size.
+      /// Give it back with bullet_shape_cache::release() when the body is destroyed.
       btCollisionShape *get_bullet_shape() {
-        return new btCylinderShapeZ(btVector3(cylinder.get_radius(), cylinder.get_radius(), cylinder.get_half_extent()));
+        return bullet_shape_cache::get_cylinder_z(btVector3(cylinder.get_radius(), cylinder.get_radius(), cylinder.get_half_extent()));
       }
 
-      /// Get a static bullet shape object for this mesh
+      /// Get a static bullet shape object for this mesh (the same shared shape)
       btCollisionShape *get_static_bullet_shape() {
-        return new btCylinderShapeZ(btVector3(cylinder.get_radius(), cylinder.get_radius(), cylinder.get_half_extent()));
+        return bullet_shape_cache::get_cylinder_z(btVector3(cylinder.get_radius(), cylinder.get_radius(), cylinder.get_half_extent()));
       }
     #endif
   };
@@ -11,7 +11,10 @@ namespace octet { namespace scene {
   /// Instance of a mesh in a game world; node, mesh, material and skin.
   class mesh_instance : public resource {
   public:
-    enum { flag_selected = 1 << 0 };
+    enum {
+      flag_selected = 1 << 0,
+      flag_occluder = 1 << 1, // drawn into the occlusion buffer to hide what is behind it (see visual_scene::set_occlusion_culling)
+    };
 
   private:
     // which scene_node (model to world matrix) to use in the scene
@@ -29,6 +32,8 @@ namespace octet { namespace scene {
     // assorted mesh instance booleans (see flag_*)
     unsigned flags;
 
+    static unsigned &access_change_version() { static unsigned value; return value; }
+
   public:
     RESOURCE_META(mesh_instance)
 
@@ -39,6 +44,7 @@ namespace octet { namespace scene {
       this->mat = mat;
       this->skel = skel;
       flags = 0;
+      access_change_version()++;
     }
 
     /// metadata visitor. Used for serialisation and script interface.
@@ -48,6 +54,7 @@ namespace octet { namespace scene {
       v.visit(mat, atom_mat);
       v.visit(skel, atom_skel);
       v.visit(flags, atom_flags);
+      access_change_version()++;
     }
 
     //////////////////////////////
@@ -117,13 +124,18 @@ namespace octet { namespace scene {
     unsigned get_flags() const { return flags; }
 
     /// Set the transformation for this instance.
-    void set_node(scene_node *value) { node = value; }
+    void set_node(scene_node *value) { node = value; access_change_version()++; }
 
     /// Set the mesh for this instance.
-    void set_mesh(mesh *value) { msh = value; }
+    void set_mesh(mesh *value) { msh = value; access_change_version()++; }
 
     /// Set the mesh for this instance.
-    void set_material(material *value) { mat = value; }
+    void set_material(material *value) { mat = value; access_change_version()++; }
+
+    /// Changes whenever any mesh instance is made or given a new node, mesh or material.
+    static unsigned get_change_version() {
+      return access_change_version();
+    }
 
     /// Set the skeleton for this instance.
     void set_skeleton(skeleton *value) { skel = value; }
@@ -52,14 +52,15 @@ namespace octet { namespace scene {
     }
 
     #ifdef OCTET_BULLET
-      /// Get a bullet shape object for this mesh
+      /// Get a bullet shape object for this mesh, shared with every primitive of the same size.
+      /// Give it back with bullet_shape_cache::release() when the body is destroyed.
       btCollisionShape *get_bullet_shape() {
-        return new btSphereShape(shape.get_radius());
+        return bullet_shape_cache::get_sphere(shape.get_radius());
       }
 
-      /// Get a static bullet shape object for this mesh
+      /// Get a static bullet shape object for this mesh (the same shared shape)
       btCollisionShape *get_static_bullet_shape() {
-        return new btSphereShape(shape.get_radius());
+        return bullet_shape_cache::get_sphere(shape.get_radius());
       }
     #endif
   };
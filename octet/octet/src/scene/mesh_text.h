@@ -37,6 +37,16 @@ namespace octet { namespace scene {
       text = "";
     }
 
+    /// Replace the text. Unlike format() this has no length limit.
+    void set_text(const char *value) {
+      text = value;
+    }
+
+    /// Move the box the text is formatted in (in pixels). Call update() afterwards.
+    void set_bounds(const aabb &value) {
+      bb = value;
+    }
+
     void format(const char *fmt, ...) {
       va_list list;
       va_start(list, fmt);
@@ -54,19 +64,20 @@ namespace octet { namespace scene {
 	      unsigned max_indices = max_quads * 6;
 	      unsigned vsize = sizeof(vertex) * max_vertices;
 	      unsigned isize = sizeof(uint32_t) * max_indices;
-	      allocate(vsize, isize);
+	      allocate(vsize, isize, GL_DYNAMIC_DRAW);
       }
 
-      vertex *vtx = (vertex *)get_vertices()->lock();
-      uint32_t *idx = (uint32_t *)get_indices()->lock();
-
-      unsigned num_quads = font->build_mesh(
-        bb, vtx, idx, max_quads,
-        text.c_str(), text.c_str() + text.size()
-      );
+      unsigned num_quads = 0;
+      {
+        // write-only, so we do not wait for the GPU to finish drawing the last text.
+        gl_resource::wolock vlock(get_vertices());
+        gl_resource::wolock ilock(get_indices());
+        num_quads = font->build_mesh(
+          bb, (vertex *)vlock.u8(), ilock.u32(), max_quads,
+          text.c_str(), text.c_str() + text.size()
+        );
+      }
 
-      get_vertices()->unlock();
-      get_indices()->unlock();
       set_num_indices(num_quads * 6);
       set_num_vertices(num_quads * 4);
     }
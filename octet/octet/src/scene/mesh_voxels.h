@@ -73,13 +73,18 @@ namespace octet { namespace scene {
         }
       }
 
-      allocate(sizeof(vertex)*count.num_faces*4, sizeof(uint32_t)*count.num_faces*6);
+      // keep the buffers unless they are too small, they are rewritten every time.
+      size_t vsize = sizeof(vertex)*count.num_faces*4;
+      size_t isize = sizeof(uint32_t)*count.num_faces*6;
+      if (!get_vertices()->is_dynamic() || get_vertices()->get_size() < vsize || get_indices()->get_size() < isize) {
+        allocate(vsize, isize, GL_DYNAMIC_DRAW);
+      }
       set_num_indices(count.num_faces*6);
       set_num_vertices(count.num_faces*4);
 
       mesh_iterate_faces<face_adder, subcube_dim> add;
-      add.vtx = (vertex *)get_vertices()->lock();
-      add.idx = (uint32_t *)get_indices()->lock();
+      add.vtx = (vertex *)get_vertices()->lock_write_only();
+      add.idx = (uint32_t *)get_indices()->lock_write_only();
       add.dx = vec3(voxel_size, 0.0f, 0.0f);
       add.dy = vec3(0.0f, voxel_size, 0.0f);
       add.dz = vec3(0.0f, 0.0f, voxel_size);
@@ -102,8 +107,8 @@ namespace octet { namespace scene {
 
       assert(count.num_faces == add.num_faces);
 
-      get_vertices()->unlock();
-      get_indices()->unlock();
+      get_vertices()->unlock_write_only();
+      get_indices()->unlock_write_only();
       //dump(log("voxels\n"));
     }
 
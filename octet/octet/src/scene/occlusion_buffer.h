@@ -0,0 +1,554 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Software depth buffer for occlusion culling
+//
+
+namespace octet { namespace scene {
+  /// Low resolution depth buffer of large occluders, used to skip objects hidden behind them.
+  ///
+  /// add_occluder() transforms a mesh, clips it to the near plane and bins its triangles to
+  /// screen tiles on the calling thread. rasterize() fills the tiles, on a thread_pool if given,
+  /// four pixels at a time, and builds a hierarchy holding the farthest depth of 2x2, 4x4... blocks.
+  /// is_occluded() tests a box against the hierarchy, only going to finer levels where the
+  /// coarse ones can not decide.
+  ///
+  /// Depth is stored as 1/w, which is linear in screen space: bigger is nearer, 0 is empty.
+  /// Occluders cover the pixels whose centres they cover, so they can spill half a pixel past
+  /// their edges. Boxes are grown by a pixel when testing to make up for it.
+  ///
+  /// rasterize_reference() and is_occluded_reference() do the same job one pixel at a time
+  /// with no tiles or hierarchy, for checking the fast path.
+  class occlusion_buffer {
+  public:
+    enum {
+      tile_width = 64,
+      tile_height = 32,
+      default_width = 256,
+      default_height = 128,
+      max_levels = 16,
+    };
+
+    /// Counters since the last begin().
+    struct stats {
+      unsigned occluders;
+      unsigned triangles; // after near plane clipping and dropping those that cover no pixel centres
+      unsigned tests;
+      unsigned occluded;
+    };
+
+  private:
+    // positions and triangles of an occluder mesh, copied out of its buffers.
+    class occluder_geometry : public resource {
+    public:
+      unsigned vertices_version;
+      unsigned indices_version;
+      unsigned num_indices;
+      dynarray<vec3p> positions;
+      dynarray<uint32_t> indices;
+
+      occluder_geometry() {
+        vertices_version = indices_version = 0;
+        num_indices = ~0u;
+      }
+
+      bool is_valid(mesh *msh) const {
+        gl_resource *vtx = msh->get_vertices(), *idx = msh->get_indices();
+        return
+          vertices_version == (vtx ? vtx->get_version() : 0) &&
+          indices_version == (idx ? idx->get_version() : 0) &&
+          num_indices == (msh->get_index_type() ? msh->get_num_indices() : msh->get_num_vertices())
+        ;
+      }
+
+      // only GL_TRIANGLES with float positions are copied, others are left empty.
+      void build(mesh *msh) {
+        gl_resource *vtx = msh->get_vertices(), *idx = msh->get_indices();
+        vertices_version = vtx ? vtx->get_version() : 0;
+        indices_version = idx ? idx->get_version() : 0;
+        num_indices = msh->get_index_type() ? msh->get_num_indices() : msh->get_num_vertices();
+        positions.resize(0);
+        indices.resize(0);
+
+        unsigned pos_slot = msh->get_slot(attribute_pos);
+        if (msh->get_mode() != GL_TRIANGLES || !vtx || pos_slot == ~0u) return;
+        if (msh->get_size(pos_slot) < 3 || msh->get_kind(pos_slot) != GL_FLOAT) return;
+        unsigned index_type = msh->get_index_type();
+        if (index_type && (!idx || (index_type != GL_UNSIGNED_INT && index_type != GL_UNSIGNED_SHORT))) return;
+
+        unsigned num_vertices = msh->get_num_vertices();
+        unsigned stride = msh->get_stride();
+        unsigned pos_offset = msh->get_offset(pos_slot);
+        {
+          gl_resource::rolock vtx_lock(vtx);
+          const uint8_t *src = vtx_lock.u8();
+          positions.resize(num_vertices);
+          for (unsigned i = 0; i != num_vertices; ++i) {
+            positions[i] = *(const vec3p*)(src + pos_offset + stride * i);
+          }
+        }
+
+        indices.resize(num_indices - num_indices % 3);
+        if (index_type) {
+          gl_resource::rolock idx_lock(idx);
+          for (unsigned i = 0; i != indices.size(); ++i) {
+            indices[i] = index_type == GL_UNSIGNED_INT ? idx_lock.u32()[i] : idx_lock.u16()[i];
+          }
+        } else {
+          for (unsigned i = 0; i != indices.size(); ++i) {
+            indices[i] = i;
+          }
+        }
+
+        // drop triangles that point outside the vertices.
+        for (unsigned i = 0; i != indices.size(); ++i) {
+          if (indices[i] >= num_vertices) {
+            indices.resize(0);
+            break;
+          }
+        }
+      }
+    };
+
+    // a triangle ready to draw: e = a * x + b * y + c >= 0 inside all three edges, depth = za * x + zb * y + zc.
+    // x and y are pixel numbers, the half pixel offset to the centre is in c and zc.
+    struct triangle {
+      float a[3], b[3], c[3];
+      float za, zb, zc;
+      int x0, y0, x1, y1; // pixels that may be covered, inclusive
+    };
+
+    // a vertex in screen space
+    struct screen_vertex {
+      float x, y, iw;
+    };
+
+    unsigned width;
+    unsigned height;
+    unsigned tiles_x;
+    unsigned tiles_y;
+    unsigned num_levels;
+    unsigned tile_levels; // levels that fit inside a tile, built by the tile jobs
+    unsigned level_offset[max_levels];
+    dynarray<float> depth; // every level, finest first
+
+    mat4t worldToProjection;
+    dynarray<triangle> triangles;
+    dynarray<unsigned> tile_counts; // triangles in each tile, then the start of each tile in tile_triangles
+    dynarray<unsigned> tile_triangles;
+    dynarray<vec4> clip_positions; // scratch for add_occluder
+
+    hash_map<void *, unsigned> geometry_ids;
+    dynarray<ref<occluder_geometry> > geometries;
+    mutable stats counters;
+
+    float *get_level(unsigned level) {
+      return depth.data() + level_offset[level];
+    }
+
+    const float *get_level(unsigned level) const {
+      return depth.data() + level_offset[level];
+    }
+
+    occluder_geometry *get_geometry(mesh *msh) {
+      unsigned &id = geometry_ids[(void*)msh];
+      if (id == 0) {
+        geometries.push_back(new occluder_geometry());
+        id = geometries.size();
+      }
+      occluder_geometry *geom = geometries[id - 1];
+      if (!geom->is_valid(msh)) geom->build(msh);
+      return geom;
+    }
+
+    screen_vertex to_screen(const vec4 &clip) const {
+      screen_vertex v;
+      v.iw = 1.0f / clip.w();
+      v.x = (clip.x() * v.iw * 0.5f + 0.5f) * width;
+      v.y = (clip.y() * v.iw * 0.5f + 0.5f) * height;
+      return v;
+    }
+
+    // make the edge and depth equations of a screen space triangle.
+    void add_triangle(screen_vertex v0, screen_vertex v1, screen_vertex v2) {
+      float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+      if (!(area != 0)) return;
+      if (area < 0) {
+        // occluders are drawn from both sides.
+        screen_vertex tmp = v1; v1 = v2; v2 = tmp;
+        area = -area;
+      }
+
+      triangle t;
+      t.x0 = max(0, (int)ceilf(min(v0.x, min(v1.x, v2.x)) - 0.5f));
+      t.x1 = min((int)width - 1, (int)floorf(max(v0.x, max(v1.x, v2.x)) - 0.5f));
+      t.y0 = max(0, (int)ceilf(min(v0.y, min(v1.y, v2.y)) - 0.5f));
+      t.y1 = min((int)height - 1, (int)floorf(max(v0.y, max(v1.y, v2.y)) - 0.5f));
+      if (t.x0 > t.x1 || t.y0 > t.y1) return;
+
+      // edges opposite each vertex, so that e[i] / area is the weight of vertex i.
+      const screen_vertex *v[3] = { &v0, &v1, &v2 };
+      float za = 0, zb = 0, zc = 0;
+      for (unsigned i = 0; i != 3; ++i) {
+        const screen_vertex &p = *v[(i + 1) % 3], &q = *v[(i + 2) % 3];
+        float a = p.y - q.y, b = q.x - p.x, c = p.x * q.y - p.y * q.x;
+        t.a[i] = a;
+        t.b[i] = b;
+        t.c[i] = c + (a + b) * 0.5f;
+        za += a * v[i]->iw;
+        zb += b * v[i]->iw;
+        zc += c * v[i]->iw;
+      }
+      float rarea = 1.0f / area;
+      t.za = za * rarea;
+      t.zb = zb * rarea;
+      t.zc = (zc + (za + zb) * 0.5f) * rarea;
+      triangles.push_back(t);
+    }
+
+    // clip a triangle to the near plane (z + w >= 0) and add what is left.
+    void add_clipped(const vec4 &p0, const vec4 &p1, const vec4 &p2) {
+      const vec4 *in[3] = { &p0, &p1, &p2 };
+      vec4 out[4];
+      unsigned num_out = 0;
+      for (unsigned i = 0; i != 3; ++i) {
+        const vec4 &p = *in[i], &q = *in[(i + 1) % 3];
+        float dp = p.z() + p.w(), dq = q.z() + q.w();
+        if (dp >= 0) out[num_out++] = p;
+        if ((dp >= 0) != (dq >= 0)) {
+          out[num_out++] = p + (q - p) * (dp / (dp - dq));
+        }
+      }
+      if (num_out < 3) return;
+
+      screen_vertex s[4];
+      for (unsigned i = 0; i != num_out; ++i) {
+        // a point on the near plane of an orthographic camera or at the eye can have w = 0.
+        if (!(out[i].w() > 0)) return;
+        s[i] = to_screen(out[i]);
+      }
+      add_triangle(s[0], s[1], s[2]);
+      if (num_out == 4) add_triangle(s[0], s[2], s[3]);
+    }
+
+    // the farthest depth of each 2x2 block of level - 1, for cells [x0, x1) x [y0, y1) of level.
+    void build_level(unsigned level, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+      const float *src = get_level(level - 1);
+      float *dest = get_level(level);
+      unsigned src_width = width >> (level - 1), dest_width = width >> level;
+      for (unsigned y = y0; y != y1; ++y) {
+        const float *row0 = src + (y * 2) * src_width, *row1 = row0 + src_width;
+        for (unsigned x = x0; x != x1; ++x) {
+          dest[y * dest_width + x] = min(min(row0[x * 2], row0[x * 2 + 1]), min(row1[x * 2], row1[x * 2 + 1]));
+        }
+      }
+    }
+
+    // draw triangle t into the part of the tile [tx0, tx1) x [ty0, ty1) it covers.
+    void draw_in_tile(const triangle &t, int tx0, int ty0, int tx1, int ty1) {
+      int y0 = max(t.y0, ty0), y1 = min(t.y1, ty1 - 1);
+      int x0 = max(t.x0, tx0) & ~3, x1 = min(t.x1, tx1 - 1);
+      float *level0 = get_level(0);
+      for (int y = y0; y <= y1; ++y) {
+        float fy = (float)y;
+        float *row = level0 + y * width;
+        #if OCTET_SIMD
+          __m128 lanes = _mm_setr_ps(0, 1, 2, 3), zero = _mm_setzero_ps();
+          __m128 a0 = _mm_set1_ps(t.a[0]), a1 = _mm_set1_ps(t.a[1]), a2 = _mm_set1_ps(t.a[2]), za = _mm_set1_ps(t.za);
+          __m128 r0 = _mm_set1_ps(t.b[0] * fy), r1 = _mm_set1_ps(t.b[1] * fy), r2 = _mm_set1_ps(t.b[2] * fy), rz = _mm_set1_ps(t.zb * fy);
+          __m128 c0 = _mm_set1_ps(t.c[0]), c1 = _mm_set1_ps(t.c[1]), c2 = _mm_set1_ps(t.c[2]), zc = _mm_set1_ps(t.zc);
+          __m128 xmin = _mm_set1_ps((float)t.x0), xmax = _mm_set1_ps((float)t.x1);
+          for (int x = x0; x <= x1; x += 4) {
+            __m128 fx = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+            __m128 e0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, fx), r0), c0);
+            __m128 e1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a1, fx), r1), c1);
+            __m128 e2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a2, fx), r2), c2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(fx, xmin), _mm_cmple_ps(fx, xmax)));
+            if (_mm_movemask_ps(inside) == 0) continue;
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(za, fx), rz), zc);
+            __m128 d = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_and_ps(inside, _mm_cmpgt_ps(z, d));
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, d)));
+          }
+        #else
+          float r0 = t.b[0] * fy, r1 = t.b[1] * fy, r2 = t.b[2] * fy, rz = t.zb * fy;
+          for (int x = x0; x <= x1; x += 4) {
+            for (int lane = 0; lane != 4; ++lane) {
+              int px = x + lane;
+              if (px < t.x0 || px > t.x1) continue;
+              float fx = (float)px;
+              float e0 = t.a[0] * fx + r0 + t.c[0];
+              float e1 = t.a[1] * fx + r1 + t.c[1];
+              float e2 = t.a[2] * fx + r2 + t.c[2];
+              if (e0 >= 0 && e1 >= 0 && e2 >= 0) {
+                float z = t.za * fx + rz + t.zc;
+                if (z > row[px]) row[px] = z;
+              }
+            }
+          }
+        #endif
+      }
+    }
+
+    // clear a tile, draw its triangles and build the levels that lie inside it.
+    void draw_tile(unsigned tile) {
+      int tx0 = (tile % tiles_x) * tile_width, ty0 = (tile / tiles_x) * tile_height;
+      int tx1 = tx0 + tile_width, ty1 = ty0 + tile_height;
+
+      float *level0 = get_level(0);
+      for (int y = ty0; y != ty1; ++y) {
+        memset(level0 + y * width + tx0, 0, sizeof(float) * tile_width);
+      }
+
+      const unsigned *first = tile_triangles.data() + tile_counts[tile];
+      const unsigned *last = tile_triangles.data() + tile_counts[tile + 1];
+      for (const unsigned *i = first; i != last; ++i) {
+        draw_in_tile(triangles[*i], tx0, ty0, tx1, ty1);
+      }
+
+      for (unsigned level = 1; level <= tile_levels; ++level) {
+        build_level(level, tx0 >> level, ty0 >> level, tx1 >> level, ty1 >> level);
+      }
+    }
+
+    // thread_pool job: draw tiles [begin, end)
+    static void tile_job(void *context, unsigned begin, unsigned end) {
+      OCTET_PROFILE("occlusion_buffer::tile_job");
+      occlusion_buffer *buffer = (occlusion_buffer*)context;
+      for (unsigned tile = begin; tile != end; ++tile) {
+        buffer->draw_tile(tile);
+      }
+    }
+
+    // sort the triangles into the tiles they touch.
+    void bin_triangles() {
+      unsigned num_tiles = tiles_x * tiles_y;
+      tile_counts.resize(num_tiles + 1);
+      memset(tile_counts.data(), 0, sizeof(unsigned) * (num_tiles + 1));
+      for (unsigned i = 0; i != triangles.size(); ++i) {
+        const triangle &t = triangles[i];
+        for (int ty = t.y0 / tile_height; ty <= t.y1 / tile_height; ++ty) {
+          for (int tx = t.x0 / tile_width; tx <= t.x1 / tile_width; ++tx) {
+            tile_counts[ty * tiles_x + tx + 1]++;
+          }
+        }
+      }
+      for (unsigned tile = 0; tile != num_tiles; ++tile) {
+        tile_counts[tile + 1] += tile_counts[tile];
+      }
+
+      tile_triangles.resize(tile_counts[num_tiles]);
+      for (unsigned i = 0; i != triangles.size(); ++i) {
+        const triangle &t = triangles[i];
+        for (int ty = t.y0 / tile_height; ty <= t.y1 / tile_height; ++ty) {
+          for (int tx = t.x0 / tile_width; tx <= t.x1 / tile_width; ++tx) {
+            tile_triangles[tile_counts[ty * tiles_x + tx]++] = i;
+          }
+        }
+      }
+      // filling moved each start to the end of its tile, move them back.
+      for (unsigned tile = num_tiles; tile != 0; --tile) {
+        tile_counts[tile] = tile_counts[tile - 1];
+      }
+      tile_counts[0] = 0;
+    }
+
+    // find the pixels a box covers, grown by a pixel, and its nearest depth.
+    // returns false if the box crosses the near plane or is off the screen, when it can not be occluded.
+    bool get_screen_rect(const aabb &bb, int rect[4], float &nearest) const {
+      vec3 center = bb.get_center(), half = bb.get_half_extent();
+      float xmin = 1e37f, ymin = 1e37f, xmax = -1e37f, ymax = -1e37f;
+      nearest = 0;
+      for (int i = 0; i != 8; ++i) {
+        vec3 corner = center + half * vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+        vec4 clip = corner.xyz1() * worldToProjection;
+        if (clip.z() + clip.w() < 0 || !(clip.w() > 0)) return false;
+        screen_vertex s = to_screen(clip);
+        xmin = min(xmin, s.x); xmax = max(xmax, s.x);
+        ymin = min(ymin, s.y); ymax = max(ymax, s.y);
+        nearest = max(nearest, s.iw);
+      }
+      if (xmax < 0 || ymax < 0 || xmin > width || ymin > height) return false;
+      rect[0] = max(0, (int)ceilf(xmin - 0.5f) - 1);
+      rect[1] = max(0, (int)ceilf(ymin - 0.5f) - 1);
+      rect[2] = min((int)width - 1, (int)floorf(xmax - 0.5f) + 1);
+      rect[3] = min((int)height - 1, (int)floorf(ymax - 0.5f) + 1);
+      return rect[0] <= rect[2] && rect[1] <= rect[3];
+    }
+
+    // is every pixel of rect under cell (x, y) of level nearer than depth?
+    bool is_hidden(unsigned level, int x, int y, const int rect[4], float nearest) const {
+      if (get_level(level)[y * (width >> level) + x] > nearest) return true;
+      if (level == 0) return false;
+      unsigned child = level - 1;
+      int x0 = max(x * 2, rect[0] >> child), x1 = min(x * 2 + 1, rect[2] >> child);
+      int y0 = max(y * 2, rect[1] >> child), y1 = min(y * 2 + 1, rect[3] >> child);
+      for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+          if (!is_hidden(child, cx, cy, rect, nearest)) return false;
+        }
+      }
+      return true;
+    }
+
+  public:
+    occlusion_buffer() {
+      width = height = 0;
+      memset(&counters, 0, sizeof(counters));
+    }
+
+    /// Set the size in pixels, a multiple of the tile size.
+    void init(unsigned width = default_width, unsigned height = default_height) {
+      assert(width % tile_width == 0 && height % tile_height == 0);
+      this->width = width;
+      this->height = height;
+      tiles_x = width / tile_width;
+      tiles_y = height / tile_height;
+
+      // each level halves the size while both sides are even.
+      unsigned size = 0, w = width, h = height;
+      num_levels = 0;
+      tile_levels = 0;
+      for (;;) {
+        level_offset[num_levels++] = size;
+        size += w * h;
+        if ((w & 1) || (h & 1) || num_levels == max_levels) break;
+        w /= 2;
+        h /= 2;
+        if (tile_width >> num_levels && tile_height >> num_levels) tile_levels = num_levels;
+      }
+      depth.resize(size);
+      memset(depth.data(), 0, sizeof(float) * size);
+    }
+
+    unsigned get_width() const {
+      return width;
+    }
+
+    unsigned get_height() const {
+      return height;
+    }
+
+    /// Depth (1/w) of a pixel after rasterize(), 0 where no occluder was drawn.
+    float get_depth(unsigned x, unsigned y) const {
+      return get_level(0)[y * width + x];
+    }
+
+    /// Start a frame seen through worldToProjection. Forgets the last frame's occluders.
+    void begin(const mat4t &worldToProjection) {
+      if (!width) init();
+      this->worldToProjection = worldToProjection;
+      triangles.resize(0);
+      memset(&counters, 0, sizeof(counters));
+    }
+
+    /// Add the triangles of a mesh at modelToWorld. Only GL_TRIANGLES meshes with float positions are drawn.
+    /// The positions are copied the first time a mesh is used and again if its buffers change.
+    void add_occluder(mesh *msh, const mat4t &modelToWorld) {
+      occluder_geometry *geom = get_geometry(msh);
+      if (geom->indices.size() == 0) return;
+      counters.occluders++;
+
+      mat4t modelToProjection = modelToWorld * worldToProjection;
+      unsigned num_vertices = geom->positions.size();
+      clip_positions.resize(num_vertices);
+      for (unsigned i = 0; i != num_vertices; ++i) {
+        clip_positions[i] = vec3(geom->positions[i]).xyz1() * modelToProjection;
+      }
+
+      const uint32_t *idx = geom->indices.data();
+      for (unsigned i = 0; i != geom->indices.size(); i += 3) {
+        add_clipped(clip_positions[idx[i]], clip_positions[idx[i + 1]], clip_positions[idx[i + 2]]);
+      }
+    }
+
+    /// Draw the occluders and build the hierarchy. Tiles are shared between the threads of pool if it is not NULL.
+    void rasterize(thread_pool *pool = NULL) {
+      OCTET_PROFILE("occlusion_buffer::rasterize");
+      counters.triangles = triangles.size();
+      bin_triangles();
+      unsigned num_tiles = tiles_x * tiles_y;
+      if (pool) {
+        pool->run(tile_job, this, num_tiles, 1);
+      } else {
+        tile_job(this, 0, num_tiles);
+      }
+      for (unsigned level = tile_levels + 1; level < num_levels; ++level) {
+        build_level(level, 0, 0, width >> level, height >> level);
+      }
+    }
+
+    /// Draw the occluders one pixel at a time, for checking rasterize().
+    void rasterize_reference() {
+      counters.triangles = triangles.size();
+      float *level0 = get_level(0);
+      memset(level0, 0, sizeof(float) * width * height);
+      for (unsigned i = 0; i != triangles.size(); ++i) {
+        const triangle &t = triangles[i];
+        for (int y = t.y0; y <= t.y1; ++y) {
+          float fy = (float)y;
+          for (int x = t.x0; x <= t.x1; ++x) {
+            float fx = (float)x;
+            float e0 = t.a[0] * fx + t.b[0] * fy + t.c[0];
+            float e1 = t.a[1] * fx + t.b[1] * fy + t.c[1];
+            float e2 = t.a[2] * fx + t.b[2] * fy + t.c[2];
+            if (e0 >= 0 && e1 >= 0 && e2 >= 0) {
+              float z = t.za * fx + t.zb * fy + t.zc;
+              float &d = level0[y * width + x];
+              if (z > d) d = z;
+            }
+          }
+        }
+      }
+      for (unsigned level = 1; level < num_levels; ++level) {
+        build_level(level, 0, 0, width >> level, height >> level);
+      }
+    }
+
+    /// Is the box hidden behind the occluders? Call after rasterize().
+    bool is_occluded(const aabb &bb) const {
+      counters.tests++;
+      int rect[4];
+      float nearest = 0;
+      if (!get_screen_rect(bb, rect, nearest)) return false;
+
+      // start at the finest level where the box covers at most 2x2 cells.
+      unsigned level = 0;
+      while (level + 1 < num_levels && (((rect[2] >> level) - (rect[0] >> level)) > 1 || ((rect[3] >> level) - (rect[1] >> level)) > 1)) {
+        level++;
+      }
+      for (int y = rect[1] >> level; y <= rect[3] >> level; ++y) {
+        for (int x = rect[0] >> level; x <= rect[2] >> level; ++x) {
+          if (!is_hidden(level, x, y, rect, nearest)) return false;
+        }
+      }
+      counters.occluded++;
+      return true;
+    }
+
+    /// Is the box hidden behind the occluders? Tests every pixel, for checking is_occluded().
+    bool is_occluded_reference(const aabb &bb) const {
+      counters.tests++;
+      int rect[4];
+      float nearest = 0;
+      if (!get_screen_rect(bb, rect, nearest)) return false;
+      const float *level0 = get_level(0);
+      for (int y = rect[1]; y <= rect[3]; ++y) {
+        for (int x = rect[0]; x <= rect[2]; ++x) {
+          if (!(level0[y * width + x] > nearest)) return false;
+        }
+      }
+      counters.occluded++;
+      return true;
+    }
+
+    /// Occluders, triangles and tests since begin().
+    const stats &get_stats() const {
+      return counters;
+    }
+  };
+}}
@@ -205,15 +205,28 @@ namespace octet { namespace scene {
     /// for OpenGL ES2, call glUniform* to copy the uniform to the GPU command buffer.
     /// for OpenGL ES3, we can use the uniform buffer directly and so don't need this.
     void render(const uint8_t *buffer) {
-      GLint uni = get_uniform();
+      render_at(get_uniform(), buffer);
+    }
+
+    /// copy the uniform to a location in the current program, for programs other than the one we were bound to.
+    void render_at(GLint uni, const uint8_t *buffer) {
+      upload(uni, get_gl_type(), repeat, buffer + offset);
+    }
+
+    /// how many in the array?
+    unsigned get_repeat() const {
+      return repeat;
+    }
 
+    /// call glUniform* for repeat values of a GL type at data.
+    static void upload(GLint uni, unsigned type, unsigned repeat, const void *data) {
       if (uni == -1) return;
 
-      switch (get_gl_type()) {
-        case GL_FLOAT: glUniform1fv(uni, repeat, (float*)(buffer + offset)); break;
-        case GL_FLOAT_VEC2: glUniform2fv(uni, repeat, (float*)(buffer + offset)); break;
-        case GL_FLOAT_VEC3: glUniform3fv(uni, repeat, (float*)(buffer + offset)); break;
-        case GL_FLOAT_VEC4: glUniform4fv(uni, repeat, (float*)(buffer + offset)); break;
+      switch (type) {
+        case GL_FLOAT: glUniform1fv(uni, repeat, (float*)data); break;
+        case GL_FLOAT_VEC2: glUniform2fv(uni, repeat, (float*)data); break;
+        case GL_FLOAT_VEC3: glUniform3fv(uni, repeat, (float*)data); break;
+        case GL_FLOAT_VEC4: glUniform4fv(uni, repeat, (float*)data); break;
 
         case GL_SAMPLER_2D:
         case GL_SAMPLER_CUBE:
@@ -221,14 +234,14 @@ namespace octet { namespace scene {
         case GL_SAMPLER_2D_SHADOW:
         case GL_INT:
         case GL_BOOL: 
-        case GL_UNSIGNED_INT: glUniform1iv(uni, repeat, (GLint*)(buffer + offset)); break;
-        case GL_BOOL_VEC2: case GL_INT_VEC2: glUniform2iv(uni, repeat, (GLint*)(buffer + offset)); break;
-        case GL_BOOL_VEC3: case GL_INT_VEC3: glUniform3iv(uni, repeat, (GLint*)(buffer + offset)); break;
-        case GL_BOOL_VEC4: case GL_INT_VEC4: glUniform4iv(uni, repeat, (GLint*)(buffer + offset)); break;
+        case GL_UNSIGNED_INT: glUniform1iv(uni, repeat, (GLint*)data); break;
+        case GL_BOOL_VEC2: case GL_INT_VEC2: glUniform2iv(uni, repeat, (GLint*)data); break;
+        case GL_BOOL_VEC3: case GL_INT_VEC3: glUniform3iv(uni, repeat, (GLint*)data); break;
+        case GL_BOOL_VEC4: case GL_INT_VEC4: glUniform4iv(uni, repeat, (GLint*)data); break;
 
-        case GL_FLOAT_MAT2: glUniformMatrix2fv(uni, repeat, GL_FALSE, (float*)(buffer + offset)); break;
-        case GL_FLOAT_MAT3: glUniformMatrix3fv(uni, repeat, GL_FALSE, (float*)(buffer + offset)); break;
-        case GL_FLOAT_MAT4: glUniformMatrix4fv(uni, repeat, GL_FALSE, (float*)(buffer + offset)); break;
+        case GL_FLOAT_MAT2: glUniformMatrix2fv(uni, repeat, GL_FALSE, (float*)data); break;
+        case GL_FLOAT_MAT3: glUniformMatrix3fv(uni, repeat, GL_FALSE, (float*)data); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(uni, repeat, GL_FALSE, (float*)data); break;
 
         default: abort();
       }
@@ -295,11 +308,20 @@ namespace octet { namespace scene {
     /// Set the OpenGL state for this sampler.
     void render(const uint8_t *buffer) {
       param_uniform::render(buffer);
-      glActiveTexture(GL_TEXTURE0 + texture_slot);
-      glBindTexture(sampler_->get_gl_target(), sampler_->get_gl_texture(image_));
+      bind_texture();
+    }
 
+    /// Bind the texture to its slot.
+    void bind_texture() {
+      gl_state::bind_texture(texture_slot, sampler_->get_gl_target(), sampler_->get_gl_texture(image_));
       //log("%s: u%d=ts%d targ=%04x tex=%d\n", get_atom_name(), get_uniform(), texture_slot, sampler_->get_gl_target(), sampler_->get_gl_texture(image_));
     }
+
+    /// Bind the texture to its slot, skipping the bind if it is already there.
+    /// The uniform holds the slot number and is set by render_at().
+    void bind_texture(render_state &state) {
+      state.bind_texture(texture_slot, sampler_->get_gl_target(), sampler_->get_gl_texture(image_));
+    }
   };
 
   /// Shader that uses parameters.
@@ -307,13 +329,19 @@ namespace octet { namespace scene {
     std::string vertex_shader;
     std::string fragment_shader;
 
+    // the vertex shader compiled with INSTANCED defined, if it supports it.
+    ref<shader> instanced;
+    bool instanced_tried;
+
   public:
     RESOURCE_META(param_shader)
 
     param_shader() {
+      instanced_tried = false;
     }
 
     param_shader(const char *vs_url, const char *fs_url) {
+      instanced_tried = false;
       dynarray<uint8_t> vs;
       dynarray<uint8_t> fs;
       app_utils::get_url(vs, vs_url);
@@ -333,6 +361,32 @@ namespace octet { namespace scene {
         params[i]->bind(pbi);
       }
     }
+
+    /// The shader for drawing many objects in one call, or NULL if the vertex shader has no INSTANCED variant.
+    /// The variant takes modelToCamera from the instance_modelToCamera attribute and has a cameraToProjection uniform.
+    shader *get_instanced_shader() {
+      #if OCTET_INSTANCING
+        if (!instanced_tried) {
+          instanced_tried = true;
+          if (vertex_shader.find("INSTANCED") != std::string::npos) {
+            // #version must come first, so the define goes after it.
+            std::string vs = vertex_shader;
+            size_t pos = vs.find("#version");
+            pos = pos == std::string::npos ? 0 : vs.find('\n', pos) + 1;
+            vs.insert(pos, "#define INSTANCED 1\n");
+            instanced = new shader();
+            instanced->init(vs.c_str(), fragment_shader.c_str());
+          }
+        }
+      #endif
+      return instanced;
+    }
+
+    /// The program of get_instanced_shader(), or 0.
+    GLuint get_instanced_program() {
+      shader *s = get_instanced_shader();
+      return s ? s->get_program() : 0;
+    }
   };
 }}
 
@@ -0,0 +1,311 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Sorted draw lists and redundant state elimination
+//
+
+namespace octet { namespace scene {
+  /// Counts of draw calls and state changes made in one frame.
+  struct render_stats {
+    unsigned draw_calls;
+    unsigned instances; // objects drawn, more than draw_calls when instancing
+    unsigned triangles;
+    unsigned program_binds;
+    unsigned material_binds;
+    unsigned texture_binds;
+    unsigned buffer_binds;
+    unsigned mesh_binds;
+    unsigned uniform_uploads; // glUniform* calls for material and lighting uniforms, not matrices
+
+    render_stats() {
+      reset();
+    }
+
+    void reset() {
+      draw_calls = instances = triangles = program_binds = material_binds = texture_binds = buffer_binds = mesh_binds = uniform_uploads = 0;
+    }
+
+    /// Total number of state changes.
+    unsigned get_state_changes() const {
+      return program_binds + material_binds + texture_binds + buffer_binds + mesh_binds;
+    }
+  };
+
+  /// The material, mesh and attributes set by the last draw.
+  ///
+  /// Consecutive draws that share a material or mesh skip setting them again.
+  /// Programs, textures and buffers go through gl_state, which skips binds that are already current.
+  /// Call reset() whenever code outside the render queue may have changed the state.
+  class render_state {
+    const void *material;
+    GLuint material_program; // program the material's uniforms were set in
+    const void *mesh;
+    unsigned attribute_mask;
+    render_stats stats;
+
+  public:
+    render_state() {
+      reset();
+      attribute_mask = 0;
+    }
+
+    /// Forget the material and mesh so that the next draw sets them again.
+    /// Enabled attributes are still tracked as GL keeps them across programs.
+    void reset() {
+      material = NULL;
+      material_program = ~0u;
+      mesh = NULL;
+    }
+
+    /// Forget the mesh after something else has drawn.
+    void reset_buffers() {
+      mesh = NULL;
+    }
+
+    /// Bind a program if it is not already current.
+    void use_program(GLuint value) {
+      if (gl_state::use_program(value)) stats.program_binds++;
+    }
+
+    /// Returns true if this material needs its uniforms set in this program.
+    bool set_material(const void *value, GLuint in_program) {
+      if (value == material && in_program == material_program) return false;
+      material = value;
+      material_program = in_program;
+      stats.material_binds++;
+      return true;
+    }
+
+    /// Returns true if this mesh needs its attributes set.
+    bool set_mesh(const void *value) {
+      if (value == mesh) return false;
+      mesh = value;
+      stats.mesh_binds++;
+      return true;
+    }
+
+    /// Bind a texture to a texture unit if it is not already bound there.
+    void bind_texture(unsigned slot, GLenum target, GLuint texture) {
+      if (gl_state::bind_texture(slot, target, texture)) stats.texture_binds++;
+    }
+
+    /// Bind a buffer to GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER if it is not already bound.
+    void bind_buffer(GLenum target, GLuint buffer) {
+      if (gl_state::bind_buffer(target, buffer)) stats.buffer_binds++;
+    }
+
+    /// Enable the attributes in mask and disable those in old_mask that are not.
+    static void change_attributes(unsigned old_mask, unsigned mask) {
+      unsigned changed = mask ^ old_mask;
+      for (unsigned attr = 0; changed; ++attr, changed >>= 1) {
+        if (changed & 1) {
+          if ((mask >> attr) & 1) {
+            glEnableVertexAttribArray(attr);
+          } else {
+            glDisableVertexAttribArray(attr);
+          }
+        }
+      }
+    }
+
+    /// Go back to the default vertex array and enable exactly the attributes in mask,
+    /// changing only those that differ.
+    void set_attributes(unsigned mask) {
+      #if OCTET_VERTEX_ARRAYS
+        if (has_vertex_arrays() && gl_state::bind_vertex_array(0)) mesh = NULL;
+      #endif
+      change_attributes(attribute_mask, mask);
+      attribute_mask = mask;
+    }
+
+    /// Count a draw call of one or more objects of num_triangles each.
+    void add_draw(unsigned num_instances = 1, unsigned num_triangles = 0) {
+      stats.draw_calls++;
+      stats.instances += num_instances;
+      stats.triangles += num_instances * num_triangles;
+    }
+
+    /// Count glUniform* calls.
+    void add_uniform_uploads(unsigned num_uploads) {
+      stats.uniform_uploads += num_uploads;
+    }
+
+    /// Can we draw many objects in one call?
+    static bool has_instancing() {
+      #if !OCTET_INSTANCING
+        return false;
+      #elif defined(WIN32)
+        // the ES3 entry points are loaded at run time and are missing on older drivers.
+        return glDrawElementsInstanced != NULL && glVertexAttribDivisor != NULL;
+      #else
+        return true;
+      #endif
+    }
+
+    /// Can meshes keep their attribute setup in vertex array objects?
+    static bool has_vertex_arrays() {
+      #if !OCTET_VERTEX_ARRAYS
+        return false;
+      #elif defined(WIN32)
+        return glGenVertexArrays != NULL && glBindVertexArray != NULL && glDeleteVertexArrays != NULL;
+      #else
+        return true;
+      #endif
+    }
+
+    /// Counters since the last call to reset_stats().
+    const render_stats &get_stats() const {
+      return stats;
+    }
+
+    void reset_stats() {
+      stats.reset();
+    }
+  };
+
+  /// A list of draws sorted by program, material, mesh and depth.
+  ///
+  /// Each draw gets a 64 bit key. Sorting the keys puts draws that share state next to each other
+  /// so that render_state can skip most of the binds. Within a program, material and mesh, draws
+  /// go front to back. Materials do not blend, so there is no back to front pass.
+  ///
+  /// Key layout from the top bit down:
+  ///
+  ///     program:10 material:14 mesh:14 depth:26
+  class render_queue {
+  public:
+    enum {
+      program_bits = 10,
+      material_bits = 14,
+      mesh_bits = 14,
+      depth_bits = 26,
+
+      depth_shift = 0,
+      mesh_shift = depth_shift + depth_bits,
+      material_shift = mesh_shift + mesh_bits,
+      program_shift = material_shift + material_bits,
+    };
+
+    struct item {
+      uint64_t key;
+      unsigned index;
+    };
+
+  private:
+    dynarray<item> items[2];
+    unsigned sorted; // which of items[] holds the current order
+
+    // small numbers for materials and meshes, stable from frame to frame
+    hash_map<void *, unsigned> material_ids;
+    hash_map<void *, unsigned> mesh_ids;
+    unsigned num_material_ids;
+    unsigned num_mesh_ids;
+
+    static unsigned get_id(hash_map<void *, unsigned> &ids, unsigned &num_ids, const void *ptr, unsigned bits) {
+      if (!ptr) return 0;
+      unsigned &id = ids[(void*)ptr];
+      if (id == 0) {
+        // when we run out, the rest share the last id. This only costs us some sorting quality.
+        id = num_ids < (1u << bits) - 1 ? ++num_ids : num_ids;
+      }
+      return id;
+    }
+
+    // Positive floats sort like their bit patterns. Keep the top depth_bits of the 31 bits.
+    static unsigned get_depth_bits(float depth) {
+      union { float f; uint32_t u; } cvt;
+      cvt.f = depth > 0 ? depth : 0;
+      return cvt.u >> (31 - depth_bits);
+    }
+
+  public:
+    render_queue() {
+      sorted = 0;
+      num_material_ids = num_mesh_ids = 0;
+    }
+
+    /// Empty the queue at the start of a frame.
+    void reset() {
+      items[0].resize(0);
+      sorted = 0;
+
+      // let go of materials and meshes that may have gone away.
+      if (num_material_ids >= (1u << material_bits) - 1) {
+        material_ids.clear();
+        num_material_ids = 0;
+      }
+      if (num_mesh_ids >= (1u << mesh_bits) - 1) {
+        mesh_ids.clear();
+        num_mesh_ids = 0;
+      }
+    }
+
+    /// Add a draw. depth is the distance in front of the camera, index is returned by get_index().
+    void add(GLuint program, const void *material, const void *mesh, float depth, unsigned index) {
+      item it;
+      it.key =
+        (uint64_t)(program & ((1u << program_bits) - 1)) << program_shift |
+        (uint64_t)get_id(material_ids, num_material_ids, material, material_bits) << material_shift |
+        (uint64_t)get_id(mesh_ids, num_mesh_ids, mesh, mesh_bits) << mesh_shift |
+        (uint64_t)get_depth_bits(depth) << depth_shift
+      ;
+      it.index = index;
+      items[0].push_back(it);
+    }
+
+    /// Sort the draws by key. This is a stable LSD radix sort on bytes, skipping bytes that are the same in every key.
+    void sort() {
+      unsigned num_items = items[0].size();
+      sorted = 0;
+      if (num_items < 2) return;
+
+      unsigned counts[8][256];
+      memset(counts, 0, sizeof(counts));
+      const item *src = items[0].data();
+      for (unsigned i = 0; i != num_items; ++i) {
+        uint64_t key = src[i].key;
+        for (unsigned b = 0; b != 8; ++b) {
+          counts[b][(key >> (b * 8)) & 0xff]++;
+        }
+      }
+
+      items[1].resize(num_items);
+      for (unsigned b = 0; b != 8; ++b) {
+        unsigned *count = counts[b];
+        if (count[(src[0].key >> (b * 8)) & 0xff] == num_items) continue;
+
+        unsigned offset = 0;
+        for (unsigned j = 0; j != 256; ++j) {
+          unsigned n = count[j];
+          count[j] = offset;
+          offset += n;
+        }
+
+        const item *from = items[sorted].data();
+        item *to = items[sorted ^ 1].data();
+        for (unsigned i = 0; i != num_items; ++i) {
+          to[count[(from[i].key >> (b * 8)) & 0xff]++] = from[i];
+        }
+        sorted ^= 1;
+      }
+    }
+
+    /// Number of draws in the queue.
+    unsigned size() const {
+      return items[0].size();
+    }
+
+    /// The index passed to add() for the i'th draw in sorted order.
+    unsigned get_index(unsigned i) const {
+      return items[sorted][i].index;
+    }
+
+    /// The key for the i'th draw in sorted order.
+    uint64_t get_key(unsigned i) const {
+      return items[sorted][i].key;
+    }
+  };
+}}
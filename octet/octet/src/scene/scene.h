@@ -14,15 +14,21 @@
 #include "../scene/skin.h"
 #include "../scene/skeleton.h"
 #include "../scene/animation.h"
+#include "../scene/render_queue.h"
+#include "../scene/mesh_bvh.h"
 #include "../scene/mesh.h"
 #include "../scene/image.h"
 #include "../scene/sampler.h"
 #include "../scene/param.h"
+#include "../scene/uniform_table.h"
 #include "../scene/material.h"
 #include "../scene/light.h"
 #include "../scene/camera_instance.h"
 #include "../scene/light_instance.h"
 #include "../scene/mesh_instance.h"
+#include "../scene/dynamic_aabb_tree.h"
+#include "../scene/occlusion_buffer.h"
+#include "../scene/debug_draw.h"
 #include "../scene/animation_instance.h"
 #include "../scene/visual_scene.h"
 #include "../scene/displacement_map.h"
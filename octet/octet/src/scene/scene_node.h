@@ -10,6 +10,11 @@
 namespace octet { namespace scene {
   /// Scene node. Part of a scene heirachy.
   /// Each node has a transform matrix, an identifying atom (sid), a parent and children.
+  ///
+  /// The node to world matrix is cached. Any change to the node to parent matrix marks the cache dirty
+  /// and each cached matrix remembers the version of its parent's matrix that it was built from,
+  /// so get_nodeToWorld() only multiplies matrices for nodes that moved or whose ancestors moved.
+  /// visual_scene::update_world_transforms() refreshes a whole scene in one pass.
   class scene_node : public resource {
     // every scene_node has a parent scene_node except the roots (NULL)
     // todo: support DAGs with multiple node parents
@@ -23,6 +28,61 @@ namespace octet { namespace scene {
 
     // sid used to target animations
     atom_t sid;
+
+    // cached node to world transform
+    mat4t nodeToWorld;
+
+    // incremented every time nodeToWorld changes
+    unsigned world_version;
+
+    // world_version of the parent when nodeToWorld was computed
+    unsigned parent_world_version;
+
+    // nodeToParent has changed since nodeToWorld was computed
+    bool world_dirty;
+
+    // access_nodeToParent() handed out a reference that may still be written through.
+    // the world matrix is then recomputed on every query until set_nodeToParent() is called.
+    bool access_pending;
+
+    static unsigned &access_hierarchy_version() { static unsigned value; return value; }
+
+    static unsigned &access_change_version() { static unsigned value; return value; }
+
+    // the local matrix changed, so the world matrices of this node and its children must be recomputed.
+    void mark_dirty() {
+      world_dirty = true;
+      access_change_version()++;
+    }
+
+    void init_world() {
+      nodeToWorld.loadIdentity();
+      world_version = 0;
+      parent_world_version = 0;
+      world_dirty = true;
+      access_pending = false;
+    }
+
+    // recompute nodeToWorld if needed, the parent must already be up to date.
+    void update_from_parent(scene_node *p) {
+      if (p) {
+        if (world_dirty || parent_world_version != p->world_version) {
+          nodeToWorld = nodeToParent * p->nodeToWorld;
+          parent_world_version = p->world_version;
+          world_version++;
+          world_dirty = access_pending;
+        }
+      } else if (world_dirty) {
+        nodeToWorld = nodeToParent;
+        world_version++;
+        world_dirty = access_pending;
+      }
+      if (access_pending) {
+        access_change_version()++;
+      }
+    }
+
+    friend class visual_scene;
   public:
     RESOURCE_META(scene_node)
 
@@ -30,12 +90,14 @@ namespace octet { namespace scene {
     scene_node() {
       nodeToParent.loadIdentity();
       sid = atom_;
+      init_world();
     }
 
     /// Construct a scene node with a matrix and an identifying sid atom.
     scene_node(const mat4t &nodeToParent, atom_t sid) {
       this->nodeToParent = nodeToParent;
       this->sid = sid;
+      init_world();
     }
 
     /// the virtual add_ref on animation_target gets passed to here and we pass iton (delegate it) to the resource
@@ -52,6 +114,7 @@ namespace octet { namespace scene {
     void set_value(atom_t sid, atom_t sub_target, atom_t component, float *value) {
       if (sub_target == atom_transform) {
         nodeToParent.init_transpose(value);
+        mark_dirty();
       }
     }
 
@@ -64,13 +127,53 @@ namespace octet { namespace scene {
       //log("visit scene_node nodeToParent\n");
       v.visit(nodeToParent, atom_nodeToParent);
       v.visit(sid, atom_sid);
+      mark_dirty();
+      access_hierarchy_version()++;
     }
 
 
-    /// add a child node to this node.
+    /// add a child node to this node, removing it from its old parent.
     void add_child(scene_node *new_node) {
+      ref<scene_node> keep = new_node; // the old parent may hold the only reference
+      if (new_node->parent) {
+        new_node->parent->remove_child(new_node);
+      }
       new_node->parent = this;
+      new_node->mark_dirty();
       children.push_back(new_node);
+      access_hierarchy_version()++;
+    }
+
+    /// remove a child node from this node, it no longer has a parent.
+    void remove_child(scene_node *child) {
+      for (unsigned i = 0; i != children.size(); ++i) {
+        if (children[i] == child) {
+          ref<scene_node> keep = child;
+          children.erase(i);
+          access_hierarchy_version()++;
+          child->mark_dirty();
+          // do this last, it may release this node
+          child->parent = NULL;
+          return;
+        }
+      }
+    }
+
+    /// Changes whenever a node is added to or removed from any hierarchy.
+    /// Use this to know when a flattened list of nodes is out of date.
+    static unsigned get_hierarchy_version() {
+      return access_hierarchy_version();
+    }
+
+    /// Changes whenever any node is moved, added or removed.
+    /// If this has not changed, no world matrix has changed either.
+    static unsigned get_change_version() {
+      return access_change_version();
+    }
+
+    /// Changes whenever the cached node to world matrix of this node changes.
+    unsigned get_world_version() const {
+      return world_version;
     }
 
     /// Get the parent node of this node.
@@ -88,13 +191,18 @@ namespace octet { namespace scene {
       return children[index];
     }
 
+    /// get the cached scene_node to world matrix, updating it and its ancestors if they have changed.
+    const mat4t &get_nodeToWorld() {
+      if (parent) {
+        parent->get_nodeToWorld();
+      }
+      update_from_parent(parent);
+      return nodeToWorld;
+    }
+
     // compute the scene_node to world matrix for an individual scene_node;
     mat4t calcModelToWorld() {
-      mat4t result = nodeToParent;
-      for (scene_node *p = parent; p != NULL; p = p->parent) {
-        result = result * p->nodeToParent;
-      }
-      return result;
+      return get_nodeToWorld();
     }
 
     /// read the node to parent transform matrix
@@ -102,29 +210,44 @@ namespace octet { namespace scene {
       return nodeToParent;
     }
 
+    /// set the node to parent transform matrix, the world matrix is recomputed on the next query.
+    void set_nodeToParent(const mat4t &value) {
+      nodeToParent = value;
+      access_pending = false;
+      mark_dirty();
+    }
+
     /// access the node to parent transform matrix for writing.
+    /// The reference may be written at any time, so this node loses its cached world matrix
+    /// until set_nodeToParent() is called. Prefer set_nodeToParent() or the helpers below.
     mat4t &access_nodeToParent() {
+      access_pending = true;
+      mark_dirty();
       return nodeToParent;
     }
 
     /// reset the matrix
     void loadIdentity() {
       nodeToParent.loadIdentity();
+      mark_dirty();
     }
 
     /// Translate the matrix
     void translate(vec3_in xyz) {
       nodeToParent.translate(xyz[0], xyz[1], xyz[2]);
+      mark_dirty();
     }
 
     /// Rotate the matrix
     void rotate(float angle, vec3_in axis) {
       nodeToParent.rotate(angle, axis[0], axis[1], axis[2]);
+      mark_dirty();
     }
 
     /// Scale the matrix
     void scale(vec3_in xyz) {
       nodeToParent.scale(xyz[0], xyz[1], xyz[2]);
+      mark_dirty();
     }
 
     /// Get the identifying sid
@@ -132,7 +255,7 @@ namespace octet { namespace scene {
       return sid;
     }
 
-    /// recursively fetch all child nodes
+    /// recursively fetch all child nodes. parents come before their children in the result.
     void get_all_child_nodes(dynarray<scene_node*> &nodes, dynarray<int> &parents) {
       dynarray<scene_node*> stack;
       dynarray<int> parent_stack;
@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Uniform locations of a material's parameters in one program
+//
+
+namespace octet { namespace scene {
+  /// Flat table of where a material's parameters go in one shader program.
+  ///
+  /// Built once per material and program so that drawing does not search the parameters by name.
+  /// Parameters are split by how often they change:
+  ///
+  ///   * matrices change for every object.
+  ///   * lighting changes once a frame.
+  ///   * everything else (colours, sampler slots, user uniforms) changes only when the material does.
+  class uniform_table {
+  public:
+    struct binding {
+      GLint location;
+      uint16_t type;
+      uint16_t repeat;
+      uint16_t offset;
+      uint8_t buffer; // 0 = dynamic, 1 = static
+    };
+
+  private:
+    GLuint program;
+    unsigned num_params; // number of parameters when the table was built
+
+    dynarray<binding> material_bindings;
+    dynarray<param_sampler*> samplers; // owned by the material's params
+
+    GLint modelToProjection_location;
+    GLint modelToCamera_location;
+    GLint cameraToProjection_location;
+    GLint lighting_location;
+    GLint num_lights_location;
+
+  public:
+    uniform_table() {
+      program = 0;
+      num_params = ~0u;
+    }
+
+    /// Was the table built for this program and number of parameters?
+    bool is_valid(GLuint program, unsigned num_params) const {
+      return this->program == program && this->num_params == num_params;
+    }
+
+    /// Look up the parameters in program.
+    void init(GLuint program, dynarray<ref<param> > &params) {
+      this->program = program;
+      num_params = params.size();
+      material_bindings.resize(0);
+      samplers.resize(0);
+
+      modelToProjection_location = glGetUniformLocation(program, "modelToProjection");
+      modelToCamera_location = glGetUniformLocation(program, "modelToCamera");
+      cameraToProjection_location = glGetUniformLocation(program, "cameraToProjection");
+      lighting_location = glGetUniformLocation(program, "lighting");
+      num_lights_location = glGetUniformLocation(program, "num_lights");
+
+      for (unsigned i = 0; i != params.size(); ++i) {
+        param_uniform *pu = params[i]->get_param_uniform();
+        if (!pu) continue;
+
+        if (param_sampler *ps = params[i]->get_param_sampler()) {
+          samplers.push_back(ps);
+        }
+
+        atom_t name = pu->get_name();
+        if (name == atom_modelToProjection || name == atom_modelToCamera || name == atom_lighting || name == atom_num_lights) {
+          continue;
+        }
+
+        // the program may not use every parameter.
+        binding b;
+        b.location = glGetUniformLocation(program, pu->get_atom_name());
+        if (b.location == -1) continue;
+        b.type = pu->get_gl_type();
+        b.repeat = (uint16_t)pu->get_repeat();
+        b.offset = (uint16_t)pu->get_offset();
+        b.buffer = pu->get_uniform_buffer_index();
+        material_bindings.push_back(b);
+      }
+    }
+
+    /// Set the uniforms that only change with the material. Returns the number of glUniform calls.
+    unsigned render_material(const uint8_t *dynamic_buffer, const uint8_t *static_buffer) const {
+      for (unsigned i = 0; i != material_bindings.size(); ++i) {
+        const binding &b = material_bindings[i];
+        param_uniform::upload(b.location, b.type, b.repeat, (b.buffer ? static_buffer : dynamic_buffer) + b.offset);
+      }
+      return material_bindings.size();
+    }
+
+    /// Set the lighting. Returns the number of glUniform calls.
+    unsigned render_lighting(const vec4 *light_uniforms, int num_light_uniforms, int num_lights) const {
+      unsigned calls = 0;
+      if (lighting_location != -1) { glUniform4fv(lighting_location, num_light_uniforms, (const float*)light_uniforms); calls++; }
+      if (num_lights_location != -1) { glUniform1i(num_lights_location, num_lights); calls++; }
+      return calls;
+    }
+
+    /// Set the matrices for one object.
+    void render_matrices(const mat4t &modelToProjection, const mat4t &modelToCamera) const {
+      if (modelToProjection_location != -1) glUniformMatrix4fv(modelToProjection_location, 1, GL_FALSE, modelToProjection.get());
+      if (modelToCamera_location != -1) glUniformMatrix4fv(modelToCamera_location, 1, GL_FALSE, modelToCamera.get());
+    }
+
+    /// Set the projection for instanced programs.
+    void render_cameraToProjection(const mat4t &cameraToProjection) const {
+      if (cameraToProjection_location != -1) glUniformMatrix4fv(cameraToProjection_location, 1, GL_FALSE, cameraToProjection.get());
+    }
+
+    /// Bind the textures through a render_state.
+    void bind_textures(render_state &state) const {
+      for (unsigned i = 0; i != samplers.size(); ++i) {
+        samplers[i]->bind_texture(state);
+      }
+    }
+
+    /// Bind the textures.
+    void bind_textures() const {
+      for (unsigned i = 0; i != samplers.size(); ++i) {
+        samplers[i]->bind_texture();
+      }
+    }
+  };
+}}
@@ -31,9 +31,7 @@ namespace octet { namespace scene {
     bool render_aabbs;
     bool render_debug_lines;
     bool dump_vertices;
-    ref<material> debug_material;
-    dynarray<vec3> debug_line_buffer;
-    unsigned debug_in_ptr;
+    ref<debug_draw> debug;
 
     /// derived light information
     enum { max_lights = material::max_lights, light_size = material::light_size, ambient_size = material::ambient_size };
@@ -43,38 +41,80 @@ namespace octet { namespace scene {
 
     int frame_number;
 
+    /// the hierarchy flattened in parent before child order, rebuilt when nodes are added or removed
+    dynarray<scene_node*> flat_nodes;
+    dynarray<int> flat_parents;
+    unsigned flat_hierarchy_version;
+
+    /// frustum culling
+    bool frustum_culling;
+    dynarray<float> cull_blocks; // world space boxes of the mesh instances, four per 24 floats (see frustum)
+    dynarray<uint8_t> instance_visible; // result of the cull, one per mesh instance
+    int num_visible_instances;
+    int num_culled_instances;
+
+    /// occlusion culling: instances flagged as occluders hide the instances behind them
+    bool occlusion_culling;
+    occlusion_buffer occlusion;
+    thread_pool *occlusion_pool; // shares the tiles of the occlusion buffer between threads, may be NULL
+    int num_occluded_instances;
+
+    /// scene queries: a tree of the world space boxes of the mesh instances, the user value is the instance index
+    struct instance_proxy {
+      int proxy; // leaf in instance_tree, -1 if not in the tree
+      unsigned world_version; // node world version the bounds were built from
+      scene_node *node; // node and mesh the bounds were built from
+      mesh *msh;
+      aabb bounds; // tight world space box
+      mat4t worldToNode; // for taking rays into model space
+      const mesh_bvh *bvh; // triangle tree of msh, refreshed by cast_rays()
+    };
+    dynamic_aabb_tree instance_tree;
+    dynarray<instance_proxy> instance_proxies;
+    unsigned tree_change_version; // scene_node::get_change_version() when the tree was last refit
+    unsigned tree_instance_version; // mesh_instance::get_change_version() when the tree was last refit
+
+    /// each mesh of the instance proxies once, with the triangle tree the proxies point at
+    struct bvh_mesh {
+      mesh *msh;
+      const mesh_bvh *bvh;
+    };
+    dynarray<bvh_mesh> bvh_meshes;
+    bool bvh_meshes_valid; // false when a proxy has changed mesh since the last cast_rays()
+
+    /// draws sorted by state, and the state left by the last draw
+    render_queue draw_queue;
+    render_state draw_state;
+    bool sort_draws;
+
+    /// consecutive sorted draws of one mesh and material, drawn with one call if first_matrix != ~0
+    struct draw_run {
+      unsigned begin;
+      unsigned count;
+      unsigned first_matrix; // index in instance_matrices
+    };
+    dynarray<draw_run> draw_runs;
+    dynarray<mat4t> instance_matrices; // modelToCamera for each instanced draw, streamed to instance_buffer
+    ref<gl_resource> instance_buffer;
+    bool use_instancing;
+    enum { min_instances = 2 };
+    dynarray<int> query_results;
+    dynarray<uint64_t> ray_order[2]; // (sort key << 32) | ray index for cast_rays(), and radix sort scratch
+
+    /// exact squared distance from a point to the box of an instance, for find_nearest
+    struct instance_distance {
+      const instance_proxy *proxies;
+      float operator()(int index, vec3_in point) const {
+        const aabb &bb = proxies[index].bounds;
+        vec3 d = math::max(abs(point - bb.get_center()) - bb.get_half_extent(), vec3(0, 0, 0));
+        return dot(d, d);
+      }
+    };
+
     /// shaders to draw triangles
     ref<bump_shader> object_shader;
     ref<bump_shader> skin_shader;
 
-    void draw_aabb(const aabb &bb) {
-      vec3 pos[8];
-      for (int i = 0; i != 8; ++i) {
-        vec3 center = bb.get_center();
-        vec3 half = bb.get_half_extent();
-        pos[i] = center + half * vec3(
-          (i & 1 ? 1.0f : -1.0f),
-          (i & 2 ? 1.0f : -1.0f),
-          (i & 4 ? 1.0f : -1.0f)
-        );
-      }
-
-      static const uint16_t indices[] = {
-        0, 1, 2, 3, 4, 5, 6, 7,
-        0, 2, 1, 3, 4, 6, 5, 7,
-        0, 4, 1, 5, 2, 6, 3, 7
-      };
-
-      /// render immediate data (this is inefficient!)
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)pos );
-      glEnableVertexAttribArray(attribute_pos);
-    
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-      glDrawElements(GL_LINES, 24, GL_UNSIGNED_SHORT, indices);
-      glDisableVertexAttribArray(attribute_pos);
-    }
-
     void calc_lighting(const mat4t &worldToCamera) {
       vec4 &ambient = light_uniforms[0];
       ambient = vec4(0, 0, 0, 1);
@@ -99,29 +139,20 @@ namespace octet { namespace scene {
       num_light_uniforms = ambient_size + num_lights * light_size;
     }
 
-    void render_mesh_aabbs() {
+    void add_mesh_aabbs() {
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
         aabb bb = mi->get_mesh()->get_aabb();
-        bb = bb.get_transform(mi->get_node()->calcModelToWorld());
-        draw_aabb(bb);
+        bb = bb.get_transform(mi->get_node()->get_nodeToWorld());
+        debug->add_box(bb);
       }
     }
 
-    void render_debug_line_buffer() {
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)debug_line_buffer.data() );
-      glEnableVertexAttribArray(attribute_pos);
-    
-      glDrawArrays(GL_LINES, 0, debug_line_buffer.size());
-      glDisableVertexAttribArray(attribute_pos);
-    }
-
     void dump_mesh_vertices(camera_instance &cam) {
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
         mesh *msh = mi->get_mesh();
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
+        const mat4t &modelToWorld = mi->get_node()->get_nodeToWorld();
         mat4t modelToCamera;
         mat4t modelToProjection;
         cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
@@ -150,28 +181,192 @@ namespace octet { namespace scene {
       }
     }
 
-    void draw_debug_data(camera_instance &cam) {
-      /// debug draw the AABBs of the mesh instances in the world.
-      /// draw in world space
-      mat4t worldToCamera;
-      mat4t worldToProjection;
-      mat4t worldToWorld;
-      worldToWorld.loadIdentity();
-      cam.get_matrices(worldToProjection, worldToCamera, worldToWorld);
-      debug_material->render(worldToProjection, worldToCamera, light_uniforms, num_light_uniforms, num_lights);
-
+    /// draw this frame's debug lines and boxes in world space, then start again for the next frame.
+    void draw_debug_data(const mat4t &worldToProjection) {
       /// debug lines are a useful way of showing dynamic behaviour in the scene.
-      if (render_debug_lines) {
-        render_debug_line_buffer();
+      if (!render_debug_lines) {
+        debug->clear();
       }
 
       if (render_aabbs) {
-        render_mesh_aabbs();
+        add_mesh_aabbs();
+      }
+
+      debug->render(worldToProjection, draw_state);
+      debug->clear();
+    }
+
+    /// find the mesh instances that are at least partly inside the view frustum, four boxes at a time.
+    void cull_mesh_instances(const frustum &view) {
+      unsigned num_instances = mesh_instances.size();
+      unsigned num_blocks = (num_instances + 3) / 4;
+      cull_blocks.resize(num_blocks * 24);
+      instance_visible.resize(num_blocks * 4);
+
+      for (unsigned mesh_index = 0; mesh_index != num_blocks * 4; ++mesh_index) {
+        float *block = &cull_blocks[(mesh_index / 4) * 24];
+        mesh_instance *mi = mesh_index < num_instances ? (mesh_instance*)mesh_instances[mesh_index] : NULL;
+        if (mi) {
+          aabb bb = mi->get_mesh()->get_aabb().get_transform(mi->get_node()->get_nodeToWorld());
+          frustum::set_block(block, mesh_index & 3, bb);
+        } else {
+          frustum::set_block(block, mesh_index & 3, aabb());
+        }
+      }
+
+      num_visible_instances = 0;
+      for (unsigned b = 0; b != num_blocks; ++b) {
+        unsigned mask = view.intersects4(&cull_blocks[b * 24]);
+        for (unsigned j = 0; j != 4; ++j) {
+          unsigned mesh_index = b * 4 + j;
+          mesh_instance *mi = mesh_index < num_instances ? (mesh_instance*)mesh_instances[mesh_index] : NULL;
+          // skinned meshes move away from their bind pose box, so never cull them.
+          bool visible = mi && ((mask >> j) & 1 || (mi->get_skeleton() && mi->get_mesh()->get_skin()));
+          instance_visible[mesh_index] = visible;
+          num_visible_instances += visible;
+        }
+      }
+      num_culled_instances = num_instances - num_visible_instances;
+    }
+
+    /// mark every mesh instance visible when frustum culling is off.
+    void show_all_mesh_instances() {
+      instance_visible.resize(mesh_instances.size());
+      if (instance_visible.size()) memset(instance_visible.data(), 1, instance_visible.size());
+      num_visible_instances = mesh_instances.size();
+      num_culled_instances = 0;
+    }
+
+    /// draw the visible occluders into the occlusion buffer and hide the visible instances behind them.
+    void cull_occluded_instances(const mat4t &worldToProjection) {
+      OCTET_PROFILE("visual_scene::cull_occluded_instances");
+      unsigned num_instances = mesh_instances.size();
+      occlusion.begin(worldToProjection);
+      for (unsigned mesh_index = 0; mesh_index != num_instances; ++mesh_index) {
+        mesh_instance *mi = mesh_instances[mesh_index];
+        if (instance_visible[mesh_index] && (mi->get_flags() & mesh_instance::flag_occluder)) {
+          occlusion.add_occluder(mi->get_mesh(), mi->get_node()->get_nodeToWorld());
+        }
+      }
+      if (occlusion.get_stats().occluders == 0) return;
+      occlusion.rasterize(occlusion_pool);
+
+      for (unsigned mesh_index = 0; mesh_index != num_instances; ++mesh_index) {
+        mesh_instance *mi = mesh_instances[mesh_index];
+        if (!instance_visible[mesh_index] || (mi->get_flags() & mesh_instance::flag_occluder)) continue;
+        // skinned meshes move away from their bind pose box.
+        if (mi->get_skeleton() && mi->get_mesh()->get_skin()) continue;
+        aabb bb = mi->get_mesh()->get_aabb().get_transform(mi->get_node()->get_nodeToWorld());
+        if (occlusion.is_occluded(bb)) {
+          instance_visible[mesh_index] = 0;
+          num_visible_instances--;
+          num_occluded_instances++;
+        }
+      }
+    }
+
+    // draw one mesh instance with its own matrices.
+    void draw_instance(mesh_instance *mi, camera_instance &cam) {
+      mesh *msh = mi->get_mesh();
+      skin *skn = msh->get_skin();
+      skeleton *skel = mi->get_skeleton();
+      material *mat = mi->get_material();
+
+      const mat4t &modelToWorld = mi->get_node()->get_nodeToWorld();
+      mat4t modelToCamera;
+      mat4t modelToProjection;
+      cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
+
+      if (!skel || !skn) {
+        /// normal rendering for single matrix objects
+        /// build a projection matrix: model -> world -> camera_instance -> projection
+        /// the projection space is the cube -1 <= x/w, y/w, z/w <= 1
+        /// the shader, colours and textures only change when the material does.
+        if (draw_state.set_material(mat, mat->get_program())) {
+          mat->render_static(light_uniforms, num_light_uniforms, num_lights, draw_state);
+        }
+        mat->render_matrices(modelToProjection, modelToCamera);
+      } else {
+        /// multi-matrix rendering
+        mat4t *transforms = skel->calc_transforms(modelToCamera, skn);
+        int num_bones = skel->get_num_bones();
+        if(num_bones > 192) {
+          GLint mvuv = 0;
+          //glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &mvuv);
+          printf("warning: too many bones (%d/%d)\n", num_bones, mvuv/4);
+        } else {
+          mat->render_skinned(cam.get_cameraToProjection(), transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
+        }
+      }
+
+      /*if (true) {
+        static bool dumped;
+        if (!dumped) { msh->dump_transformed(modelToProjection); dumped = true; }
+      }*/
+      msh->enable_attributes(draw_state);
+      msh->draw(draw_state);
+
+      if (mi->get_flags() & mesh_instance::flag_selected) {
+        aabb bb = mi->get_mesh()->get_aabb();
+        debug->add_box(bb.get_transform(modelToWorld));
       }
     }
 
+    // can this instance be drawn together with others of the same mesh and material?
+    static bool can_instance(mesh_instance *mi) {
+      return !(mi->get_skeleton() && mi->get_mesh()->get_skin()) && !(mi->get_flags() & mesh_instance::flag_selected);
+    }
+
+    // split the sorted draws into runs that share a mesh and material. Runs that can be instanced get
+    // their modelToCamera matrices added to instance_matrices.
+    void find_instanced_runs(const mat4t &worldToCamera) {
+      bool instancing = use_instancing && render_state::has_instancing();
+      draw_runs.resize(0);
+      instance_matrices.resize(0);
+      unsigned num_draws = draw_queue.size();
+      for (unsigned i = 0; i != num_draws; ) {
+        mesh_instance *mi = mesh_instances[draw_queue.get_index(i)];
+        draw_run run;
+        run.begin = i;
+        run.count = 1;
+        run.first_matrix = ~0u;
+        if (instancing && can_instance(mi)) {
+          while (i + run.count != num_draws) {
+            mesh_instance *next = mesh_instances[draw_queue.get_index(i + run.count)];
+            if (next->get_mesh() != mi->get_mesh() || next->get_material() != mi->get_material() || !can_instance(next)) break;
+            run.count++;
+          }
+          if (run.count >= min_instances && mi->get_material()->get_instanced_program()) {
+            run.first_matrix = instance_matrices.size();
+            for (unsigned j = i; j != i + run.count; ++j) {
+              mesh_instance *inst = mesh_instances[draw_queue.get_index(j)];
+              instance_matrices.push_back(inst->get_node()->get_nodeToWorld() * worldToCamera);
+            }
+          }
+        }
+        draw_runs.push_back(run);
+        i += run.count;
+      }
+    }
+
+    // copy this frame's instance matrices to the GPU.
+    void upload_instance_matrices() {
+      if (instance_matrices.size() == 0) return;
+      size_t bytes = instance_matrices.size() * sizeof(mat4t);
+      if (!instance_buffer || instance_buffer->get_size() < bytes) {
+        size_t capacity = 0x1000;
+        while (capacity < bytes) capacity *= 2;
+        if (!instance_buffer) instance_buffer = new gl_resource();
+        instance_buffer->allocate(GL_ARRAY_BUFFER, capacity, GL_STREAM_DRAW);
+      }
+      gl_resource::wolock lock(instance_buffer);
+      memcpy(lock.u8(), instance_matrices.data(), bytes);
+    }
+
     void render_impl(bump_shader &object_shader, bump_shader &skin_shader, camera_instance &cam, float aspect_ratio) {
-      mat4t cameraToWorld = cam.get_node()->calcModelToWorld();
+      update_world_transforms();
+
+      mat4t cameraToWorld = cam.get_node()->get_nodeToWorld();
 
       mat4t worldToCamera;
       cameraToWorld.invertQuick(worldToCamera);
@@ -181,52 +376,56 @@ namespace octet { namespace scene {
       cam.set_cameraToWorld(cameraToWorld, aspect_ratio);
       mat4t cameraToProjection = cam.get_cameraToProjection();
 
-      draw_debug_data(cam);
+      if (frustum_culling) {
+        cull_mesh_instances(frustum(worldToCamera * cameraToProjection));
+      } else {
+        show_all_mesh_instances();
+      }
+
+      num_occluded_instances = 0;
+      if (occlusion_culling) {
+        cull_occluded_instances(worldToCamera * cameraToProjection);
+      }
 
+      // sort the visible instances to group draws that share a program, material and mesh.
+      vec3 camera_pos = cameraToWorld.w().xyz();
+      vec3 camera_dir = -cameraToWorld.z().xyz();
+      draw_queue.reset();
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
+        if (!instance_visible[mesh_index]) continue;
         mesh_instance *mi = mesh_instances[mesh_index];
-        mesh *msh = mi->get_mesh();
-        skin *skn = msh->get_skin();
-        skeleton *skel = mi->get_skeleton();
         material *mat = mi->get_material();
-
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
-        mat4t modelToCamera;
-        mat4t modelToProjection;
-        cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
-
-        if (!skel || !skn) {
-          /// normal rendering for single matrix objects
-          /// build a projection matrix: model -> world -> camera_instance -> projection
-          /// the projection space is the cube -1 <= x/w, y/w, z/w <= 1
-          mat->render(modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
+        float depth = dot(mi->get_node()->get_nodeToWorld().w().xyz() - camera_pos, camera_dir);
+        draw_queue.add(mat->get_program(), mat, mi->get_mesh(), depth, mesh_index);
+      }
+      if (sort_draws) draw_queue.sort();
+
+      // runs of the same mesh and material become one instanced draw.
+      find_instanced_runs(worldToCamera);
+      upload_instance_matrices();
+
+      draw_state.reset();
+      draw_state.reset_stats();
+      for (unsigned r = 0; r != draw_runs.size(); ++r) {
+        const draw_run &run = draw_runs[r];
+        mesh_instance *mi = mesh_instances[draw_queue.get_index(run.begin)];
+        if (run.first_matrix != ~0u) {
+          material *mat = mi->get_material();
+          mesh *msh = mi->get_mesh();
+          if (draw_state.set_material(mat, mat->get_instanced_program())) {
+            mat->render_instanced_static(cameraToProjection, light_uniforms, num_light_uniforms, num_lights, draw_state);
+          }
+          msh->enable_attributes(draw_state);
+          msh->draw_instanced(draw_state, instance_buffer->get_buffer(), run.first_matrix * sizeof(mat4t), run.count);
         } else {
-          /// multi-matrix rendering
-          mat4t *transforms = skel->calc_transforms(modelToCamera, skn);
-          int num_bones = skel->get_num_bones();
-          if(num_bones > 192) {
-            GLint mvuv = 0;
-            //glGetIntegerv(GL_MAX_VERTEX_UNIFORM_VECTORS, &mvuv);
-            printf("warning: too many bones (%d/%d)\n", num_bones, mvuv/4);
-          } else {
-            mat->render_skinned(cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
+          for (unsigned i = run.begin; i != run.begin + run.count; ++i) {
+            draw_instance(mesh_instances[draw_queue.get_index(i)], cam);
           }
         }
-
-        /*if (true) {
-          static bool dumped;
-          if (!dumped) { msh->dump_transformed(modelToProjection); dumped = true; }
-        }*/
-        msh->enable_attributes();
-        msh->draw();
-        msh->disable_attributes();
-
-        if (mi->get_flags() & mesh_instance::flag_selected) {
-          aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(mi->get_node()->calcModelToWorld());
-          draw_aabb(bb);
-        }
       }
+      draw_state.set_attributes(0);
+
+      draw_debug_data(worldToCamera * cameraToProjection);
       frame_number++;
     }
   public:
@@ -240,11 +439,19 @@ namespace octet { namespace scene {
       render_aabbs = false;
       dump_vertices = false;
       render_debug_lines = false;
-      debug_material = new material(vec4(1, 0, 0, 1));
-      debug_line_buffer.resize(256);
-      assert(is_power_of_two(debug_line_buffer.size()));
-      memset(&debug_line_buffer[0], 0, debug_line_buffer.size() * sizeof(debug_line_buffer[0]));
-      debug_in_ptr = 0;
+      debug = new debug_draw();
+      flat_hierarchy_version = ~0u;
+      frustum_culling = true;
+      num_visible_instances = 0;
+      num_culled_instances = 0;
+      occlusion_culling = false;
+      occlusion_pool = NULL;
+      num_occluded_instances = 0;
+      tree_change_version = ~0u;
+      tree_instance_version = ~0u;
+      bvh_meshes_valid = false;
+      sort_draws = true;
+      use_instancing = true;
     }
 
     /// Serialization
@@ -257,6 +464,83 @@ namespace octet { namespace scene {
     }
 
 
+    /// Bring the cached node to world matrix of every node in the scene up to date.
+    /// This is one pass over the flattened hierarchy, doing a matrix multiply only for nodes that have
+    /// moved or have a moving ancestor. render() calls this, call it yourself if you need world matrices
+    /// for many nodes before rendering.
+    void update_world_transforms() {
+      if (flat_hierarchy_version != get_hierarchy_version()) {
+        flat_nodes.resize(0);
+        flat_parents.resize(0);
+        get_all_child_nodes(flat_nodes, flat_parents);
+        flat_hierarchy_version = get_hierarchy_version();
+      }
+
+      // the scene itself may have a parent
+      get_nodeToWorld();
+
+      scene_node **nodes = flat_nodes.data();
+      const int *parents = flat_parents.data();
+      for (unsigned i = 1; i < flat_nodes.size(); ++i) {
+        nodes[i]->update_from_parent(nodes[parents[i]]);
+      }
+    }
+
+    /// Refit the query tree to the mesh instances that have moved since the last query.
+    /// Only the leaves of moved instances are touched, and only those that leave their fat box are reinserted.
+    /// The queries call this, so there is normally no need to call it yourself.
+    void update_instance_tree() {
+      if (
+        tree_change_version == get_change_version() &&
+        tree_instance_version == mesh_instance::get_change_version() &&
+        instance_proxies.size() == mesh_instances.size()
+      ) {
+        return;
+      }
+      update_world_transforms();
+
+      unsigned old_size = instance_proxies.size();
+      instance_proxies.resize(mesh_instances.size());
+      for (unsigned i = old_size; i < instance_proxies.size(); ++i) {
+        instance_proxies[i].proxy = -1;
+        instance_proxies[i].node = NULL;
+        instance_proxies[i].msh = NULL;
+        instance_proxies[i].bvh = NULL;
+      }
+
+      for (unsigned i = 0; i != mesh_instances.size(); ++i) {
+        mesh_instance *mi = mesh_instances[i];
+        instance_proxy &p = instance_proxies[i];
+        scene_node *node = mi ? mi->get_node() : NULL;
+        mesh *msh = mi ? mi->get_mesh() : NULL;
+        if (!node || !msh) {
+          if (p.proxy != -1) {
+            instance_tree.remove(p.proxy);
+            p.proxy = -1;
+            bvh_meshes_valid = false;
+          }
+          continue;
+        }
+
+        const mat4t &nodeToWorld = node->get_nodeToWorld();
+        if (p.proxy == -1 || p.msh != msh) bvh_meshes_valid = false;
+        if (p.proxy == -1 || p.node != node || p.msh != msh || p.world_version != node->get_world_version()) {
+          p.node = node;
+          p.msh = msh;
+          p.world_version = node->get_world_version();
+          p.bounds = msh->get_aabb().get_transform(nodeToWorld);
+          p.worldToNode = nodeToWorld.inverse3x4();
+          if (p.proxy == -1) {
+            p.proxy = instance_tree.insert(p.bounds, (int)i);
+          } else {
+            instance_tree.move(p.proxy, p.bounds);
+          }
+        }
+      }
+      tree_change_version = get_change_version();
+      tree_instance_version = mesh_instance::get_change_version();
+    }
+
     /// set up OpenGL state
     void begin_render(int vx, int vy, vec4_in clear_color=vec4(0.5f, 0.5f, 0.5f, 1.0f)) {
       /// set a viewport - includes whole window area
@@ -266,20 +550,22 @@ namespace octet { namespace scene {
       glClearColor(clear_color.x(), clear_color.y(), clear_color.z(), clear_color.w());
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+      /// start counting gl_state calls for this frame
+      gl_state::end_frame();
+
       /// allow Z buffer depth testing (closer objects are always drawn in front of far ones)
-      glEnable(GL_DEPTH_TEST);
+      gl_state::enable(GL_DEPTH_TEST);
 
-      GLint param;
-      glGetIntegerv(GL_SAMPLE_BUFFERS, &param);
-      if (param == 0) {
+      /// the number of sample buffers is asked for once per framebuffer binding, glGetIntegerv stalls the pipeline.
+      if (gl_state::get_sample_buffers() == 0) {
         /// if multisampling is disabled, we can't use GL_SAMPLE_COVERAGE (which I think is mean)
         /// Instead, allow alpha blend (transparency when alpha channel is 0)
-        glEnable(GL_BLEND);
+        gl_state::enable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
       } else {
         /// if multisampling is enabled, use GL_SAMPLE_COVERAGE instead
-        glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-        glEnable(GL_SAMPLE_COVERAGE);
+        gl_state::enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        gl_state::enable(GL_SAMPLE_COVERAGE);
       }
     }
 
@@ -297,7 +583,10 @@ namespace octet { namespace scene {
         camera_instance *cam = new camera_instance();
         float bb_size = length(bb.get_half_extent()) * 2.0f;
         float distance = max(bb.get_max().z(), bb_size) * 2;
-        node->access_nodeToParent().translate(0, 0, distance);
+        mat4t cameraToParent;
+        cameraToParent.loadIdentity();
+        cameraToParent.translate(0, 0, distance);
+        node->set_nodeToParent(cameraToParent);
         float f = distance * 2, n = f * 0.001f;
         cam->set_node(node);
         cam->set_perspective(0, 45, 1, n, f);
@@ -309,9 +598,12 @@ namespace octet { namespace scene {
         scene_node *node = add_scene_node();
         light *_light = new light();
         light_instance *li = new light_instance();
-        node->access_nodeToParent().translate(100, 100, 100);
-        node->access_nodeToParent().rotateX(45);
-        node->access_nodeToParent().rotateY(45);
+        mat4t lightToParent;
+        lightToParent.loadIdentity();
+        lightToParent.translate(100, 100, 100);
+        lightToParent.rotateX(45);
+        lightToParent.rotateY(45);
+        node->set_nodeToParent(lightToParent);
         _light->set_color(vec4(1, 1, 1, 1));
         _light->set_kind(atom_directional);
         li->set_node(node);
@@ -391,11 +683,68 @@ namespace octet { namespace scene {
       render_aabbs = value;
     }
 
-    /// debugging aid to draw debug lines
+    /// skip mesh instances outside the camera's view (on by default)
+    void set_frustum_culling(bool value) {
+      frustum_culling = value;
+    }
+
+    /// number of mesh instances drawn in the last render
+    int get_num_visible_instances() {
+      return num_visible_instances;
+    }
+
+    /// number of mesh instances skipped by frustum culling in the last render
+    int get_num_culled_instances() {
+      return num_culled_instances;
+    }
+
+    /// skip mesh instances hidden behind instances flagged mesh_instance::flag_occluder (off by default).
+    /// The occluders are drawn into a small software depth buffer, on the threads of pool if it is not NULL.
+    void set_occlusion_culling(bool value, thread_pool *pool = NULL) {
+      occlusion_culling = value;
+      occlusion_pool = pool;
+    }
+
+    bool get_occlusion_culling() const {
+      return occlusion_culling;
+    }
+
+    /// number of mesh instances skipped by occlusion culling in the last render
+    int get_num_occluded_instances() {
+      return num_occluded_instances;
+    }
+
+    /// the occluders of the last render. Call init() on it to change its size.
+    occlusion_buffer &get_occlusion_buffer() {
+      return occlusion;
+    }
+
+    /// sort draws by program, material and mesh to reduce state changes (on by default)
+    void set_sort_draws(bool value) {
+      sort_draws = value;
+    }
+
+    /// draw runs of the same mesh and material with one call where the GL supports it (on by default)
+    void set_instancing(bool value) {
+      use_instancing = value;
+    }
+
+    /// draw calls and state changes in the last render
+    const render_stats &get_render_stats() const {
+      return draw_state.get_stats();
+    }
+
+    /// debugging aid to draw the lines, shapes and labels added to get_debug_draw()
     void set_render_debug_lines(bool value) {
       render_debug_lines = value;
     }
 
+    /// lines, shapes and labels to draw over the next render (see set_render_debug_lines()).
+    /// With bullet, pass this to btCollisionWorld::setDebugDrawer().
+    debug_draw *get_debug_draw() {
+      return debug;
+    }
+
     /// debugging aid to log vertices
     void set_dump_vertices(bool value) {
       dump_vertices = value;
@@ -469,12 +818,13 @@ namespace octet { namespace scene {
 
     /// get the approximate size of the scene, not including lights or cameras
     aabb get_world_aabb() {
+      update_world_transforms();
       aabb world_aabb;
       bool first = true;
       for (int i = 0; i != mesh_instances.size(); ++i) {
         mesh_instance *mi = mesh_instances[i];
         if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
+          const mat4t &nodeToWorld = mi->get_node()->get_nodeToWorld();
           aabb bb = mi->get_mesh()->get_aabb();
           bb = bb.get_transform(nodeToWorld);
           if (first) {
@@ -493,45 +843,245 @@ namespace octet { namespace scene {
       rational depth;
     };
 
-    /// brute force & ignorance ray cast.
-    /// return the mesh instance and location of hits.
-    /// todo: build a kd tree for mesh instance bbs & mesh triangles
+    /// ray cast against the triangles of the mesh instances.
+    /// return the nearest mesh instance hit and the depth of the hit along the ray (0 to 1),
+    /// or mi = 0 if nothing is hit.
     void cast_ray(cast_result &result, const ray &the_ray) {
       result.mi = 0;
       result.depth = rational(0, 0);
-
-      for (int i = 0; i != mesh_instances.size(); ++i) {
-        mesh_instance *mi = mesh_instances[i];
-        if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
-          mesh *mesh = mi->get_mesh();
-          aabb bb = mesh->get_aabb();
-          bb = bb.get_transform(nodeToWorld);
-          if (the_ray.intersects(bb)) {
-            mat4t worldToNode = nodeToWorld.inverse3x4();
-            //ray model_ray = ray(vec3(0, 0, -1), vec3(0, 0, 2)); //the_ray.get_transform(worldToNode);
-            ray model_ray = the_ray.get_transform(worldToNode);
-            int indices[3] = {0};
-            vec4 bary_numer(0, 0, 0, 0);
-            float bary_denom;
-            bool hit = mesh->ray_cast(model_ray, indices, bary_numer, bary_denom);
-            if (hit) {
-              rational depth(bary_numer.w() / bary_denom);
-              result.depth = min(depth, result.depth);
-            }
-            //printf("hit=%d %s %f\n", hit, (bary_numer/bary_denom).toString(tmp, sizeof(tmp)), (float)result.depth);
+      update_instance_tree();
+
+      query_results.resize(0);
+      instance_tree.query(the_ray, query_results);
+      for (unsigned i = 0; i != query_results.size(); ++i) {
+        int index = query_results[i];
+        mesh_instance *mi = mesh_instances[index];
+        if (!the_ray.intersects(instance_proxies[index].bounds)) continue;
+
+        mesh *mesh = mi->get_mesh();
+        ray model_ray = the_ray.get_transform(instance_proxies[index].worldToNode);
+        int indices[3] = {0};
+        vec4 bary_numer(0, 0, 0, 0);
+        float bary_denom;
+        bool hit = mesh->ray_cast(model_ray, indices, bary_numer, bary_denom);
+        if (hit) {
+          rational depth(bary_numer.w() / bary_denom);
+          if (!result.mi || depth.lt(result.depth) < 0) {
+            result.depth = depth;
+            result.mi = mi;
           }
         }
       }
     }
 
-    /// Debug rendering: add a new line in world space (old ones will be lost)
-    void add_debug_line(const vec3 &start, const vec3 &end) {
-      if (debug_line_buffer.size()) {
-        debug_line_buffer[debug_in_ptr++ & debug_line_buffer.size()-1] = start;
-        debug_line_buffer[debug_in_ptr++ & debug_line_buffer.size()-1] = end;
+    /// One ray for cast_rays(): the points origin + direction * t for 0 <= t < max_distance.
+    /// With a unit direction, t is the distance in world units.
+    struct ray_query {
+      vec3 origin;
+      vec3 direction;
+      float max_distance;
+      scene_node *ignore; ///< instances of this node are skipped (eg. the car casting the ray), may be NULL
+    };
+
+    /// Result of one ray from cast_rays().
+    struct ray_hit {
+      mesh_instance *mi; ///< nearest mesh instance hit, NULL if none
+      float distance; ///< t of the hit, max_distance if none
+      int index; ///< first index of the triangle hit in the mesh's index buffer, -1 if none
+    };
+
+  private:
+    // tests one ray against the triangles of the instances that the tree finds
+    struct instance_ray_cast {
+      const instance_proxy *proxies;
+      vec3 origin;
+      vec3 direction;
+      const scene_node *ignore;
+      unsigned triangle; // triangle of the last hit
+
+      float operator()(int index, float max_t) {
+        const instance_proxy &p = proxies[index];
+        if (!p.bvh || p.node == ignore) return max_t;
+        // model space t is the same as world space t, so the search distance carries over
+        vec3 org = (origin.xyz1() * p.worldToNode).xyz();
+        vec3 dir = (direction.xyz0() * p.worldToNode).xyz();
+        unsigned tri = 0;
+        float t = max_t;
+        if (!p.bvh->ray_cast(org, dir, tri, t, max_t)) return max_t;
+        triangle = tri;
+        return t;
+      }
+    };
+
+    struct ray_batch {
+      const visual_scene *scene;
+      const ray_query *queries;
+      ray_hit *results;
+      const uint64_t *order;
+    };
+
+    void cast_one_ray(ray_hit &hit, const ray_query &q) const {
+      instance_ray_cast cast = { instance_proxies.data(), q.origin, q.direction, q.ignore, 0 };
+      float t = q.max_distance;
+      int index = instance_tree.ray_cast(q.origin, q.direction, t, cast);
+      hit.mi = index == -1 ? (mesh_instance*)NULL : (mesh_instance*)mesh_instances[index];
+      hit.distance = t;
+      hit.index = index == -1 ? -1 : (int)cast.triangle;
+    }
+
+    // thread_pool job: cast rays [begin, end) of the sorted order
+    static void cast_ray_job(void *context, unsigned begin, unsigned end) {
+      OCTET_PROFILE("visual_scene::cast_ray_job");
+      const ray_batch &batch = *(const ray_batch*)context;
+      for (unsigned i = begin; i != end; ++i) {
+        unsigned r = (unsigned)batch.order[i];
+        batch.scene->cast_one_ray(batch.results[r], batch.queries[r]);
+      }
+    }
+
+    // spread the bits of a 10 bit number out to every third bit
+    static uint32_t spread_bits(uint32_t x) {
+      x = (x | (x << 16)) & 0x030000ff;
+      x = (x | (x << 8)) & 0x0300f00f;
+      x = (x | (x << 4)) & 0x030c30c3;
+      x = (x | (x << 2)) & 0x09249249;
+      return x;
+    }
+
+    // build or refresh the triangle trees for cast_rays() before any thread starts.
+    // Each mesh is visited once; the proxies are only repointed when a mesh or tree has changed.
+    void update_proxy_bvhs() {
+      for (unsigned i = 0; i != bvh_meshes.size() && bvh_meshes_valid; ++i) {
+        // a tree rebuilt for new vertices keeps its address.
+        if (bvh_meshes[i].msh->get_bvh() != bvh_meshes[i].bvh) bvh_meshes_valid = false;
+      }
+      if (bvh_meshes_valid) return;
+
+      bvh_meshes.resize(0);
+      hash_map<void *, unsigned> mesh_index; // index in bvh_meshes + 1
+      for (unsigned i = 0; i != instance_proxies.size(); ++i) {
+        instance_proxy &p = instance_proxies[i];
+        p.bvh = NULL;
+        if (p.proxy == -1) continue;
+        unsigned &index = mesh_index[(void*)p.msh];
+        if (index == 0) {
+          bvh_mesh bm = { p.msh, p.msh->get_bvh() };
+          bvh_meshes.push_back(bm);
+          index = bvh_meshes.size();
+        }
+        p.bvh = bvh_meshes[index - 1].bvh;
+      }
+      bvh_meshes_valid = true;
+    }
+
+    // order the rays so that neighbours start close together and point the same way
+    void sort_rays(const ray_query *queries, unsigned num_rays) {
+      vec3 lo = queries[0].origin, hi = lo;
+      for (unsigned i = 1; i < num_rays; ++i) {
+        lo = math::min(lo, queries[i].origin);
+        hi = math::max(hi, queries[i].origin);
+      }
+      vec3 size = hi - lo;
+      vec3 scale(
+        size.x() > 0 ? 1023.0f / size.x() : 0,
+        size.y() > 0 ? 1023.0f / size.y() : 0,
+        size.z() > 0 ? 1023.0f / size.z() : 0
+      );
+
+      // key: direction octant in the top three bits, then the morton code of the origin
+      ray_order[0].resize(num_rays);
+      ray_order[1].resize(num_rays);
+      uint64_t *keys = ray_order[0].data();
+      for (unsigned i = 0; i != num_rays; ++i) {
+        const ray_query &q = queries[i];
+        vec3 cell = (q.origin - lo) * scale;
+        uint32_t morton = (spread_bits((uint32_t)cell.x()) << 2) | (spread_bits((uint32_t)cell.y()) << 1) | spread_bits((uint32_t)cell.z());
+        uint32_t octant = (q.direction.x() < 0) * 4 + (q.direction.y() < 0) * 2 + (q.direction.z() < 0);
+        uint32_t key = (octant << 29) | (morton >> 1);
+        keys[i] = ((uint64_t)key << 32) | i;
+      }
+
+      // radix sort on the key, eight bits at a time. four passes leave the result back in ray_order[0]
+      for (unsigned pass = 0; pass != 4; ++pass) {
+        unsigned shift = 32 + pass * 8;
+        const uint64_t *src = ray_order[pass & 1].data();
+        uint64_t *dest = ray_order[(pass & 1) ^ 1].data();
+        unsigned count[257] = { 0 };
+        for (unsigned i = 0; i != num_rays; ++i) {
+          count[((src[i] >> shift) & 0xff) + 1]++;
+        }
+        for (unsigned b = 0; b != 256; ++b) {
+          count[b + 1] += count[b];
+        }
+        for (unsigned i = 0; i != num_rays; ++i) {
+          dest[count[(src[i] >> shift) & 0xff]++] = src[i];
+        }
       }
     }
+
+  public:
+    /// Cast many rays at the triangles of the mesh instances, for example AI sensors.
+    /// results[i] gets the nearest hit of queries[i].
+    /// The rays are sorted so that neighbouring rays visit the same parts of the scene, then
+    /// split between the threads of the pool (or run on this thread if pool is NULL).
+    /// Triangle trees are built for meshes that need them before any thread starts.
+    /// Skinned meshes are tested in their bind pose.
+    void cast_rays(ray_hit *results, const ray_query *queries, unsigned num_rays, thread_pool *pool = NULL) {
+      if (num_rays == 0) return;
+      update_instance_tree();
+      update_proxy_bvhs();
+
+      sort_rays(queries, num_rays);
+
+      // rays are handed out in chunks so that each thread keeps its share coherent
+      ray_batch batch = { this, queries, results, ray_order[0].data() };
+      if (pool) {
+        pool->run(cast_ray_job, &batch, num_rays, 64);
+      } else {
+        cast_ray_job(&batch, 0, num_rays);
+      }
+    }
+
+    /// find the mesh instances whose world space boxes overlap a box.
+    void find_mesh_instances(dynarray<mesh_instance*> &result, const aabb &bb) {
+      update_instance_tree();
+      query_results.resize(0);
+      instance_tree.query(bb, query_results);
+      for (unsigned i = 0; i != query_results.size(); ++i) {
+        int index = query_results[i];
+        if (instance_proxies[index].bounds.intersects(bb)) {
+          result.push_back(mesh_instances[index]);
+        }
+      }
+    }
+
+    /// find the mesh instances whose world space boxes touch a sphere, for example a trigger volume.
+    void find_mesh_instances(dynarray<mesh_instance*> &result, const sphere &sph) {
+      update_instance_tree();
+      query_results.resize(0);
+      instance_tree.query(sph, query_results);
+      instance_distance distance = { instance_proxies.data() };
+      float radius2 = sph.get_radius() * sph.get_radius();
+      for (unsigned i = 0; i != query_results.size(); ++i) {
+        int index = query_results[i];
+        if (distance(index, sph.get_center()) <= radius2) {
+          result.push_back(mesh_instances[index]);
+        }
+      }
+    }
+
+    /// find the mesh instance whose world space box is nearest to a point, or NULL if none is within max_distance.
+    mesh_instance *find_nearest_mesh_instance(vec3_in point, float max_distance = 1e18f) {
+      update_instance_tree();
+      instance_distance distance = { instance_proxies.data() };
+      int index = instance_tree.find_nearest(point, max_distance, distance);
+      return index == -1 ? (mesh_instance*)NULL : (mesh_instance*)mesh_instances[index];
+    }
+
+    /// Debug rendering: add a line in world space to draw in the next render.
+    void add_debug_line(const vec3 &start, const vec3 &end) {
+      debug->add_line(start, end);
+    }
   };
 }}
 
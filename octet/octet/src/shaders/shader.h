@@ -14,6 +14,10 @@ namespace octet { namespace shaders {
   class shader : public resource {
     GLuint program_;
 
+    // uniforms stay in the program between uses, this is who set them last.
+    const void *uniform_owner;
+    unsigned uniform_version;
+
     void link(GLuint vertex_shader, GLuint fragment_shader) {
           // assemble the program for use by glUseProgram
       GLuint program = glCreateProgram();
@@ -29,9 +33,11 @@ namespace octet { namespace shaders {
       glBindAttribLocation(program, attribute_blendindices, "blendindices");
       glBindAttribLocation(program, attribute_color, "color");
       glBindAttribLocation(program, attribute_uv, "uv");
+      glBindAttribLocation(program, attribute_instance_matrix, "instance_modelToCamera");
       glLinkProgram(program);
 
       program_ = program;
+      uniform_owner = NULL;
       GLsizei length;
       char buf[0x10000];
       glGetProgramInfoLog(program, sizeof(buf), &length, buf);
@@ -41,6 +47,9 @@ namespace octet { namespace shaders {
     }
   public:
     shader() {
+      program_ = 0;
+      uniform_owner = NULL;
+      uniform_version = 0;
     }
 
     GLuint program() { return program_; }
@@ -88,13 +97,22 @@ namespace octet { namespace shaders {
 
     // use the program we have compiled in init()
     void render() {
-      glUseProgram(program_);
+      gl_state::use_program(program_);
     }
 
     /// get the OpenGL program object.
     GLuint get_program() const {
       return program_;
     }
+
+    /// Record that owner has set this program's uniforms from version of its data.
+    /// Returns false if it already had, so they can be left alone.
+    bool set_uniform_owner(const void *owner, unsigned version) {
+      if (owner == uniform_owner && version == uniform_version) return false;
+      uniform_owner = owner;
+      uniform_version = version;
+      return true;
+    }
   };
 
 }}
@@ -28,6 +28,7 @@
   // shaders
   #include "../shaders/shader.h"
   #include "../shaders/color_shader.h"
+  #include "../shaders/vertex_color_shader.h"
   #include "../shaders/texture_shader.h"
   #include "../shaders/phong_shader.h"
   #include "../shaders/bump_shader.h"
@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Vertex color shader
+//
+// shader which renders with the color of each vertex, optionally cut out by the alpha of a texture
+
+namespace octet { namespace shaders {
+  class vertex_color_shader : public shader {
+    // index for model space to projection space matrix
+    GLuint modelToProjectionIndex_;
+
+    // index for the texture sampler, only used with textured shaders
+    GLuint samplerIndex_;
+  public:
+    /// textured shaders take the shape from the alpha of the texture (eg. a bitmap font)
+    void init(bool textured = false) {
+      const char vertex_shader[] = SHADER_STR(
+        varying vec2 uv_;
+        varying vec4 color_;
+
+        attribute vec4 pos;
+        attribute vec2 uv;
+        attribute vec4 color;
+
+        uniform mat4 modelToProjection;
+
+        void main() { gl_Position = modelToProjection * pos; uv_ = uv; color_ = color; }
+      );
+
+      const char fragment_shader[] = SHADER_STR(
+        varying vec4 color_;
+        void main() { gl_FragColor = color_; }
+      );
+
+      const char textured_fragment_shader[] = SHADER_STR(
+        varying vec2 uv_;
+        varying vec4 color_;
+        uniform sampler2D sampler;
+        void main() {
+          gl_FragColor = vec4(color_.xyz, color_.w * texture2D(sampler, uv_).w);
+          if (gl_FragColor.w < 0.05) discard;
+        }
+      );
+
+      shader::init(vertex_shader, textured ? textured_fragment_shader : fragment_shader);
+
+      modelToProjectionIndex_ = glGetUniformLocation(program(), "modelToProjection");
+      samplerIndex_ = glGetUniformLocation(program(), "sampler");
+    }
+
+    // start drawing with this shader
+    void render(const mat4t &modelToProjection, int sampler = 0) {
+      shader::render();
+
+      glUniformMatrix4fv(modelToProjectionIndex_, 1, GL_FALSE, modelToProjection.get());
+      if (samplerIndex_ != (GLuint)-1) glUniform1i(samplerIndex_, sampler);
+    }
+  };
+}}